@@ -0,0 +1,748 @@
+// bmper-load: replay a mix of BMP sizes through the cipher library and report
+// throughput and latency percentiles, so a change can be judged by its tail
+// latency and not only by GB/s.
+//
+//   bmper-load [--mix SIZE:WEIGHT,...] [--path mem|file] [--mode ECB|CBC|CTR|ICBC]
+//              [--concurrency N] [--rate REQ/S] [--duration SEC | --requests N]
+//              [--dir DIR] [--hist FILE] [--seed N]
+//   bmper-load --soak SEC [--interval SEC] [--corpus N] [--max-drop PCT] [--max-p99-rise PCT]
+//              [--max-rss-growth SIZE] [--max-fd-growth N] [--max-disk-read SIZE] [options above]
+//
+// One synthetic 24-bit BMP is made per size class, and every request picks a
+// class by weight (default: mostly thumbnails, the odd 64M scan).
+//
+// Closed loop (default): N workers each start the next request as soon as the
+// last one is done. Open loop (--rate): requests arrive at Poisson-distributed
+// times whatever the workers are doing, and latency counts from the arrival, so
+// time spent queued behind a huge scan shows up in the tail.
+//
+// mem: bmp_transform_mem() on a buffer. file: the BMP is read from DIR,
+// transformed through sdes_stream in 64K blocks and written to a file, as
+// bmper does.
+//
+// --soak runs for SEC seconds and samples every interval: throughput, p99,
+// RSS, open fds, page cache size, storage reads and major faults. The file
+// path cycles through a corpus of --corpus files and replaces a tenth of them
+// each interval; the mem path allocates every output buffer. At the end the
+// first quarter of the samples (after a warm-up interval) is compared with the
+// last quarter, and drift beyond the limits exits with status 2.
+
+#define _GNU_SOURCE
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+#include "bmpmem.h"
+#include "sdes.h"
+
+#define MAX_CLASSES 16
+#define MAX_WORKERS 256
+#define IO_BLOCK 65536
+
+static const char *MODE_NAMES[SDES_MODE_COUNT] = {"ECB", "CBC", "CTR", "ICBC"};
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t xorshift(uint64_t *s) {
+    *s ^= *s << 13; *s ^= *s >> 7; *s ^= *s << 17;
+    return *s;
+}
+
+// --- Latency histogram ---
+// HdrHistogram-style buckets: exact below 256 ns, then 128 sub-buckets per
+// power of two, so any recorded value is within 1% of the one reported.
+
+#define H_SUB 128
+#define H_BUCKETS (58 * H_SUB)
+
+typedef struct {
+    uint64_t count[H_BUCKETS];
+    uint64_t n, max, bytes;
+} hist_t;
+
+static int h_index(uint64_t v) {
+    if (v < 2 * H_SUB) return (int)v;
+    int shift = 63 - __builtin_clzll(v) - 7;
+    return shift * H_SUB + (int)(v >> shift);
+}
+
+// Largest value that falls in bucket i.
+static uint64_t h_value(int i) {
+    if (i < 2 * H_SUB) return (uint64_t)i;
+    int shift = i / H_SUB - 1;
+    return (((uint64_t)(i - shift * H_SUB) + 1) << shift) - 1;
+}
+
+static void h_add(hist_t *h, uint64_t v) {
+    h->count[h_index(v)]++;
+    h->n++;
+    if (v > h->max) h->max = v;
+}
+
+static void h_merge(hist_t *into, const hist_t *h) {
+    for (int i = 0; i < H_BUCKETS; ++i) into->count[i] += h->count[i];
+    into->n += h->n;
+    into->bytes += h->bytes;
+    if (h->max > into->max) into->max = h->max;
+}
+
+// Value at quantile q (0..1): at least that fraction of samples is <= it.
+static uint64_t h_quantile(const hist_t *h, double q) {
+    uint64_t want = (uint64_t)ceil(q * (double)h->n), seen = 0;
+    if (want == 0) want = 1;
+    for (int i = 0; i < H_BUCKETS; ++i) {
+        seen += h->count[i];
+        if (seen >= want) return h_value(i) < h->max ? h_value(i) : h->max;
+    }
+    return h->max;
+}
+
+// Percentile distribution in HdrHistogram's .hgrm layout (values in
+// microseconds), one line per occupied bucket, for its plotting tools.
+static int h_write(const hist_t *h, const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) return -1;
+    double sum = 0, sq = 0;
+    for (int i = 0; i < H_BUCKETS; ++i) {
+        double v = (double)h_value(i) / 1e3;
+        sum += v * (double)h->count[i];
+        sq += v * v * (double)h->count[i];
+    }
+    double mean = h->n ? sum / (double)h->n : 0;
+    fprintf(f, "%12s %14s %10s %14s\n\n", "Value", "Percentile", "TotalCount", "1/(1-Percentile)");
+    uint64_t seen = 0;
+    for (int i = 0; i < H_BUCKETS; ++i) {
+        if (!h->count[i]) continue;
+        seen += h->count[i];
+        double p = (double)seen / (double)h->n;
+        uint64_t v = h_value(i) < h->max ? h_value(i) : h->max;
+        if (seen < h->n) fprintf(f, "%12.3f %14.12f %10llu %14.2f\n", (double)v / 1e3, p, (unsigned long long)seen, 1 / (1 - p));
+        else fprintf(f, "%12.3f %14.12f %10llu\n", (double)v / 1e3, p, (unsigned long long)seen);
+    }
+    fprintf(f, "#[Mean    = %12.3f, StdDeviation   = %12.3f]\n", mean,
+            h->n ? sqrt(fmax(sq / (double)h->n - mean * mean, 0)) : 0.0);
+    fprintf(f, "#[Max     = %12.3f, Total count    = %12llu]\n", (double)h->max / 1e3, (unsigned long long)h->n);
+    fprintf(f, "#[Buckets = %12d, SubBuckets     = %12d]\n", H_BUCKETS / H_SUB, H_SUB);
+    return fclose(f);
+}
+
+static const char *fmt_ns(uint64_t ns, char *buf, size_t cap) {
+    if (ns < 1000) snprintf(buf, cap, "%llu ns", (unsigned long long)ns);
+    else if (ns < 1000000) snprintf(buf, cap, "%.1f us", ns / 1e3);
+    else if (ns < 1000000000) snprintf(buf, cap, "%.2f ms", ns / 1e6);
+    else snprintf(buf, cap, "%.2f s", ns / 1e9);
+    return buf;
+}
+
+// --- Workload ---
+
+typedef struct {
+    char label[24];         // the size as given, e.g. 16K
+    unsigned weight;
+    uint8_t *bmp;           // synthetic image
+    size_t len;
+    char path[4096];        // file path: where it was written
+} class_t;
+
+typedef struct {
+    class_t cls[MAX_CLASSES];
+    int ncls;
+    unsigned total_weight;
+    sdes_ctx_t ctx;
+    sdes_mode_t mode;
+    int file;               // file path instead of mem
+    const char *dir;
+
+    pthread_mutex_t lock;   // guards the generator below
+    uint64_t rng;
+    uint64_t start_ns, end_ns;      // end_ns 0 = run until limit requests
+    uint64_t limit, issued;
+    double gap_ns;          // open loop: mean time between arrivals, 0 = closed loop
+    uint64_t next_ns;       // open loop: arrival of the next request
+
+    int soak;
+    int corpus;             // soak file path: files used round robin, 0 = one per class
+    uint8_t *corpus_cls;    // class of each corpus file
+} load_t;
+
+typedef struct {
+    load_t *l;
+    int id;
+    hist_t hist[MAX_CLASSES];
+    uint64_t errors;
+    pthread_mutex_t lock;   // soak: guards window against the sampler
+    hist_t window;          // soak: requests since the last sample
+} worker_t;
+
+static size_t parse_size(const char *s, char **end) {
+    unsigned long long v = strtoull(s, end, 10);
+    switch (toupper((unsigned char)**end)) {
+    case 'K': v <<= 10; ++*end; break;
+    case 'M': v <<= 20; ++*end; break;
+    case 'G': v <<= 30; ++*end; break;
+    }
+    return (size_t)v;
+}
+
+// "SIZE:WEIGHT,..." into l->cls. Returns -1 on a malformed list.
+static int parse_mix(load_t *l, const char *s) {
+    l->ncls = 0;
+    l->total_weight = 0;
+    while (*s) {
+        if (l->ncls == MAX_CLASSES) return -1;
+        class_t *c = &l->cls[l->ncls];
+        char *end;
+        const char *start = s;
+        c->len = parse_size(s, &end);
+        if (c->len < 64 || c->len > ((size_t)1 << 32) || *end != ':' || (size_t)(end - start) >= sizeof(c->label)) return -1;
+        memcpy(c->label, start, (size_t)(end - start));
+        c->label[end - start] = '\0';
+        unsigned long w = strtoul(end + 1, &end, 10);
+        if (w == 0 || w > 1000000 || (*end && *end != ',')) return -1;
+        c->weight = (unsigned)w;
+        l->total_weight += c->weight;
+        l->ncls++;
+        s = *end ? end + 1 : end;
+    }
+    return l->ncls ? 0 : -1;
+}
+
+static void put_u32le(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); p[2] = (uint8_t)(v >> 16); p[3] = (uint8_t)(v >> 24);
+}
+
+// A 24-bit BMP of about len bytes: smooth gradients with noisy patches, so
+// ECB keeps some structure and CTR's run paths are crossed now and then.
+static uint8_t *make_bmp(size_t *len, uint64_t *rng) {
+    size_t px = (*len - 54) / 3, w = 4;
+    while ((w + 4) * (w + 4) <= px) w += 4;    // square-ish, rows without padding
+    size_t h = px / w ? px / w : 1;
+    if (w > px) w = px ? px : 1;
+    size_t stride = (w * 3 + 3) & ~(size_t)3, size = 54 + stride * h;
+    uint8_t *p = (uint8_t*)calloc(1, size);
+    if (!p) return NULL;
+    p[0] = 'B';
+    p[1] = 'M';
+    put_u32le(p + 2, (uint32_t)size);
+    put_u32le(p + 10, 54);
+    put_u32le(p + 14, 40);
+    put_u32le(p + 18, (uint32_t)w);
+    put_u32le(p + 22, (uint32_t)h);
+    p[26] = 1;
+    p[28] = 24;
+    put_u32le(p + 34, (uint32_t)(stride * h));
+    for (size_t y = 0; y < h; ++y) {
+        uint8_t *row = p + 54 + y * stride;
+        int noisy = (y / 16) % 3 == 0;
+        for (size_t x = 0; x < w; ++x) {
+            uint8_t r = (uint8_t)(x * 255 / w), g = (uint8_t)(y * 255 / h);
+            uint8_t b = noisy && (x / 16) % 2 ? (uint8_t)xorshift(rng) : (uint8_t)(r ^ g);
+            row[3 * x] = b; row[3 * x + 1] = g; row[3 * x + 2] = r;
+        }
+    }
+    *len = size;
+    return p;
+}
+
+static int write_file(const char *path, const uint8_t *p, size_t n) {
+    FILE *f = fopen(path, "wb");
+    if (!f) return -1;
+    size_t w = fwrite(p, 1, n, f);
+    return fclose(f) != 0 || w != n ? -1 : 0;
+}
+
+static void corpus_path(const load_t *l, int i, const char *ext, char *buf, size_t cap) {
+    snprintf(buf, cap, "%s/bmper-load-%d-c%d.%s", l->dir, (int)getpid(), i, ext);
+}
+
+// Next request: its number, class and when it arrived. Returns 0 when the
+// run is over.
+static int next_request(load_t *l, uint64_t *seq, int *cls, uint64_t *arrival) {
+    pthread_mutex_lock(&l->lock);
+    uint64_t t = l->gap_ns > 0 ? l->next_ns : now_ns();
+    int more = l->limit ? l->issued < l->limit : t < l->end_ns;
+    if (more) {
+        *seq = l->issued++;
+        if (l->gap_ns > 0) {
+            double u = (double)((xorshift(&l->rng) >> 11) + 1) / 9007199254740993.0;   // (0, 1]
+            l->next_ns += (uint64_t)(-log(u) * l->gap_ns);
+        }
+        unsigned pick = (unsigned)(xorshift(&l->rng) % l->total_weight);
+        int k = 0;
+        while (pick >= l->cls[k].weight) pick -= l->cls[k++].weight;
+        *cls = k;
+        *arrival = t;
+    }
+    pthread_mutex_unlock(&l->lock);
+    return more;
+}
+
+// The file path: header copied, pixel data transformed block by block.
+static int file_request(const load_t *l, const char *inpath, const char *outpath, uint8_t *buf) {
+    int in = open(inpath, O_RDONLY);
+    if (in < 0) return -1;
+    int out = open(outpath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out < 0) { close(in); return -1; }
+    sdes_stream_t st;
+    sdes_stream_init(&st, &l->ctx, l->mode, true, 0x5A);
+    uint64_t pos = 0, off = 54;
+    ssize_t n = 0;
+    int rc = 0;
+    while (rc == 0 && (n = read(in, buf, IO_BLOCK)) > 0) {
+        if (pos == 0 && n >= 14) off = (uint64_t)buf[10] | (uint64_t)buf[11] << 8 | (uint64_t)buf[12] << 16 | (uint64_t)buf[13] << 24;
+        uint64_t lo = off > pos ? off - pos : 0;
+        if (lo < (uint64_t)n) sdes_stream_process(&st, buf + lo, buf + lo, (size_t)n - lo);
+        if (write(out, buf, (size_t)n) != n) rc = -1;
+        pos += (uint64_t)n;
+    }
+    if (n < 0) rc = -1;
+    close(in);
+    if (close(out) != 0) rc = -1;
+    return rc;
+}
+
+static void *worker_main(void *arg) {
+    worker_t *w = (worker_t*)arg;
+    load_t *l = w->l;
+    size_t cap = IO_BLOCK;
+    for (int k = 0; k < l->ncls; ++k) if (!l->file && !l->soak && l->cls[k].len > cap) cap = l->cls[k].len;
+    uint8_t *buf = (uint8_t*)malloc(cap);
+    char inpath[4200], outpath[4200];
+    snprintf(outpath, sizeof(outpath), "%s/bmper-load-%d-out%d.bmp", l->dir, (int)getpid(), w->id);
+    int k;
+    uint64_t seq, arrival;
+    while (buf && next_request(l, &seq, &k, &arrival)) {
+        if (l->gap_ns > 0) {
+            struct timespec ts = { (time_t)(arrival / 1000000000u), (long)(arrival % 1000000000u) };
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {}
+        } else {
+            arrival = now_ns();
+        }
+        const char *src = l->cls[k].path;
+        if (l->corpus) {
+            int i = (int)(seq % (uint64_t)l->corpus);
+            k = l->corpus_cls[i];
+            corpus_path(l, i, "bmp", inpath, sizeof(inpath));
+            src = inpath;
+        }
+        const class_t *c = &l->cls[k];
+        int rc;
+        if (l->file) {
+            rc = file_request(l, src, outpath, buf);
+        } else if (l->soak) {
+            // A buffer per request, as a long-lived service would allocate it.
+            uint8_t *out = (uint8_t*)malloc(c->len);
+            rc = out ? bmp_transform_mem(&l->ctx, l->mode, true, 0x5A, c->bmp, out, c->len) : -1;
+            free(out);
+        } else {
+            rc = bmp_transform_mem(&l->ctx, l->mode, true, 0x5A, c->bmp, buf, c->len);
+        }
+        uint64_t lat = now_ns() - arrival;
+        h_add(&w->hist[k], lat);
+        w->hist[k].bytes += c->len;
+        if (rc != 0) w->errors++;
+        if (l->soak) {
+            pthread_mutex_lock(&w->lock);
+            h_add(&w->window, lat);
+            w->window.bytes += c->len;
+            pthread_mutex_unlock(&w->lock);
+        }
+    }
+    if (!buf) w->errors++;
+    free(buf);
+    if (l->file) unlink(outpath);
+    return NULL;
+}
+
+// --- Soak ---
+
+#define MIB 1048576.0
+
+typedef struct {
+    double t;               // seconds since the start
+    double rps, mbps;
+    uint64_t p99;           // ns
+    uint64_t rss, cached;   // bytes
+    uint64_t disk_read;     // bytes read from storage in the interval
+    long fds, majflt;       // majflt: in the interval
+} sample_t;
+
+typedef struct {
+    double interval;
+    double max_drop, max_p99_rise;      // percent
+    uint64_t max_rss_growth, max_disk_read;
+    long max_fd_growth;
+    sample_t *samples;
+    int n, cap;
+} soak_t;
+
+static uint64_t proc_rss(void) {
+    unsigned long long size, res = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f) {
+        if (fscanf(f, "%llu %llu", &size, &res) != 2) res = 0;
+        fclose(f);
+    }
+    return (uint64_t)res * (uint64_t)sysconf(_SC_PAGESIZE);
+}
+
+static long proc_fds(void) {
+    DIR *d = opendir("/proc/self/fd");
+    if (!d) return -1;
+    long n = 0;
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL) if (e->d_name[0] != '.') n++;
+    closedir(d);
+    return n - 1;   // the directory's own descriptor
+}
+
+// The number after "key" in a /proc file of "key value" lines, 0 if absent.
+static uint64_t proc_value(const char *path, const char *key) {
+    FILE *f = fopen(path, "r");
+    if (!f) return 0;
+    char line[256];
+    unsigned long long v = 0;
+    size_t n = strlen(key);
+    while (fgets(line, sizeof(line), f))
+        if (strncmp(line, key, n) == 0) { v = strtoull(line + n, NULL, 10); break; }
+    fclose(f);
+    return (uint64_t)v;
+}
+
+static long majflt(void) {
+    struct rusage ru;
+    return getrusage(RUSAGE_SELF, &ru) == 0 ? ru.ru_majflt : 0;
+}
+
+// Replace the next tenth of the corpus with new files (new inodes, so their
+// pages are new to the cache). Readers that have a file open keep the old one.
+static int rotate_corpus(load_t *l, int *cursor) {
+    char tmp[4200], path[4200];
+    int n = l->corpus / 10 ? l->corpus / 10 : 1;
+    for (int j = 0; j < n; ++j, *cursor = (*cursor + 1) % l->corpus) {
+        const class_t *c = &l->cls[l->corpus_cls[*cursor]];
+        corpus_path(l, *cursor, "tmp", tmp, sizeof(tmp));
+        corpus_path(l, *cursor, "bmp", path, sizeof(path));
+        if (write_file(tmp, c->bmp, c->len) != 0 || rename(tmp, path) != 0) { perror(tmp); return -1; }
+    }
+    return 0;
+}
+
+// Sample every interval until the run ends; workers keep running meanwhile.
+static int soak_sample(load_t *l, worker_t *w, int workers, soak_t *s) {
+    static hist_t win;
+    uint64_t step = (uint64_t)(s->interval * 1e9), next = l->start_ns + step, prev = l->start_ns;
+    uint64_t read0 = proc_value("/proc/self/io", "read_bytes:");
+    long flt0 = majflt();
+    int cursor = 0, rc = 0;
+    char q[16];
+    printf("%8s %9s %9s %10s %9s %5s %9s %10s %7s\n", "time", "req/s", "MB/s", "p99", "RSS", "fds",
+           "cached", "disk-read", "majflt");
+    for (; next <= l->end_ns; next += step) {
+        struct timespec ts = { (time_t)(next / 1000000000u), (long)(next % 1000000000u) };
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {}
+        memset(&win, 0, sizeof(win));
+        for (int t = 0; t < workers; ++t) {
+            pthread_mutex_lock(&w[t].lock);
+            h_merge(&win, &w[t].window);
+            memset(&w[t].window, 0, sizeof(w[t].window));
+            pthread_mutex_unlock(&w[t].lock);
+        }
+        uint64_t t1 = now_ns(), read1 = proc_value("/proc/self/io", "read_bytes:");
+        long flt1 = majflt();
+        double dt = (double)(t1 - prev) / 1e9;
+        if (s->n == s->cap) {
+            int cap = s->cap ? 2 * s->cap : 64;
+            sample_t *ns = (sample_t*)realloc(s->samples, (size_t)cap * sizeof(*ns));
+            if (!ns) { fprintf(stderr, "Out of memory\n"); return -1; }
+            s->samples = ns;
+            s->cap = cap;
+        }
+        sample_t *x = &s->samples[s->n++];
+        *x = (sample_t){ (double)(t1 - l->start_ns) / 1e9, (double)win.n / dt, (double)win.bytes / 1e6 / dt,
+                         h_quantile(&win, 0.99), proc_rss(), proc_value("/proc/meminfo", "Cached:") * 1024,
+                         read1 - read0, proc_fds(), flt1 - flt0 };
+        prev = t1;
+        read0 = read1;
+        flt0 = flt1;
+        printf("%7.1fs %9.1f %9.1f %10s %8.1fM %5ld %8.0fM %9.1fM %7ld\n", x->t, x->rps, x->mbps,
+               win.n ? fmt_ns(x->p99, q, sizeof(q)) : "-", x->rss / MIB, x->fds, x->cached / MIB,
+               x->disk_read / MIB, x->majflt);
+        fflush(stdout);
+        if (l->corpus && rc == 0) rc = rotate_corpus(l, &cursor);
+    }
+    return rc;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+enum { F_MBPS, F_P99, F_DISK };
+
+// Median of one field over n samples.
+static double median_field(const sample_t *x, int n, int field) {
+    double *v = (double*)malloc((size_t)n * sizeof(*v));
+    if (!v) return 0;
+    for (int i = 0; i < n; ++i)
+        v[i] = field == F_MBPS ? x[i].mbps : field == F_P99 ? (double)x[i].p99 : (double)x[i].disk_read;
+    qsort(v, (size_t)n, sizeof(*v), cmp_double);
+    double m = n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+    free(v);
+    return m;
+}
+
+static int check_line(const char *name, const char *from, const char *to, const char *change,
+                      const char *limit, int bad) {
+    printf("  %-11s %12s -> %-12s %9s   limit %-7s %s\n", name, from, to, change, limit, bad ? "DRIFT" : "ok");
+    return bad;
+}
+
+// Compare the first quarter of the samples (after the warm-up one) with the
+// last quarter: medians for rates and latency, which a single slow interval
+// does not move; for RSS and fds the final low against the baseline high, so
+// only growth that never goes back counts. Returns the number of metrics
+// that drifted past their limit.
+static int soak_check(const soak_t *s) {
+    if (s->n < 4) {
+        printf("Drift check skipped: %d sample(s), at least 4 needed (shorter --interval?)\n", s->n);
+        return 0;
+    }
+    int win = (s->n - 1) / 4 ? (s->n - 1) / 4 : 1;
+    const sample_t *b = s->samples + 1, *f = s->samples + s->n - win;
+    char x[24], y[24], d[24], lim[24];
+    int drift = 0;
+    printf("Drift check: samples %d-%d against %d-%d\n", 2, 1 + win, s->n - win + 1, s->n);
+
+    double tp0 = median_field(b, win, F_MBPS), tp1 = median_field(f, win, F_MBPS);
+    double pct = tp0 > 0 ? 100 * (tp1 - tp0) / tp0 : 0;
+    snprintf(x, sizeof(x), "%.1f MB/s", tp0);
+    snprintf(y, sizeof(y), "%.1f MB/s", tp1);
+    snprintf(d, sizeof(d), "%+.1f%%", pct);
+    snprintf(lim, sizeof(lim), "-%g%%", s->max_drop);
+    drift += check_line("throughput", x, y, d, lim, pct < -s->max_drop);
+
+    double p0 = median_field(b, win, F_P99), p1 = median_field(f, win, F_P99);
+    pct = p0 > 0 ? 100 * (p1 - p0) / p0 : 0;
+    snprintf(d, sizeof(d), "%+.1f%%", pct);
+    snprintf(lim, sizeof(lim), "+%g%%", s->max_p99_rise);
+    drift += check_line("p99", fmt_ns((uint64_t)p0, x, sizeof(x)), fmt_ns((uint64_t)p1, y, sizeof(y)), d, lim,
+                        pct > s->max_p99_rise);
+
+    uint64_t rss0 = 0, rss1 = UINT64_MAX;
+    long fd0 = 0, fd1 = 0x7FFFFFFF;
+    for (int i = 0; i < win; ++i) {
+        if (b[i].rss > rss0) rss0 = b[i].rss;
+        if (f[i].rss < rss1) rss1 = f[i].rss;
+        if (b[i].fds > fd0) fd0 = b[i].fds;
+        if (f[i].fds < fd1) fd1 = f[i].fds;
+    }
+    snprintf(x, sizeof(x), "%.1fM", rss0 / MIB);
+    snprintf(y, sizeof(y), "%.1fM", rss1 / MIB);
+    snprintf(d, sizeof(d), "%+.1fM", ((double)rss1 - (double)rss0) / MIB);
+    snprintf(lim, sizeof(lim), "+%gM", s->max_rss_growth / MIB);
+    drift += check_line("RSS", x, y, d, lim, rss1 > rss0 && rss1 - rss0 > s->max_rss_growth);
+
+    snprintf(x, sizeof(x), "%ld", fd0);
+    snprintf(y, sizeof(y), "%ld", fd1);
+    snprintf(d, sizeof(d), "%+ld", fd1 - fd0);
+    snprintf(lim, sizeof(lim), "+%ld", s->max_fd_growth);
+    drift += check_line("open fds", x, y, d, lim, fd1 - fd0 > s->max_fd_growth);
+
+    // Storage reads per interval: a corpus that no longer stays cached.
+    double d0 = median_field(b, win, F_DISK), d1 = median_field(f, win, F_DISK);
+    snprintf(x, sizeof(x), "%.1fM", d0 / MIB);
+    snprintf(y, sizeof(y), "%.1fM", d1 / MIB);
+    snprintf(d, sizeof(d), "%+.1fM", (d1 - d0) / MIB);
+    snprintf(lim, sizeof(lim), "+%gM", s->max_disk_read / MIB);
+    drift += check_line("disk reads", x, y, d, lim, d1 > d0 + (double)s->max_disk_read);
+
+    if (drift) printf("Soak: %d metric(s) drifted beyond their limits\n", drift);
+    else printf("Soak: no drift beyond the limits\n");
+    return drift;
+}
+
+static void report_line(const char *label, const hist_t *h, double share, double secs) {
+    char q[5][16];
+    printf("%-10s %6.1f%% %9llu %9.1f %10s %10s %10s %10s %10s\n", label, share, (unsigned long long)h->n,
+           (double)h->bytes / 1e6 / secs, fmt_ns(h_quantile(h, 0.50), q[0], 16), fmt_ns(h_quantile(h, 0.90), q[1], 16),
+           fmt_ns(h_quantile(h, 0.99), q[2], 16), fmt_ns(h_quantile(h, 0.999), q[3], 16), fmt_ns(h->max, q[4], 16));
+}
+
+static void usage(void) {
+    fprintf(stderr,
+        "Usage: bmper-load [--mix SIZE:WEIGHT,...] [--path mem|file] [--mode ECB|CBC|CTR|ICBC]\n"
+        "                  [--concurrency N] [--rate REQ/S] [--duration SEC | --requests N]\n"
+        "                  [--dir DIR] [--hist FILE] [--seed N]\n"
+        "  --mix          request sizes and their weights (default 16K:900,256K:90,4M:9,64M:1)\n"
+        "  --path         mem: bmp_transform_mem on buffers; file: read/transform/write files in DIR\n"
+        "  --concurrency  worker threads (default: online CPUs)\n"
+        "  --rate         open loop: Poisson arrivals at this rate, latency from arrival;\n"
+        "                 without it each worker sends its next request when the last is done\n"
+        "  --duration     seconds to run (default 10); --requests stops after N requests instead\n"
+        "  --dir          directory for the file path (default $TMPDIR or /tmp)\n"
+        "  --hist         write the overall latency distribution in HdrHistogram .hgrm form (us)\n"
+        "  --soak         run SEC seconds, sampling throughput, p99, RSS, fds and page cache every\n"
+        "                 --interval (default 10, at most SEC/10), then flag drift of the last quarter\n"
+        "                 against the first: --max-drop PCT (10), --max-p99-rise PCT (50),\n"
+        "                 --max-rss-growth SIZE (16M), --max-fd-growth N (0), --max-disk-read SIZE\n"
+        "                 per interval (64M); drift exits with status 2\n"
+        "  --corpus       soak file path: files cycled through and rotated (default 1000)\n");
+}
+
+int main(int argc, char **argv) {
+    static load_t l;
+    const char *mix = "16K:900,256K:90,4M:9,64M:1", *hist_path = NULL;
+    long workers = sysconf(_SC_NPROCESSORS_ONLN);
+    double rate = 0, duration = 0;
+    soak_t soak = { .max_drop = 10, .max_p99_rise = 50, .max_rss_growth = 16 << 20, .max_disk_read = 64 << 20 };
+    char *end;
+    l.mode = MODE_CBC;
+    l.rng = 0x9E3779B97F4A7C15ull;
+    l.dir = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+    for (int i = 1; i < argc; ++i) {
+        const char *a = argv[i], *v = i + 1 < argc ? argv[i + 1] : NULL;
+        if (!v) { usage(); return 1; }
+        ++i;
+        if (strcmp(a, "--mix") == 0) mix = v;
+        else if (strcmp(a, "--path") == 0 && (strcmp(v, "mem") == 0 || strcmp(v, "file") == 0)) l.file = v[0] == 'f';
+        else if (strcmp(a, "--concurrency") == 0) workers = atol(v);
+        else if (strcmp(a, "--rate") == 0) rate = atof(v);
+        else if (strcmp(a, "--duration") == 0) duration = atof(v);
+        else if (strcmp(a, "--requests") == 0) l.limit = strtoull(v, NULL, 10);
+        else if (strcmp(a, "--dir") == 0) l.dir = v;
+        else if (strcmp(a, "--hist") == 0) hist_path = v;
+        else if (strcmp(a, "--seed") == 0) l.rng = strtoull(v, NULL, 0) | 1;
+        else if (strcmp(a, "--soak") == 0) { l.soak = 1; duration = atof(v); }
+        else if (strcmp(a, "--interval") == 0) soak.interval = atof(v);
+        else if (strcmp(a, "--corpus") == 0) l.corpus = atoi(v);
+        else if (strcmp(a, "--max-drop") == 0) soak.max_drop = atof(v);
+        else if (strcmp(a, "--max-p99-rise") == 0) soak.max_p99_rise = atof(v);
+        else if (strcmp(a, "--max-rss-growth") == 0) soak.max_rss_growth = parse_size(v, &end);
+        else if (strcmp(a, "--max-fd-growth") == 0) soak.max_fd_growth = atol(v);
+        else if (strcmp(a, "--max-disk-read") == 0) soak.max_disk_read = parse_size(v, &end);
+        else if (strcmp(a, "--mode") == 0) {
+            int m = 0;
+            while (m < SDES_MODE_COUNT && strcasecmp(v, MODE_NAMES[m]) != 0) m++;
+            if (m == SDES_MODE_COUNT) { usage(); return 1; }
+            l.mode = (sdes_mode_t)m;
+        }
+        else { usage(); return 1; }
+    }
+    if (parse_mix(&l, mix) != 0) {
+        fprintf(stderr, "--mix expects SIZE:WEIGHT[,SIZE:WEIGHT...] with sizes from 64 bytes to 4G\n"); return 1;
+    }
+    if (workers < 1 || workers > MAX_WORKERS) { fprintf(stderr, "--concurrency expects 1 to %d\n", MAX_WORKERS); return 1; }
+    if (rate < 0 || duration < 0 || (l.limit && duration > 0)) { usage(); return 1; }
+    if (!l.limit && duration == 0) duration = 10;
+    if (l.soak) {
+        if (l.limit || duration <= 0 || soak.interval < 0 || l.corpus < 0 || soak.max_fd_growth < 0) {
+            fprintf(stderr, "--soak expects a duration in seconds and cannot be combined with --requests\n"); return 1;
+        }
+        if (soak.interval == 0) soak.interval = duration / 10 < 10 ? duration / 10 : 10;
+        if (l.file && l.corpus == 0) l.corpus = 1000;
+        if (!l.file) l.corpus = 0;
+    } else if (l.corpus || soak.interval) {
+        fprintf(stderr, "--corpus and --interval need --soak\n"); return 1;
+    }
+
+    sdes_ctx_init(&l.ctx, 0x282);
+    int rc = 1;
+    for (int k = 0; k < l.ncls; ++k) {
+        class_t *c = &l.cls[k];
+        if (!(c->bmp = make_bmp(&c->len, &l.rng))) { fprintf(stderr, "Out of memory\n"); goto out; }
+        if (l.file && !l.corpus) {
+            snprintf(c->path, sizeof(c->path), "%s/bmper-load-%d-%d.bmp", l.dir, (int)getpid(), k);
+            if (write_file(c->path, c->bmp, c->len) != 0) { perror(c->path); goto out; }
+        }
+    }
+    if (l.corpus) {
+        // Sizes by weight, as requests would pick them.
+        char path[4200];
+        if (!(l.corpus_cls = (uint8_t*)malloc((size_t)l.corpus))) { fprintf(stderr, "Out of memory\n"); goto out; }
+        for (int i = 0; i < l.corpus; ++i) {
+            unsigned pick = (unsigned)(xorshift(&l.rng) % l.total_weight);
+            int k = 0;
+            while (pick >= l.cls[k].weight) pick -= l.cls[k++].weight;
+            l.corpus_cls[i] = (uint8_t)k;
+            corpus_path(&l, i, "bmp", path, sizeof(path));
+            if (write_file(path, l.cls[k].bmp, l.cls[k].len) != 0) { perror(path); l.corpus = i + 1; goto out; }
+        }
+    }
+    pthread_mutex_init(&l.lock, NULL);
+    l.gap_ns = rate > 0 ? 1e9 / rate : 0;
+
+    worker_t *w = (worker_t*)calloc((size_t)workers, sizeof(*w));
+    pthread_t tids[MAX_WORKERS];
+    if (!w) { fprintf(stderr, "Out of memory\n"); goto out; }
+    l.start_ns = l.next_ns = now_ns();
+    l.end_ns = l.limit ? 0 : l.start_ns + (uint64_t)(duration * 1e9);
+    int started = 0;
+    for (; started < workers; ++started) {
+        w[started].l = &l;
+        w[started].id = started;
+        pthread_mutex_init(&w[started].lock, NULL);
+        if (pthread_create(&tids[started], NULL, worker_main, &w[started]) != 0) break;
+    }
+    if (started == 0) { fprintf(stderr, "Cannot start workers\n"); free(w); goto out; }
+    int soak_rc = 0;
+    if (l.soak && (soak_rc = soak_sample(&l, w, started, &soak)) != 0) {
+        pthread_mutex_lock(&l.lock);
+        l.end_ns = 0;       // stop issuing requests
+        pthread_mutex_unlock(&l.lock);
+    }
+    for (int t = 0; t < started; ++t) pthread_join(tids[t], NULL);
+    double secs = (double)(now_ns() - l.start_ns) / 1e9;
+
+    static hist_t per[MAX_CLASSES], all;
+    uint64_t errors = 0;
+    for (int t = 0; t < started; ++t) {
+        errors += w[t].errors;
+        for (int k = 0; k < l.ncls; ++k) h_merge(&per[k], &w[t].hist[k]);
+    }
+    for (int k = 0; k < l.ncls; ++k) h_merge(&all, &per[k]);
+    free(w);
+
+    printf("%s path, %s encrypt, %d worker(s), kernel %s\n", l.file ? "file" : "mem", MODE_NAMES[l.mode],
+           started, sdes_kernel_name());
+    if (rate > 0) printf("Open loop: %.1f req/s offered (Poisson), latency from arrival\n", rate);
+    else printf("Closed loop: latency is service time\n");
+    printf("%-10s %7s %9s %9s %10s %10s %10s %10s %10s\n", "size", "share", "requests", "MB/s",
+           "p50", "p90", "p99", "p99.9", "max");
+    for (int k = 0; k < l.ncls; ++k)
+        if (per[k].n) report_line(l.cls[k].label, &per[k], 100.0 * (double)per[k].n / (double)all.n, secs);
+    if (all.n) report_line("all", &all, 100.0, secs);
+    printf("%llu request(s) in %.2f s: %.1f req/s, %.1f MB/s, %llu error(s)\n", (unsigned long long)all.n, secs,
+           (double)all.n / secs, (double)all.bytes / 1e6 / secs, (unsigned long long)errors);
+    if (hist_path && h_write(&all, hist_path) != 0) { perror(hist_path); goto out; }
+    int drift = l.soak && soak_rc == 0 ? soak_check(&soak) : 0;
+    rc = errors || soak_rc ? 1 : drift ? 2 : 0;
+out:
+    for (int k = 0; k < l.ncls; ++k) {
+        free(l.cls[k].bmp);
+        if (l.file && l.cls[k].path[0]) unlink(l.cls[k].path);
+    }
+    for (int i = 0; i < l.corpus; ++i) {
+        char path[4200];
+        corpus_path(&l, i, "bmp", path, sizeof(path));
+        unlink(path);
+        corpus_path(&l, i, "tmp", path, sizeof(path));
+        unlink(path);
+    }
+    free(l.corpus_cls);
+    free(soak.samples);
+    return rc;
+}
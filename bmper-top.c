@@ -0,0 +1,83 @@
+// bmper-top: display the live counters a running `bmper --stats NAME` publishes.
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "stats.h"
+
+static const char *MODE_NAMES[4] = {"ECB", "CBC", "CTR", "ICBC"};
+static const char *STAGE_NAMES[STAGE_COUNT] = {"read", "transform", "write"};
+
+typedef struct {
+    uint64_t bytes_in[4], bytes_out[4];
+    uint64_t files_done, errors, queue_depth;
+    uint64_t busy_ns[STAGE_COUNT];
+} snapshot_t;
+
+static void take(const bmper_stats_t *s, snapshot_t *o) {
+    for (int m = 0; m < 4; ++m) {
+        o->bytes_in[m] = atomic_load_explicit(&s->bytes_in[m], memory_order_relaxed);
+        o->bytes_out[m] = atomic_load_explicit(&s->bytes_out[m], memory_order_relaxed);
+    }
+    o->files_done = atomic_load_explicit(&s->files_done, memory_order_relaxed);
+    o->errors = atomic_load_explicit(&s->errors, memory_order_relaxed);
+    o->queue_depth = atomic_load_explicit(&s->queue_depth, memory_order_relaxed);
+    for (int k = 0; k < STAGE_COUNT; ++k)
+        o->busy_ns[k] = atomic_load_explicit(&s->busy_ns[k], memory_order_relaxed);
+}
+
+int main(int argc, char **argv) {
+    const char *name = argc > 1 ? argv[1] : "bmper";
+    double interval = argc > 2 ? atof(argv[2]) : 1.0;
+    if (interval <= 0) interval = 1.0;
+
+    char path[256];
+    if (name[0] == '/') snprintf(path, sizeof(path), "%s", name);
+    else snprintf(path, sizeof(path), "/%s", name);
+
+    int fd = shm_open(path, O_RDONLY, 0);
+    if (fd < 0) { perror("shm_open"); return 1; }
+    struct stat sb;
+    if (fstat(fd, &sb) != 0 || (size_t)sb.st_size < sizeof(bmper_stats_t)) {
+        fprintf(stderr, "Segment %s is too small\n", path); close(fd); return 1;
+    }
+    const bmper_stats_t *s = mmap(NULL, sizeof(bmper_stats_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (s == MAP_FAILED) { perror("mmap"); return 1; }
+    if (s->magic != BMPER_STATS_MAGIC || s->version != BMPER_STATS_VERSION) {
+        fprintf(stderr, "Segment %s is not a version %u bmper stats page\n", path, BMPER_STATS_VERSION);
+        return 1;
+    }
+
+    snapshot_t prev, cur;
+    take(s, &prev);
+    for (;;) {
+        usleep((useconds_t)(interval * 1e6));
+        take(s, &cur);
+        double up = (stats_now_ns() - s->start_ns) / 1e9;
+        printf("\033[H\033[2J");
+        printf("bmper pid %u  up %.1fs  files %llu  errors %llu  queued %llu\n\n",
+               s->pid, up, (unsigned long long)cur.files_done,
+               (unsigned long long)cur.errors, (unsigned long long)cur.queue_depth);
+        printf("%-4s %14s %14s %12s\n", "mode", "in (MiB)", "out (MiB)", "in MiB/s");
+        for (int m = 0; m < 4; ++m) {
+            double rate = (cur.bytes_in[m] - prev.bytes_in[m]) / interval / 1048576.0;
+            printf("%-4s %14.1f %14.1f %12.1f\n", MODE_NAMES[m],
+                   cur.bytes_in[m] / 1048576.0, cur.bytes_out[m] / 1048576.0, rate);
+        }
+        printf("\n%-10s %12s %8s\n", "stage", "busy (s)", "busy %");
+        for (int k = 0; k < STAGE_COUNT; ++k) {
+            double d = (cur.busy_ns[k] - prev.busy_ns[k]) / 1e9;
+            printf("%-10s %12.2f %7.1f%%\n", STAGE_NAMES[k], cur.busy_ns[k] / 1e9, 100.0 * d / interval);
+        }
+        fflush(stdout);
+        prev = cur;
+        if (kill((pid_t)s->pid, 0) != 0) { printf("\nbmper exited\n"); break; }
+    }
+    return 0;
+}
@@ -1,4 +1,4 @@
-// BMP Encrypt/Decrypt using S-DES in ECB/CBC/CTR modes.
+// BMP Encrypt/Decrypt using S-DES in ECB/CBC/CTR/ICBC modes.
 // This file replaces the "placeholder" logic by calling sdes_* routines.
 // It preserves the BMP header and encrypts only pixel data (starting at bfOffBits).
 
@@ -7,7 +7,27 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "sdes.h"
+#include "png.h"
+#include "stats.h"
+#include "iohint.h"
+#include "pyramid.h"
+#include "pack.h"
+#include "cgroup.h"
+#include "jobq.h"
+#include "keyscan.h"
+#include "leak.h"
+#include "gzpipe.h"
+#include "manifest.h"
+#include "trace.h"
+
+#define IO_BLOCK 65536   // default cipher block; see cg_plan for sized values
 
 static int read_uint32_le(const unsigned char *p) {
     return (int)(p[0] | (p[1]<<8) | (p[2]<<16) | (p[3]<<24));
@@ -18,6 +38,1302 @@ static void trim_newline(char *s) {
     while (n && (s[n-1]=='\n' || s[n-1]=='\r')) { s[--n] = '\0'; }
 }
 
+static void put_uint32_le(unsigned char *p, uint32_t v) {
+    p[0] = (unsigned char)v; p[1] = (unsigned char)(v>>8);
+    p[2] = (unsigned char)(v>>16); p[3] = (unsigned char)(v>>24);
+}
+
+static int ends_with_ci(const char *s, const char *suffix) {
+    size_t n = strlen(s), m = strlen(suffix);
+    return n >= m && strcasecmp(s + n - m, suffix) == 0;
+}
+
+// Cooperative preemption for scheduled jobs: after every `every` bytes of
+// output, fn runs queued urgent work on this thread, then the transform resumes.
+typedef struct {
+    void (*fn)(void *arg);
+    void *arg;
+    size_t every, since;
+} preempt_t;
+
+// Returns 1 if fn ran.
+static int preempt_point(preempt_t *p, size_t n) {
+    if (!p) return 0;
+    p->since += n;
+    if (p->since < p->every) return 0;
+    p->since = 0;
+    p->fn(p->arg);
+    return 1;
+}
+
+typedef struct {
+    const char *inpath;
+    const char *outpath;
+    const sdes_ctx_t *ctx;
+    sdes_mode_t mode;
+    int do_encrypt;
+    uint8_t iv_or_nonce;
+    int lanes;          // ICBC encryption: lane count to use and record, 0 = default
+    int io_hints;       // batch runs: HINT_INPUT and/or HINT_OUTPUT below
+    uint32_t row_first; // with row_count > 0: transform only these pixel rows
+    uint32_t row_count;
+    int pyramid_levels; // > 1: also write downsampled levels (see pyramid.h)
+    size_t block;       // bytes per read/transform/write step, 0 = IO_BLOCK
+    uint32_t align;     // > 0: pad the header so BMP pixel data starts at a multiple of this
+    off_t wb_window;    // write-behind window with io_hints, 0 = IO_WB_WINDOW
+    int gz_threads;     // compressing threads for .gz output, 0 = 1
+    int raw;            // --raw: no BMP/PNG handling, see raw_offset
+    uint64_t raw_offset; // transform input bytes [raw_offset, raw_offset + raw_length)
+    uint64_t raw_length; // (0 = to the end) and copy the rest unchanged
+    preempt_t *preempt; // scheduled bulk jobs: yield to urgent work, else NULL
+} job_t;
+
+#define HINT_INPUT 1    // sequential readahead, drop consumed input pages
+#define HINT_OUTPUT 2   // write-behind of the output file
+
+// ICBC records its lane count in bfReserved1 (header bytes 6-7) so decryption
+// uses the same chains: encryption writes it, decryption reads and clears it.
+// Sets the stream's lanes; returns 1 (after a message) if there is no valid count.
+static int icbc_header_lanes(const job_t *job, unsigned char *header, sdes_stream_t *st) {
+    unsigned lanes = job->do_encrypt ? (job->lanes ? (unsigned)job->lanes : SDES_ICBC_LANES)
+                                     : (unsigned)(header[6] | (header[7] << 8));
+    if (sdes_stream_set_lanes(st, lanes) != 0) {
+        fprintf(stderr,"Not an ICBC file: bfReserved1 holds no lane count (16/32/64)\n"); return 1;
+    }
+    header[6] = job->do_encrypt ? (unsigned char)lanes : 0;
+    header[7] = 0;
+    return 0;
+}
+
+// --align: grow the region before the pixel array by pad zero bytes so that
+// bfOffBits lands on the requested boundary. hdr holds [0, off_bits) of the
+// file; bfSize and a BITMAPV5 profile stored after the pixels move with it.
+// Returns 1 (after a message) if the file would outgrow 32-bit offsets.
+static int align_header(unsigned char *hdr, uint32_t off_bits, uint32_t pad) {
+    uint64_t size = (uint32_t)read_uint32_le(&hdr[2]);
+    if ((uint64_t)off_bits + pad > 0xFFFFFFFFu || (size && size + pad > 0xFFFFFFFFu)) {
+        fprintf(stderr,"--align: file too large for BMP offsets\n"); return 1;
+    }
+    if (size) put_uint32_le(&hdr[2], (uint32_t)(size + pad));
+    put_uint32_le(&hdr[10], off_bits + pad);
+    uint32_t info = (uint32_t)read_uint32_le(&hdr[14]);
+    if (info >= 124 && off_bits >= 14 + 124) {
+        // bV5ProfileData is relative to the info header
+        uint32_t prof = (uint32_t)read_uint32_le(&hdr[14 + 112]);
+        if (prof && 14 + (uint64_t)prof >= off_bits) put_uint32_le(&hdr[14 + 112], prof + pad);
+    }
+    return 0;
+}
+
+static uint32_t align_pad(uint32_t off_bits, uint32_t align) {
+    return align ? (align - off_bits % align) % align : 0;
+}
+
+static int write_zeros(FILE *fo, uint32_t n) {
+    static const unsigned char zeros[4096];
+    while (n > 0) {
+        uint32_t c = n < sizeof(zeros) ? n : (uint32_t)sizeof(zeros);
+        if (fwrite(zeros,1,c,fo) != c) return 1;
+        n -= c;
+    }
+    return 0;
+}
+
+// Decode a PNG row by row and transform it in the same pass. With png_out the
+// raw rows are transformed and stored in an uncompressed PNG; otherwise rows
+// are converted to a top-down 24/32-bit BMP and its pixel stream (including
+// row padding) is transformed, so the result decrypts like any other BMP.
+static int transform_png(FILE *fi, FILE *fo, int png_out, sdes_stream_t *st, uint32_t align, preempt_t *pre) {
+    bmper_stats_t *stats = bmper_stats;
+    png_reader_t pr;
+    int rc = png_open(&pr, fi);
+    if (rc == -3 || rc == -4) {
+        fprintf(stderr,"Unsupported PNG (%s)\n", rc == -4 ? "interlaced" : "color type/bit depth");
+        png_close(&pr); return 1;
+    }
+    if (rc != 0) { fprintf(stderr,"Bad PNG header\n"); png_close(&pr); return 1; }
+
+    size_t outrow;
+    int oc = png_bgr_channels(&pr);
+    png_writer_t pw;
+    if (png_out) {
+        outrow = pr.rowbytes;
+        if (png_write_begin(&pw, fo, &pr) != 0) { perror("write output"); png_close(&pr); return 1; }
+    } else {
+        outrow = (((size_t)pr.width * oc) + 3) & ~(size_t)3;
+        uint64_t image = (uint64_t)outrow * pr.height;
+        if (pr.width > 0x7FFFFFFF || pr.height > 0x7FFFFFFF || image + 54 > 0xFFFFFFFFu) {
+            fprintf(stderr,"PNG too large for BMP output\n"); png_close(&pr); return 1;
+        }
+        unsigned char h[54] = {'B','M'};
+        put_uint32_le(&h[2], (uint32_t)(image + 54));
+        put_uint32_le(&h[10], 54);
+        put_uint32_le(&h[14], 40);
+        put_uint32_le(&h[18], pr.width);
+        put_uint32_le(&h[22], (uint32_t)-(int32_t)pr.height); // negative: rows stored top-down
+        if (st->mode == MODE_ICBC) h[6] = st->lanes;
+        h[26] = 1;
+        h[28] = (unsigned char)(oc * 8);
+        put_uint32_le(&h[34], (uint32_t)image);
+        put_uint32_le(&h[38], 2835);
+        put_uint32_le(&h[42], 2835);
+        uint32_t pad = align_pad(54, align);
+        if (align_header(h, 54, pad) != 0) { png_close(&pr); return 1; }
+        fwrite(h,1,sizeof(h),fo);
+        write_zeros(fo, pad);
+    }
+
+    unsigned char *obuf = (unsigned char*)calloc(1, outrow ? outrow : 1);
+    if (!obuf) {
+        fprintf(stderr,"OOM\n");
+        if (png_out) free(pw.buf);
+        png_close(&pr); return 1;
+    }
+    const uint8_t *row;
+    while ((rc = png_read_row(&pr, &row)) == 1) {
+        if (png_out) memcpy(obuf, row, outrow);
+        else {
+            png_row_to_bgr(&pr, row, obuf);
+            memset(obuf + (size_t)pr.width * oc, 0, outrow - (size_t)pr.width * oc);
+        }
+        uint64_t t0 = stats ? stats_now_ns() : 0;
+        sdes_stream_process(st, obuf, obuf, outrow);
+        if (stats) {
+            stats_add(&stats->busy_ns[STAGE_TRANSFORM], stats_now_ns() - t0);
+            stats_add(&stats->bytes_in[st->mode], pr.rowbytes);
+            stats_add(&stats->bytes_out[st->mode], outrow);
+        }
+        if (png_out) png_write_row(&pw, obuf, outrow);
+        else fwrite(obuf,1,outrow,fo);
+        preempt_point(pre, outrow);
+    }
+    free(obuf);
+    png_close(&pr);
+    if (png_out && png_write_end(&pw) != 0) rc = -1;
+    if (rc != 0) { fprintf(stderr,"Corrupt or truncated PNG data\n"); return 1; }
+    if (ferror(fo)) { perror("write output"); return 1; }
+    return 0;
+}
+
+// Packed 1/2/4-bit pixel rows. Each byte holds several pixels (MSB first), and
+// the last byte of a row may be partly padding, followed by pad bytes up to a
+// 4-byte boundary. Only pixel bits are transformed: whole pixel bytes through
+// the stream, the final partial byte through a masked merge, and the padding
+// is copied unchanged. Memory is one row.
+static void transform_packed_row(sdes_stream_t *st, unsigned char *row, size_t n,
+                                 size_t full, uint8_t tail_mask) {
+    sdes_stream_process(st, row, row, n < full ? n : full);
+    if (tail_mask && n > full) row[full] = sdes_stream_partial(st, row[full], tail_mask);
+}
+
+static int transform_packed(FILE *fi, FILE *fo, sdes_stream_t *st, int width, int height, int bits,
+                            preempt_t *pre) {
+    bmper_stats_t *stats = bmper_stats;
+    if (width <= 0) { fprintf(stderr,"Bad BMP width\n"); return 1; }
+    uint64_t rows = height < 0 ? -(int64_t)height : height;
+    uint64_t used = (uint64_t)width * bits;
+    size_t stride = (size_t)(((used + 31) / 32) * 4);
+    size_t full = (size_t)(used / 8);
+    uint8_t tail_mask = (uint8_t)(0xFF00u >> (used % 8));
+
+    unsigned char *row = (unsigned char*)malloc(stride);
+    if (!row) { fprintf(stderr,"OOM\n"); return 1; }
+    uint64_t total = 0, r;
+    size_t n = 0;
+    for (r = 0; r < rows && (n = fread(row,1,stride,fi)) > 0; ++r) {
+        transform_packed_row(st, row, n, full, tail_mask);
+        fwrite(row,1,n,fo);
+        total += n;
+        preempt_point(pre, n);
+    }
+    // Anything after the last row is not pixel data; copy it unchanged.
+    while (r == rows && (n = fread(row,1,stride,fi)) > 0) fwrite(row,1,n,fo);
+    free(row);
+    if (stats) {
+        stats_add(&stats->bytes_in[st->mode], total);
+        stats_add(&stats->bytes_out[st->mode], total);
+    }
+    return 0;
+}
+
+// Everything needed to transform one file.
+// Transform only rows [row_first, row_first + row_count) of the pixel array
+// (file order, i.e. bottom-up for positive heights) as one stream. The output
+// starts as a clone of the input (a reflink where the filesystem supports it),
+// then only the transformed byte range is rewritten, so untouched data keeps
+// sharing extents with the source.
+static int process_rows(const job_t *job) {
+    int in = open(job->inpath, O_RDONLY);
+    if (in < 0) { perror("open input"); return 1; }
+    struct stat sb;
+    unsigned char header[54];
+    if (fstat(in, &sb) != 0 || pread(in, header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+        header[0] != 'B' || header[1] != 'M') {
+        fprintf(stderr,"--rows needs a BMP input\n"); close(in); return 1;
+    }
+    int offBits = read_uint32_le(&header[10]);
+    if (offBits < 54) offBits = 54;
+    int width = read_uint32_le(&header[18]), height = read_uint32_le(&header[22]);
+    int bits = header[28] | (header[29]<<8);
+    int compression = read_uint32_le(&header[30]);
+    if (read_uint32_le(&header[14]) < 40 || width <= 0 || bits == 0 ||
+        (compression != 0 && compression != 3)) {
+        fprintf(stderr,"--rows needs an uncompressed BMP with a 40+ byte info header\n"); close(in); return 1;
+    }
+    uint64_t rows = height < 0 ? -(int64_t)height : height;
+    uint64_t used = (uint64_t)width * bits;
+    size_t stride = (size_t)(((used + 31) / 32) * 4);
+    int packed = bits < 8;
+    size_t full = (size_t)(used / 8);
+    uint8_t tail_mask = packed ? (uint8_t)(0xFF00u >> (used % 8)) : 0;
+    if (job->row_first >= rows) { fprintf(stderr,"--rows starts past the last row (%llu)\n", (unsigned long long)rows); close(in); return 1; }
+    uint64_t count = job->row_count;
+    if (count > rows - job->row_first) count = rows - job->row_first;
+
+    int out = open(job->outpath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out < 0) { perror("open output"); close(in); return 1; }
+    if (io_clone_file(in, out, sb.st_size) != 0) {
+        perror("copy input to output"); close(in); close(out); return 1;
+    }
+
+    sdes_stream_t st;
+    sdes_stream_init(&st, job->ctx, job->mode, job->do_encrypt, job->iv_or_nonce);
+    if (job->mode == MODE_ICBC &&
+        (icbc_header_lanes(job, header, &st) != 0 || pwrite(out, &header[6], 2, 6) != 2)) {
+        close(in); close(out); return 1;
+    }
+    size_t block = job->block ? job->block : IO_BLOCK;
+    size_t chunk_rows = stride >= block ? 1 : block / stride;
+    unsigned char *buf = (unsigned char*)malloc(chunk_rows * stride);
+    if (!buf) { fprintf(stderr,"OOM\n"); close(in); close(out); return 1; }
+
+    int rc = 0;
+    uint64_t total = 0;
+    off_t pos = offBits + (off_t)(job->row_first * stride);
+    for (uint64_t r = 0; r < count && rc == 0; r += chunk_rows) {
+        size_t nr = count - r < chunk_rows ? (size_t)(count - r) : chunk_rows;
+        uint64_t t0 = trace_begin();
+        ssize_t n = pread(in, buf, nr * stride, pos);
+        if (n <= 0) break; // truncated pixel array: transform what exists
+        uint64_t t1 = trace_begin();
+        if (packed) {
+            for (size_t k = 0; k * stride < (size_t)n; ++k) {
+                size_t rn = (size_t)n - k * stride < stride ? (size_t)n - k * stride : stride;
+                transform_packed_row(&st, buf + k * stride, rn, full, tail_mask);
+            }
+        } else {
+            sdes_stream_process(&st, buf, buf, (size_t)n);
+        }
+        uint64_t t2 = trace_begin();
+        if (pwrite(out, buf, (size_t)n, pos) != n) { perror("write output"); rc = 1; }
+        if (trace_on) {
+            trace_span("read", NULL, t0, t1, (uint64_t)n);
+            trace_span("transform", NULL, t1, t2, (uint64_t)n);
+            trace_end(t2, "write", (uint64_t)n);
+        }
+        pos += n;
+        total += (uint64_t)n;
+        preempt_point(job->preempt, (size_t)n);
+    }
+    free(buf);
+    close(in);
+    if (close(out) != 0 && rc == 0) { perror("write output"); rc = 1; }
+    if (bmper_stats) {
+        stats_add(&bmper_stats->bytes_in[job->mode], total);
+        stats_add(&bmper_stats->bytes_out[job->mode], total);
+    }
+    return rc;
+}
+
+// Copy fi (now at input offset in_pos) to fo in blocks, transforming input
+// bytes [first, first + count) through the bulk API on the way; count may
+// run past the end of the input. This is the pixel pass for BMPs and the whole
+// job for --raw.
+static int transform_payload(const job_t *job, FILE *fi, FILE *fo, sdes_stream_t *st,
+                             off_t in_pos, uint64_t first, uint64_t count) {
+    bmper_stats_t *stats = bmper_stats;
+    uint64_t last = count > UINT64_MAX - first ? UINT64_MAX : first + count;
+    size_t block = job->block ? job->block : IO_BLOCK;
+    unsigned char *buf = (unsigned char*)malloc(block);
+    if (!buf) { fprintf(stderr,"OOM\n"); return 1; }
+    size_t n;
+    io_wb_t wb;
+    off_t out_pos = 0;
+    off_t window = job->wb_window ? job->wb_window : IO_WB_WINDOW, in_dropped = in_pos;
+    if (job->io_hints & HINT_INPUT) io_input_sequential(fileno(fi));
+    if (job->io_hints & HINT_OUTPUT) {
+        fflush(fo);
+        out_pos = ftello(fo);
+        io_wb_init(&wb, fileno(fo));
+        wb.window = window;
+        wb.started = wb.dropped = out_pos - out_pos % wb.window;
+    }
+    // Stage timestamps, taken for live stats and the trace
+    int timed = stats || trace_on;
+    uint64_t t0 = timed ? stats_now_ns() : 0, t1 = 0, t2 = 0, t3 = 0;
+    while ((n = fread(buf,1,block,fi)) > 0) {
+        if (timed) t1 = stats_now_ns();
+        // Part of this block inside the window, as [lo, hi) block offsets
+        uint64_t pos = (uint64_t)in_pos;
+        size_t lo = first > pos ? (first - pos < n ? (size_t)(first - pos) : n) : 0;
+        size_t hi = last > pos ? (last - pos < n ? (size_t)(last - pos) : n) : 0;
+        if (hi > lo) sdes_stream_process(st, buf + lo, buf + lo, hi - lo);
+        if (timed) t2 = stats_now_ns();
+        fwrite(buf,1,n,fo);
+        in_pos += n;
+        out_pos += n;
+        if ((job->io_hints & HINT_OUTPUT) && out_pos - wb.started >= wb.window) {
+            fflush(fo);
+            io_wb_advance(&wb, out_pos);
+        }
+        if ((job->io_hints & HINT_INPUT) && in_pos - in_dropped >= window) {
+            io_input_done(fileno(fi), in_pos);
+            in_dropped = in_pos;
+        }
+        if (timed) t3 = stats_now_ns();
+        if (trace_on) {
+            trace_span("read", NULL, t0, t1, n);
+            trace_span("transform", NULL, t1, t2, hi - lo);
+            trace_span("write", NULL, t2, t3, n);
+        }
+        if (stats) {
+            stats_add(&stats->busy_ns[STAGE_READ], t1 - t0);
+            stats_add(&stats->busy_ns[STAGE_TRANSFORM], t2 - t1);
+            stats_add(&stats->busy_ns[STAGE_WRITE], t3 - t2);
+            stats_add(&stats->bytes_in[job->mode], hi - lo);
+            stats_add(&stats->bytes_out[job->mode], hi - lo);
+        }
+        t0 = t3;
+        if (preempt_point(job->preempt, n) && timed) t0 = stats_now_ns(); // urgent work is not ours
+    }
+    free(buf);
+    if ((job->io_hints & HINT_OUTPUT) && fflush(fo) == 0) io_wb_finish(&wb, out_pos);
+    if (job->io_hints & HINT_INPUT) io_input_done(fileno(fi), in_pos);
+    if (ferror(fi)) { perror("read input"); return 1; }
+    if ((uint64_t)in_pos < first) { fprintf(stderr,"Input ends before the --raw offset\n"); return 1; }
+    return 0;
+}
+
+// Copy the BMP header up to bfOffBits unchanged and transform the pixel stream.
+// Transform one input stream into fo at its current position. Neither file is
+// closed; fo may be a shared pack file, so nothing here assumes it starts at 0.
+static int transform_stream(const job_t *job, FILE *fi, FILE *fo) {
+    uint64_t t0 = trace_begin();
+    sdes_stream_t st;
+    sdes_stream_init(&st, job->ctx, job->mode, job->do_encrypt, job->iv_or_nonce);
+
+    // --raw: no format at all, just the byte window
+    if (job->raw) {
+        if (job->mode == MODE_ICBC) sdes_stream_set_lanes(&st, job->lanes ? (unsigned)job->lanes : SDES_ICBC_LANES);
+        return transform_payload(job, fi, fo, &st, 0, job->raw_offset,
+                                 job->raw_length ? job->raw_length : UINT64_MAX);
+    }
+
+    // PNG input is decoded row by row and fused with the cipher pass. BMP
+    // input continues from the bytes read here, so fi need not be seekable.
+    unsigned char header[54];
+    size_t hr = fread(header,1,8,fi);
+    if (png_is_signature(header, hr)) {
+        if (fseek(fi, 0, SEEK_SET) != 0) { fprintf(stderr,"Compressed PNG input is not supported\n"); return 1; }
+        int png_out = ends_with_ci(job->outpath, ".png");
+        if (job->mode == MODE_ICBC) {
+            // The lane count goes in the BMP header; a PNG has nowhere to keep it.
+            if (png_out) { fprintf(stderr,"ICBC output must be a BMP\n"); return 1; }
+            sdes_stream_set_lanes(&st, job->lanes ? (unsigned)job->lanes : SDES_ICBC_LANES);
+        }
+        int rc = transform_png(fi, fo, png_out, &st, job->align, job->preempt);
+        trace_end(t0, "png", 0);
+        return rc;
+    }
+    if (ends_with_ci(job->outpath, ".png")) {
+        fprintf(stderr,"PNG output requires PNG input\n"); return 1;
+    }
+
+    // Read first 14+40=54 bytes to get bfOffBits at offset 10..13 (little endian)
+    hr += fread(header + hr,1,sizeof(header) - hr,fi);
+    if (hr != sizeof(header)) { fprintf(stderr,"Not a BMP (short header)\n"); return 1; }
+
+    if (header[0] != 'B' || header[1] != 'M') {
+        fprintf(stderr,"Not a BMP (missing 'BM')\n"); return 1;
+    }
+    int offBits = read_uint32_le(&header[10]);
+    if (offBits < 54) offBits = 54; // basic safety
+    if (job->mode == MODE_ICBC && icbc_header_lanes(job, header, &st) != 0) return 1;
+
+    // Write out everything up to offBits unchanged (but for the ICBC lane count
+    // and --align fix-ups), then any alignment padding
+    unsigned char *hdr = (unsigned char*)malloc(offBits);
+    if (!hdr) { fprintf(stderr,"OOM\n"); return 1; }
+    memcpy(hdr, header, 54);
+    if (offBits > 54 && fread(hdr + 54,1,offBits - 54,fi) != (size_t)(offBits - 54)) {
+        fprintf(stderr,"Unexpected EOF reading palette/headers\n"); free(hdr); return 1;
+    }
+    uint32_t pad = align_pad((uint32_t)offBits, job->align);
+    if (pad && align_header(hdr, (uint32_t)offBits, pad) != 0) { free(hdr); return 1; }
+    fwrite(hdr,1,offBits,fo);
+    free(hdr);
+    write_zeros(fo, pad);
+    trace_end(t0, "header", 0);
+
+    // 1/2/4-bit rows: transform only the pixel bits, row by row
+    int bits = header[28] | (header[29]<<8);
+    if (read_uint32_le(&header[14]) >= 40 && read_uint32_le(&header[30]) == 0 &&
+        (bits == 1 || bits == 2 || bits == 4)) {
+        t0 = trace_begin();
+        int rc = transform_packed(fi, fo, &st, read_uint32_le(&header[18]),
+                                  read_uint32_le(&header[22]), bits, job->preempt);
+        trace_end(t0, "packed rows", 0);
+        if (ferror(fi)) { perror("read input"); rc = 1; }
+        return rc;
+    }
+
+    // Process the pixel data stream in blocks through the bulk API
+    return transform_payload(job, fi, fo, &st, offBits, offBits, UINT64_MAX);
+}
+
+// An input for transform_stream. A gzip file is inflated by a pipeline stage
+// and read through a pipe, which takes the job's I/O hints off.
+typedef struct {
+    FILE *f;            // what to read
+    FILE *raw;          // the file itself
+    gz_stage_t *gz;
+} input_t;
+
+static int open_input(job_t *job, input_t *in) {
+    in->gz = NULL;
+    in->f = in->raw = fopen(job->inpath,"rb");
+    if (!in->raw) { perror("open input"); return 1; }
+    if (!gz_detect(in->raw)) return 0;
+    if (!(in->gz = gz_reader_start(in->raw, &in->f))) { fclose(in->raw); return 1; }
+    job->io_hints = 0;
+    return 0;
+}
+
+// Close the input; rc becomes 1 if gzip input turned out to be corrupt.
+static int close_input(input_t *in, int rc) {
+    if (in->gz && gz_finish(in->gz, in->f) != 0) rc = 1;
+    fclose(in->raw);
+    return rc;
+}
+
+static int process_file(const job_t *job) {
+    // Only transform_stream writes through the gzip stage.
+    if ((job->row_count || job->pyramid_levels > 1) && ends_with_ci(job->outpath, ".gz")) {
+        fprintf(stderr,"%s can't write .gz output\n", job->row_count ? "--rows" : "--pyramid");
+        return 1;
+    }
+    if (job->row_count) return process_rows(job);
+    job_t j = *job;
+    input_t in;
+    uint64_t t0 = trace_begin();
+    if (open_input(&j, &in) != 0) return 1;
+    if (j.pyramid_levels > 1) {
+        trace_end(t0, "open", 0);
+        t0 = trace_begin();
+        int rc = pyramid_write(in.f, j.outpath, j.pyramid_levels, j.ctx, j.mode,
+                               j.do_encrypt, j.iv_or_nonce);
+        trace_end(t0, "pyramid", 0);
+        return close_input(&in, rc);
+    }
+    FILE *fo = fopen(j.outpath,"wb"), *plain = fo;
+    if (!fo) { perror("open output"); return close_input(&in, 1); }
+    // .gz output: the transformed stream goes through the compressing stage
+    gz_stage_t *gout = NULL;
+    if (ends_with_ci(j.outpath, ".gz")) {
+        if (!(gout = gz_writer_start(fo, j.gz_threads, &plain))) {
+            fclose(fo); return close_input(&in, 1);
+        }
+        j.io_hints = 0;
+    }
+    trace_end(t0, "open", 0);
+    int rc = transform_stream(&j, in.f, plain);
+    // Closing waits for the gzip stages to drain.
+    t0 = trace_begin();
+    rc = close_input(&in, rc);
+    if (gout && gz_finish(gout, plain) != 0) rc = 1;
+    if (fclose(fo) != 0 && rc == 0) { perror("write output"); rc = 1; }
+    trace_end(t0, "close", 0);
+    return rc;
+}
+
+static int cmp_str(const void *a, const void *b) {
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+// Names of the regular files in d (opened on dir), sorted; closes d.
+// Returns NULL on allocation failure (an empty directory gives a valid array).
+static char **list_dir(DIR *d, const char *dir, size_t *count) {
+    char **names = (char**)malloc(sizeof(*names));
+    size_t cap = 1;
+    struct dirent *e;
+    char path[4096];
+    *count = 0;
+    while (names && (e = readdir(d)) != NULL) {
+        struct stat sb;
+        snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+        if (e->d_name[0] == '.' || stat(path, &sb) != 0 || !S_ISREG(sb.st_mode)) continue;
+        if (*count == cap) {
+            cap *= 2;
+            char **nn = (char**)realloc(names, cap * sizeof(*names));
+            if (!nn) break;
+            names = nn;
+        }
+        if (!(names[*count] = strdup(e->d_name))) break;
+        (*count)++;
+    }
+    closedir(d);
+    if (names && e) { // stopped early: out of memory
+        while (*count) free(names[--(*count)]);
+        free(names);
+        names = NULL;
+    }
+    if (!names) fprintf(stderr,"OOM\n");
+    else if (*count) qsort(names, *count, sizeof(*names), cmp_str);
+    return names;
+}
+
+#define BATCH_MAX_WORKERS 256
+#define BATCH_MAX_PREFETCH 64
+
+typedef struct {
+    int durable, packing;
+    uint64_t interactive_max;   // auto class: inputs up to this size are interactive
+    uint64_t deadline_ms;       // default deadline of interactive jobs, 0 = none
+    size_t chunk;               // bulk jobs yield to interactive ones this often
+} sched_opts_t;
+
+// One file to transform, queued by priority class.
+typedef struct {
+    jobq_item_t qi;         // qi.payload points back here
+    char *inpath, *outpath;
+    char *name;             // pack member name
+    atomic_int prefetched;
+    const job_t *job;       // own settings (manifest jobs), NULL = the batch template
+    const mf_job_t *mf;     // manifest entry, for the result log
+} task_t;
+
+typedef struct {
+    const job_t *tmpl;
+    const sched_opts_t *opts;
+    int prefetch;
+    pack_writer_t *pack;    // non-NULL: outputs are appended here (one worker)
+    jobq_t q;
+    pthread_mutex_t lock;   // guards failed and results
+    size_t failed;
+    task_t **tasks;         // everything submitted, freed at the end
+    size_t ntasks, cap;
+    FILE *results;          // manifest runs: one log line per finished job
+} batch_t;
+
+static task_t *task_new(batch_t *b, const char *inpath, const char *outpath, const char *name) {
+    if (b->ntasks == b->cap) {
+        size_t cap = b->cap ? b->cap * 2 : 64;
+        task_t **nt = (task_t**)realloc(b->tasks, cap * sizeof(*nt));
+        if (!nt) return NULL;
+        b->tasks = nt;
+        b->cap = cap;
+    }
+    task_t *t = (task_t*)calloc(1, sizeof(*t));
+    if (!t) return NULL;
+    t->inpath = strdup(inpath);
+    t->outpath = strdup(outpath);
+    t->name = strdup(name);
+    if (!t->inpath || !t->outpath || !t->name) {
+        free(t->inpath); free(t->outpath); free(t->name); free(t);
+        return NULL;
+    }
+    t->qi.payload = t;
+    atomic_init(&t->prefetched, 0);
+    b->tasks[b->ntasks++] = t;
+    return t;
+}
+
+// cls < 0 picks the class from the input size. deadline_ms 0 uses the default.
+static void task_submit(batch_t *b, task_t *t, int cls, uint64_t deadline_ms) {
+    if (cls < 0) {
+        struct stat sb;
+        cls = stat(t->inpath, &sb) == 0 && (uint64_t)sb.st_size <= b->opts->interactive_max
+              ? JOBQ_INTERACTIVE : JOBQ_BULK;
+    }
+    if (!deadline_ms && cls == JOBQ_INTERACTIVE) deadline_ms = b->opts->deadline_ms;
+    t->qi.cls = (jobq_class_t)cls;
+    t->qi.arrival_ns = stats_now_ns();
+    t->qi.deadline_ns = deadline_ms ? t->qi.arrival_ns + deadline_ms * 1000000ull : 0;
+    jobq_push(&b->q, &t->qi);
+}
+
+static void prefetch_ahead(batch_t *b) {
+    void *next[BATCH_MAX_PREFETCH];
+    size_t n = jobq_peek(&b->q, next, (size_t)b->prefetch);
+    for (size_t k = 0; k < n; ++k) {
+        task_t *t = (task_t*)next[k];
+        if (!atomic_exchange(&t->prefetched, 1)) io_prefetch(t->inpath);
+    }
+}
+
+static void run_task(batch_t *b, task_t *t, int preemptible);
+
+// Preemption hook of bulk jobs: drain the interactive class on this thread.
+static void run_urgent(void *arg) {
+    batch_t *b = (batch_t*)arg;
+    jobq_item_t *it;
+    while ((it = jobq_pop_urgent(&b->q)) != NULL) run_task(b, (task_t*)it->payload, 0);
+}
+
+static void run_task(batch_t *b, task_t *t, int preemptible) {
+    if (bmper_stats) atomic_store_explicit(&bmper_stats->queue_depth, jobq_depth(&b->q), memory_order_relaxed);
+    if (b->prefetch > 0) prefetch_ahead(b);
+    job_t job = t->job ? *t->job : *b->tmpl;
+    uint64_t start_ns = stats_now_ns();
+    uint64_t tj = trace_begin();
+    job.inpath = t->inpath;
+    job.outpath = t->outpath;
+    // Pack members share the pack's stream, which does its own write-behind.
+    job.io_hints = b->pack ? HINT_INPUT : HINT_INPUT | HINT_OUTPUT;
+    preempt_t pre = { run_urgent, b, b->opts->chunk, 0 };
+    // Pack members are contiguous, so they are never interleaved.
+    if (preemptible && t->qi.cls == JOBQ_BULK && !b->pack) job.preempt = &pre;
+    int rc;
+    if (b->pack) {
+        pack_writer_t *pw = b->pack;
+        // Member name picks the output format, as an output path would.
+        job.outpath = t->name;
+        input_t in;
+        off_t start = ftello(pw->f);
+        if (open_input(&job, &in) != 0) rc = 1;
+        else rc = close_input(&in, transform_stream(&job, in.f, pw->f));
+        // Members are stored uncompressed: x.bmp.gz is listed as x.bmp.
+        size_t nl = strlen(t->name);
+        if (in.gz && ends_with_ci(t->name, ".gz")) t->name[nl - 3] = '\0';
+        off_t end = ftello(pw->f);
+        // Raw ICBC members have no header to carry their lane count.
+        int lanes = job.mode != MODE_ICBC ? 0 : job.lanes ? job.lanes : job.do_encrypt ? SDES_ICBC_LANES : 0;
+        int added = rc != 0 || ferror(pw->f) ? -1 :
+                    pack_add(pw, t->name, (uint64_t)start, (uint64_t)(end - start), (uint8_t)job.mode,
+                             job.iv_or_nonce, (uint8_t)job.do_encrypt, (uint8_t)lanes);
+        if (added == -2) { fprintf(stderr,"Pack already has a member named %s\n", t->name); rc = 1; }
+        else if (rc == 0 && added != 0) { perror("write pack"); rc = 1; }
+        if (rc != 0) fseeko(pw->f, start, SEEK_SET); // next member overwrites the partial one
+    } else {
+        rc = process_file(&job);
+        if (rc == 0 && b->opts->durable && io_sync_defer(t->outpath) != 0) { perror("fsync output"); rc = 1; }
+    }
+    uint64_t end_ns = stats_now_ns();
+    if (tj) trace_span(t->qi.cls == JOBQ_INTERACTIVE ? "interactive job" : "bulk job", t->inpath, tj, trace_now(), 0);
+    jobq_done(&b->q, &t->qi, end_ns);
+    if (rc != 0) fprintf(stderr,"Failed: %s\n", t->inpath);
+    if (bmper_stats) stats_add(rc ? &bmper_stats->errors : &bmper_stats->files_done, 1);
+    struct stat sb;
+    uint64_t bytes = b->results && stat(t->inpath, &sb) == 0 ? (uint64_t)sb.st_size : 0;
+    if (rc || b->results) {
+        pthread_mutex_lock(&b->lock);
+        if (rc) b->failed++;
+        if (b->results) {
+            manifest_log(b->results, t->mf, rc == 0, (start_ns - t->qi.arrival_ns) / 1e6,
+                         (end_ns - start_ns) / 1e6, bytes);
+            fflush(b->results);
+        }
+        pthread_mutex_unlock(&b->lock);
+    }
+}
+
+static void *batch_worker(void *arg) {
+    batch_t *b = (batch_t*)arg;
+    jobq_item_t *it;
+    trace_thread("worker");
+    for (;;) {
+        uint64_t tw = trace_begin();
+        it = jobq_pop(&b->q);
+        trace_end(tw, "queue wait", 0);
+        if (!it) break;
+        run_task(b, (task_t*)it->payload, 1);
+    }
+    return NULL;
+}
+
+static void batch_init(batch_t *b, const job_t *tmpl, const cg_plan_t *plan, const sched_opts_t *opts) {
+    memset(b, 0, sizeof(*b));
+    b->tmpl = tmpl;
+    b->opts = opts;
+    b->prefetch = plan->prefetch < BATCH_MAX_PREFETCH ? plan->prefetch : BATCH_MAX_PREFETCH;
+    jobq_init(&b->q);
+    pthread_mutex_init(&b->lock, NULL);
+}
+
+static int batch_start(batch_t *b, int workers, pthread_t *tids) {
+    int started = 0;
+    for (; started < workers; ++started)
+        if (pthread_create(&tids[started], NULL, batch_worker, b) != 0) break;
+    return started;
+}
+
+// Close the queue, wait for the workers (running the queue here if none
+// could be started) and free the tasks. Returns the number of failures.
+static size_t batch_finish(batch_t *b, pthread_t *tids, int started) {
+    jobq_close(&b->q);
+    if (!started) batch_worker(b);
+    for (int t = 0; t < started; ++t) pthread_join(tids[t], NULL);
+    for (size_t i = 0; i < b->ntasks; ++i) {
+        free(b->tasks[i]->inpath); free(b->tasks[i]->outpath); free(b->tasks[i]->name); free(b->tasks[i]);
+    }
+    free(b->tasks);
+    pthread_mutex_destroy(&b->lock);
+    return b->failed;
+}
+
+// Transform every regular file in indir into outdir (same names) on
+// plan->workers threads. Files up to opts->interactive_max run first, in name
+// order; larger ones follow as bulk work that yields to interactive work every
+// opts->chunk bytes. Queued inputs are read ahead; with durable set, outputs are
+// fsynced in groups instead of one by one. With opts->packing set, outdir names a
+// pack file that receives all outputs instead, and a single worker appends them.
+static int run_batch(const char *indir, const char *outdir, const job_t *tmpl, const cg_plan_t *plan,
+                     const sched_opts_t *opts) {
+    DIR *d = opendir(indir);
+    if (!d) { perror("open input directory"); return 1; }
+    pack_writer_t pw;
+    if (opts->packing) {
+        if (pack_create(&pw, outdir) != 0) { perror("create pack"); closedir(d); return 1; }
+    } else if (mkdir(outdir, 0755) != 0 && errno != EEXIST) {
+        perror("create output directory"); closedir(d); return 1;
+    }
+
+    size_t count;
+    char **names = list_dir(d, indir, &count);
+    if (!names) return 1;
+    char path[4096];
+
+    batch_t b;
+    batch_init(&b, tmpl, plan, opts);
+    b.pack = opts->packing ? &pw : NULL;
+    size_t failed = 0;
+    char outpath[4096];
+    for (size_t i = 0; i < count; ++i) {
+        snprintf(path, sizeof(path), "%s/%s", indir, names[i]);
+        snprintf(outpath, sizeof(outpath), "%s/%s", outdir, names[i]);
+        task_t *t = task_new(&b, path, outpath, names[i]);
+        if (t) task_submit(&b, t, -1, 0);
+        else { fprintf(stderr,"OOM\n"); failed++; }
+        free(names[i]);
+    }
+    free(names);
+    if (b.prefetch > 0) prefetch_ahead(&b);
+
+    int workers = opts->packing ? 1 : plan->workers;
+    if ((size_t)workers > count) workers = count ? (int)count : 1;
+    pthread_t tids[BATCH_MAX_WORKERS];
+    int started = batch_start(&b, workers, tids);
+    failed += batch_finish(&b, tids, started);
+    // io_sync_flush fsyncs outdir as the parent of the deferred outputs.
+    if (opts->packing) {
+        if (pack_finish(&pw, opts->durable) != 0) { perror("write pack index"); failed++; }
+    } else if (opts->durable && io_sync_flush(NULL) != 0) { perror("fsync output"); failed++; }
+
+    printf("Done. %zu file(s), %zu failed, output in %s\n", count, failed, outdir);
+    jobq_report(&b.q, stdout);
+    jobq_destroy(&b.q);
+    return failed ? 1 : 0;
+}
+
+// Serve jobs as they arrive, one per line of src ("-" = rest of stdin):
+//   CLASS INPATH OUTPATH [DEADLINE_MS]
+// CLASS is interactive, bulk or auto (by size); blank and '#' lines are skipped.
+static int run_queue(const char *src, const job_t *tmpl, const cg_plan_t *plan, const sched_opts_t *opts) {
+    FILE *f = strcmp(src, "-") == 0 ? stdin : fopen(src, "r");
+    if (!f) { perror("open queue"); return 1; }
+    batch_t b;
+    batch_init(&b, tmpl, plan, opts);
+    pthread_t tids[BATCH_MAX_WORKERS];
+    int started = batch_start(&b, plan->workers, tids);
+
+    char line[8192], cls_s[32], in[4096], out[4096];
+    size_t lineno = 0, bad = 0;
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+        unsigned long long dl = 0;
+        int nf = sscanf(line, "%31s %4095s %4095s %llu", cls_s, in, out, &dl);
+        if (nf <= 0 || cls_s[0] == '#') continue;
+        int cls = strcmp(cls_s, "interactive") == 0 ? JOBQ_INTERACTIVE :
+                  strcmp(cls_s, "bulk") == 0 ? JOBQ_BULK : strcmp(cls_s, "auto") == 0 ? -1 : -2;
+        task_t *t = nf >= 3 && cls != -2 ? task_new(&b, in, out, out) : NULL;
+        if (!t) { fprintf(stderr,"Bad queue line %zu\n", lineno); bad++; continue; }
+        task_submit(&b, t, cls, dl);
+    }
+    if (f != stdin) fclose(f);
+    size_t jobs = b.ntasks;
+    size_t failed = bad + batch_finish(&b, tids, started);
+    if (opts->durable && io_sync_flush(NULL) != 0) { perror("fsync output"); failed++; }
+
+    printf("Done. %zu job(s), %zu failed\n", jobs, failed);
+    jobq_report(&b.q, stdout);
+    jobq_destroy(&b.q);
+    return failed ? 1 : 0;
+}
+
+// Manifest jobs in key order, then manifest order.
+static int cmp_mf_key(const void *a, const void *b) {
+    const mf_job_t *x = *(const mf_job_t* const*)a, *y = *(const mf_job_t* const*)b;
+    if (x->key10 != y->key10) return x->key10 < y->key10 ? -1 : 1;
+    return (x->line > y->line) - (x->line < y->line);
+}
+
+// Run a JSON-lines manifest (see manifest.h) of jobs with their own key, mode
+// and options on plan->workers threads. Nothing runs unless every line is
+// valid. Jobs are queued grouped by key, so each key's tables are built once
+// and the workers share one key's tables at a time. One result line per job
+// (timings included) goes to results, "-" = stdout.
+static int run_manifest(const char *path, const char *results, const cg_plan_t *plan,
+                        const sched_opts_t *opts) {
+    manifest_t m;
+    int bad = manifest_load(path, &m);
+    if (bad < 0) { perror(path); return 1; }
+    if (bad) {
+        fprintf(stderr, "%d bad manifest line(s); nothing was run\n", bad);
+        manifest_free(&m); return 1;
+    }
+    FILE *log = strcmp(results, "-") == 0 ? stdout : fopen(results, "w");
+    size_t nctx = m.count < 1024 ? m.count : 1024;  // one per distinct key
+    sdes_ctx_t *ctxs = (sdes_ctx_t*)malloc((nctx ? nctx : 1) * sizeof(*ctxs));
+    job_t *jobs = (job_t*)calloc(m.count + 1, sizeof(*jobs));
+    mf_job_t **order = (mf_job_t**)malloc((m.count + 1) * sizeof(*order));
+    if (!log) perror(results);
+    if (!ctxs || !jobs || !order) fprintf(stderr, "OOM\n");
+    if (!log || !ctxs || !jobs || !order) {
+        free(ctxs); free(jobs); free(order); manifest_free(&m);
+        if (log && log != stdout) fclose(log);
+        return 1;
+    }
+    for (size_t i = 0; i < m.count; ++i) order[i] = &m.jobs[i];
+    qsort(order, m.count, sizeof(*order), cmp_mf_key);
+
+    batch_t b;
+    batch_init(&b, NULL, plan, opts);
+    b.results = log;
+    size_t failed = 0, nkeys = 0;
+    for (size_t i = 0; i < m.count; ++i) {
+        const mf_job_t *mj = order[i];
+        if (i == 0 || mj->key10 != order[i - 1]->key10) sdes_ctx_init(&ctxs[nkeys++], mj->key10);
+        jobs[i] = (job_t){ .ctx = &ctxs[nkeys - 1], .mode = mj->mode, .do_encrypt = mj->encrypt,
+                           .iv_or_nonce = mj->iv, .lanes = mj->lanes,
+                           .row_first = mj->row_first, .row_count = mj->row_count,
+                           .block = plan->block, .align = mj->align, .wb_window = (off_t)plan->wb_window,
+                           .raw = mj->raw, .raw_offset = mj->raw_offset, .raw_length = mj->raw_length };
+        task_t *t = task_new(&b, mj->in, mj->out, mj->out);
+        if (!t) { fprintf(stderr,"OOM\n"); failed++; continue; }
+        t->job = &jobs[i];
+        t->mf = mj;
+        task_submit(&b, t, mj->cls, mj->deadline_ms);
+    }
+    if (b.prefetch > 0) prefetch_ahead(&b);
+
+    int workers = plan->workers;
+    if ((size_t)workers > m.count) workers = m.count ? (int)m.count : 1;
+    pthread_t tids[BATCH_MAX_WORKERS];
+    int started = batch_start(&b, workers, tids);
+    failed += batch_finish(&b, tids, started);
+    // Outputs sit in any number of directories; io_sync_flush fsyncs each
+    // one that received an output, and the result log's.
+    if (opts->durable && log != stdout && (fflush(log) != 0 || io_sync_defer(results) != 0)) {
+        perror(results); failed++;
+    }
+    if (opts->durable && io_sync_flush(NULL) != 0) { perror("fsync output"); failed++; }
+    if (log != stdout && fclose(log) != 0) { perror(results); failed++; }
+
+    FILE *report = log == stdout ? stderr : stdout;
+    fprintf(report, "Done. %zu job(s) under %zu key(s), %zu failed\n", m.count, nkeys, failed);
+    jobq_report(&b.q, report);
+    jobq_destroy(&b.q);
+    free(order);
+    free(jobs);
+    free(ctxs);
+    manifest_free(&m);
+    return failed ? 1 : 0;
+}
+
+// Pack companion commands: --list, --extract and --unpack. No cipher work;
+// members come out exactly as stored and decrypt like any other file.
+static int write_member(const pack_reader_t *r, const pack_entry_t *e, const char *path) {
+    FILE *fo = fopen(path,"wb");
+    if (!fo) { perror(path); return 1; }
+    unsigned char buf[IO_BLOCK];
+    uint64_t off = 0;
+    ssize_t n;
+    while ((n = pack_read(r, e, buf, sizeof(buf), off)) > 0) {
+        fwrite(buf,1,(size_t)n,fo);
+        off += (uint64_t)n;
+    }
+    if (fclose(fo) != 0 || n < 0 || off != e->length) { fprintf(stderr,"Failed to extract %s\n", e->name); return 1; }
+    return 0;
+}
+
+static int run_pack_tool(const char *cmd, const char *pack, const char *arg1, const char *arg2) {
+    static const char *MODE_NAMES[SDES_MODE_COUNT] = {"ECB","CBC","CTR","ICBC"};
+    pack_reader_t r;
+    if (pack_open(&r, pack) != 0) { fprintf(stderr,"Cannot read pack %s\n", pack); return 1; }
+    int rc = 0;
+    if (strcmp(cmd, "--list") == 0) {
+        for (size_t i = 0; i < r.count; ++i) {
+            const pack_entry_t *e = &r.entries[i];
+            char lanes[16] = "";
+            if (e->lanes) snprintf(lanes, sizeof(lanes), " lanes=%u", e->lanes);
+            printf("%12llu %12llu %s %s IV=0x%02X%s %s\n", (unsigned long long)e->offset,
+                   (unsigned long long)e->length, e->mode < SDES_MODE_COUNT ? MODE_NAMES[e->mode] : "?",
+                   e->encrypted ? "enc" : "dec", e->iv, lanes, e->name);
+        }
+    } else if (strcmp(cmd, "--extract") == 0) {
+        const pack_entry_t *e = pack_find(&r, arg1);
+        if (!e) { fprintf(stderr,"No member %s in %s\n", arg1, pack); rc = 1; }
+        else rc = write_member(&r, e, arg2);
+    } else { // --unpack
+        if (mkdir(arg1, 0755) != 0 && errno != EEXIST) { perror("create output directory"); rc = 1; }
+        char path[4096];
+        for (size_t i = 0; rc == 0 && i < r.count; ++i) {
+            const char *name = r.entries[i].name;
+            if (strchr(name, '/') || strcmp(name, "..") == 0 || strcmp(name, ".") == 0) {
+                fprintf(stderr,"Skipping unsafe member name %s\n", name); continue;
+            }
+            snprintf(path, sizeof(path), "%s/%s", arg1, name);
+            rc = write_member(&r, &r.entries[i], path);
+        }
+        if (rc == 0) printf("Unpacked %zu member(s) into %s\n", r.count, arg1);
+    }
+    pack_close(&r);
+    return rc;
+}
+
+// --keyscan: fingerprint the key of every ECB-encrypted BMP in a directory
+// from a sample of its pixels and group the files that share a key.
+typedef struct {
+    const char *dir;
+    char **names;
+    size_t count, sample;
+    atomic_size_t next;
+    ks_guess_t *guess;
+    int *status;            // 0 = guessed, -1 = not a readable BMP
+    uint64_t *sampled, *pixel_bytes;
+} keyscan_t;
+
+static void *keyscan_worker(void *arg) {
+    keyscan_t *k = (keyscan_t*)arg;
+    ks_sample_t *s = (ks_sample_t*)malloc(sizeof(*s));
+    char path[4096];
+    size_t i;
+    trace_thread("keyscan");
+    while (s && (i = atomic_fetch_add(&k->next, 1)) < k->count) {
+        snprintf(path, sizeof(path), "%s/%s", k->dir, k->names[i]);
+        uint64_t t0 = trace_begin();
+        int rc = ks_sample(path, k->sample, s);
+        uint64_t t1 = trace_begin();
+        if (t0) trace_span("sample", k->names[i], t0, t1, rc == 0 ? s->sampled : 0);
+        k->status[i] = rc == 0 ? ks_guess(s, &k->guess[i]) : -1;
+        trace_end(t1, "guess key", 0);
+        k->sampled[i] = k->status[i] == 0 ? s->sampled : 0;
+        k->pixel_bytes[i] = k->status[i] == 0 ? s->pixel_bytes : 0;
+    }
+    free(s);
+    return NULL;
+}
+
+static const keyscan_t *keyscan_sort_ctx;
+
+// Confident guesses grouped by key, then uncertain ones, then failures.
+static int cmp_keyscan(const void *a, const void *b) {
+    const keyscan_t *k = keyscan_sort_ctx;
+    size_t i = *(const size_t*)a, j = *(const size_t*)b;
+    int ri = k->status[i] ? 2 : k->guess[i].margin < KS_MIN_MARGIN;
+    int rj = k->status[j] ? 2 : k->guess[j].margin < KS_MIN_MARGIN;
+    if (ri != rj) return ri - rj;
+    if (ri == 0 && k->guess[i].key10 != k->guess[j].key10) return k->guess[i].key10 - k->guess[j].key10;
+    return strcmp(k->names[i], k->names[j]);
+}
+
+static void key_bits(uint16_t key10, char out[11]) {
+    for (int b = 0; b < 10; ++b) out[b] = (char)('0' + ((key10 >> (9 - b)) & 1));
+    out[10] = 0;
+}
+
+static int run_keyscan(const char *dir, const cg_plan_t *plan, size_t sample) {
+    DIR *d = opendir(dir);
+    if (!d) { perror("open input directory"); return 1; }
+    keyscan_t k = { .dir = dir, .sample = sample };
+    k.names = list_dir(d, dir, &k.count);
+    if (!k.names) return 1;
+    size_t n = k.count ? k.count : 1;
+    k.guess = (ks_guess_t*)calloc(n, sizeof(*k.guess));
+    k.status = (int*)calloc(n, sizeof(*k.status));
+    k.sampled = (uint64_t*)calloc(n, sizeof(*k.sampled));
+    k.pixel_bytes = (uint64_t*)calloc(n, sizeof(*k.pixel_bytes));
+    size_t *order = (size_t*)calloc(n, sizeof(*order));
+    int rc = 1;
+    if (!k.guess || !k.status || !k.sampled || !k.pixel_bytes || !order) { fprintf(stderr,"OOM\n"); goto out; }
+    atomic_init(&k.next, 0);
+
+    int workers = plan->workers;
+    if ((size_t)workers > k.count) workers = k.count ? (int)k.count : 1;
+    pthread_t tids[BATCH_MAX_WORKERS];
+    int started = 0;
+    while (started < workers && pthread_create(&tids[started], NULL, keyscan_worker, &k) == 0) started++;
+    if (started == 0) keyscan_worker(&k);
+    for (int t = 0; t < started; ++t) pthread_join(tids[t], NULL);
+
+    uint64_t sampled = 0, total = 0;
+    size_t bad = 0, unsure = 0, clusters = 0;
+    for (size_t i = 0; i < k.count; ++i) {
+        order[i] = i;
+        sampled += k.sampled[i];
+        total += k.pixel_bytes[i];
+        if (k.status[i]) bad++;
+        else if (k.guess[i].margin < KS_MIN_MARGIN) unsure++;
+    }
+    keyscan_sort_ctx = &k;
+    if (k.count) qsort(order, k.count, sizeof(*order), cmp_keyscan);
+
+    char bits[11];
+    for (size_t o = 0; o < k.count; ++o) {
+        size_t i = order[o];
+        const ks_guess_t *g = &k.guess[i];
+        int sure = k.status[i] == 0 && g->margin >= KS_MIN_MARGIN;
+        if (sure && (o == 0 || k.guess[order[o - 1]].key10 != g->key10)) {
+            size_t members = 1;
+            while (o + members < k.count && k.status[order[o + members]] == 0 &&
+                   k.guess[order[o + members]].margin >= KS_MIN_MARGIN &&
+                   k.guess[order[o + members]].key10 == g->key10) members++;
+            key_bits(g->key10, bits);
+            printf("Key %s (K1=0x%02X K2=0x%02X): %zu file(s)\n", bits, g->K1, g->K2, members);
+            clusters++;
+        } else if (!sure && k.status[i] == 0 && (o == 0 || k.status[order[o - 1]] != 0 ||
+                                                 k.guess[order[o - 1]].margin >= KS_MIN_MARGIN)) {
+            printf("Uncertain (not ECB, or too little structure): %zu file(s)\n", unsure);
+        } else if (k.status[i] && (o == 0 || !k.status[order[o - 1]])) {
+            printf("Not readable as BMP: %zu file(s)\n", bad);
+        }
+        if (k.status[i]) { printf("  %s\n", k.names[i]); continue; }
+        key_bits(g->key10, bits);
+        printf("  %-40s score %6.2f  margin %5.2f%s%s\n", k.names[i], g->score,
+               g->margin > 999 ? 999.0 : g->margin, sure ? "" : "  best ", sure ? "" : bits);
+    }
+    printf("Scanned %zu file(s): %zu key(s), %zu uncertain, %zu unreadable; sampled %.1f%% of %llu pixel bytes\n",
+           k.count, clusters, unsure, bad, total ? 100.0 * (double)sampled / (double)total : 0.0,
+           (unsigned long long)total);
+    rc = 0;
+out:
+    for (size_t i = 0; i < k.count; ++i) free(k.names[i]);
+    free(k.names); free(k.guess); free(k.status); free(k.sampled); free(k.pixel_bytes); free(order);
+    return rc;
+}
+
+// --leak: SSIM and perceptual-hash distance between plaintext BMPs and their
+// ciphertexts, as a measure of how recognizable each mode leaves an image.
+typedef struct {
+    const char *plain_dir, *cipher_dir;
+    char **names;
+    size_t count;
+    atomic_size_t next;
+    int threads;            // SSIM threads per pair
+    double *ssim;
+    int *dist;
+    int *status;            // 0 = compared, -1 = unreadable, -2 = sizes differ
+} leak_t;
+
+static int leak_pair(const char *plain, const char *cipher, int threads, double *ssim, int *dist) {
+    lk_image_t a, b;
+    if (lk_load(plain, &a) != 0) return -1;
+    if (lk_load(cipher, &b) != 0) { lk_free(&a); return -1; }
+    int rc = lk_ssim(&a, &b, threads, ssim) == 0 ? 0 : -2;
+    if (rc == 0) *dist = lk_distance(lk_phash(&a), lk_phash(&b));
+    lk_free(&a);
+    lk_free(&b);
+    return rc;
+}
+
+static void *leak_worker(void *arg) {
+    leak_t *l = (leak_t*)arg;
+    char plain[4096], cipher[4096];
+    size_t i;
+    trace_thread("leak");
+    while ((i = atomic_fetch_add(&l->next, 1)) < l->count) {
+        snprintf(plain, sizeof(plain), "%s/%s", l->plain_dir, l->names[i]);
+        snprintf(cipher, sizeof(cipher), "%s/%s", l->cipher_dir, l->names[i]);
+        uint64_t t0 = trace_begin();
+        l->status[i] = leak_pair(plain, cipher, l->threads, &l->ssim[i], &l->dist[i]);
+        if (t0) trace_span("compare", l->names[i], t0, trace_now(), 0);
+    }
+    return NULL;
+}
+
+// Compare PLAIN with CIPHER, two BMPs or two directories of same-named BMPs.
+// Directories are split across workers a file at a time; a single pair
+// splits its SSIM rows instead.
+static int run_leak(const char *plain, const char *cipher, const cg_plan_t *plan) {
+    struct stat sp, sc;
+    if (stat(plain, &sp) != 0 || stat(cipher, &sc) != 0) { perror("--leak"); return 1; }
+    if (S_ISDIR(sp.st_mode) != S_ISDIR(sc.st_mode)) {
+        fprintf(stderr, "--leak compares two files or two directories\n"); return 1;
+    }
+    int single = !S_ISDIR(sp.st_mode);
+    leak_t l = { .plain_dir = plain, .cipher_dir = cipher, .count = 1, .threads = plan->workers };
+    if (!single) {
+        DIR *d = opendir(plain);
+        if (!d) { perror("open plaintext directory"); return 1; }
+        if (!(l.names = list_dir(d, plain, &l.count))) return 1;
+        l.threads = 1;
+    }
+    size_t n = l.count ? l.count : 1;
+    l.ssim = (double*)calloc(n, sizeof(*l.ssim));
+    l.dist = (int*)calloc(n, sizeof(*l.dist));
+    l.status = (int*)calloc(n, sizeof(*l.status));
+    int rc = 1;
+    if (!l.ssim || !l.dist || !l.status) { fprintf(stderr,"OOM\n"); goto out; }
+
+    if (single) {
+        l.status[0] = leak_pair(plain, cipher, l.threads, &l.ssim[0], &l.dist[0]);
+    } else {
+        atomic_init(&l.next, 0);
+        int workers = plan->workers;
+        if ((size_t)workers > l.count) workers = l.count ? (int)l.count : 1;
+        pthread_t tids[BATCH_MAX_WORKERS];
+        int started = 0;
+        while (started < workers && pthread_create(&tids[started], NULL, leak_worker, &l) == 0) started++;
+        if (started == 0) leak_worker(&l);
+        for (int t = 0; t < started; ++t) pthread_join(tids[t], NULL);
+    }
+
+    size_t done = 0, bad = 0, close_hash = 0;
+    double sum_ssim = 0, sum_dist = 0, lo = 1, hi = -1;
+    for (size_t i = 0; i < l.count; ++i) {
+        const char *name = single ? cipher : l.names[i];
+        if (l.status[i]) {
+            printf("  %-40s %s\n", name, l.status[i] == -2 ? "sizes differ" : "missing, unreadable or not a BMP");
+            bad++;
+            continue;
+        }
+        printf("  %-40s SSIM %7.4f  pHash distance %2d%s\n", name, l.ssim[i], l.dist[i],
+               l.dist[i] <= LK_PHASH_MATCH ? "  recognizable" : "");
+        done++;
+        sum_ssim += l.ssim[i];
+        sum_dist += l.dist[i];
+        if (l.ssim[i] < lo) lo = l.ssim[i];
+        if (l.ssim[i] > hi) hi = l.ssim[i];
+        if (l.dist[i] <= LK_PHASH_MATCH) close_hash++;
+    }
+    if (done) {
+        printf("Compared %zu pair(s), %zu failed: mean SSIM %.4f (min %.4f, max %.4f), "
+               "mean pHash distance %.1f/32, %zu within %d (recognizable)\n",
+               done, bad, sum_ssim / done, lo, hi, sum_dist / done, close_hash, LK_PHASH_MATCH);
+    } else {
+        printf("Compared 0 pair(s), %zu failed\n", bad);
+    }
+    rc = bad ? 1 : 0;
+out:
+    if (!single) {
+        for (size_t i = 0; i < l.count; ++i) free(l.names[i]);
+        free(l.names);
+    }
+    free(l.ssim); free(l.dist); free(l.status);
+    return rc;
+}
+
+// Parse a byte count with an optional K, M or G suffix. Returns 0 on error.
+static size_t parse_size(const char *s) {
+    char *end;
+    unsigned long long v = strtoull(s, &end, 10);
+    switch (toupper((unsigned char)*end)) {
+    case 'K': v <<= 10; end++; break;
+    case 'M': v <<= 20; end++; break;
+    case 'G': v <<= 30; end++; break;
+    }
+    if (toupper((unsigned char)*end) == 'B') end++;
+    return *end ? 0 : (size_t)v;
+}
+
+// --raw window "OFFSET[:LENGTH]" with size suffixes; LENGTH > 0. Returns 0 or -1.
+static int parse_raw(const char *s, uint64_t *off, uint64_t *len) {
+    char part[64];
+    const char *colon = strchr(s, ':');
+    size_t k = colon ? (size_t)(colon - s) : strlen(s);
+    if (k == 0 || k >= sizeof(part)) return -1;
+    memcpy(part, s, k);
+    part[k] = '\0';
+    *off = parse_size(part);
+    if (*off == 0 && strspn(part, "0") != k) return -1;
+    *len = 0;
+    if (colon && (*len = parse_size(colon + 1)) == 0) return -1;
+    return 0;
+}
+
+static const char *fmt_bytes(uint64_t v, char *buf, size_t cap) {
+    static const char *units[] = {"B", "KiB", "MiB", "GiB", "TiB"};
+    int u = 0;
+    // Exact for power-of-two sizes, whole units (rounded down) for big limits.
+    while (u < 4 && v >= 1024 && (v % 1024 == 0 || v >= (1u << 20))) { v /= 1024; u++; }
+    snprintf(buf, cap, "%llu %s", (unsigned long long)v, units[u]);
+    return buf;
+}
+
+// Print the limits that were found and the sizing chosen from them to out.
+// set has one flag per plan field given on the command line.
+static void report_sizing(const cg_limits_t *lim, const cg_plan_t *plan, const int set[4], FILE *out) {
+    char a[32], b[32], q[32], c[32];
+    if (lim->cpu_quota > 0) snprintf(q, sizeof(q), "%.2f", lim->cpu_quota); else snprintf(q, sizeof(q), "none");
+    if (lim->cpuset_cpus > 0) snprintf(c, sizeof(c), "%d", lim->cpuset_cpus); else snprintf(c, sizeof(c), "-");
+    if (lim->version) fprintf(out, "Resources: cgroup v%d, CPU quota %s, cpuset %s CPU(s), host %d CPU(s); memory limit %s, host %s\n",
+                                   lim->version, q, c, lim->host_cpus,
+                                   lim->mem_limit ? fmt_bytes(lim->mem_limit, a, sizeof(a)) : "none",
+                                   fmt_bytes(lim->host_mem, b, sizeof(b)));
+    else fprintf(out, "Resources: no cgroup limits found, host %d CPU(s), %s\n", lim->host_cpus,
+                 fmt_bytes(lim->host_mem, b, sizeof(b)));
+    fprintf(out, "Sizing: %d worker(s)%s, %s blocks%s, prefetch %d%s, write-behind %s%s\n",
+            plan->workers, set[0] ? " (set)" : "",
+            fmt_bytes(plan->block, a, sizeof(a)), set[1] ? " (set)" : "",
+            plan->prefetch, set[2] ? " (set)" : "",
+            fmt_bytes(plan->wb_window, b, sizeof(b)), set[3] ? " (set)" : "");
+}
+
+static void usage(void) {
+    fprintf(stderr,
+        "Usage: bmper [--stats NAME] [--trace OUT.json] [--batch INDIR OUT [--pack] [--fsync] | --queue FILE]\n"
+        "             [--rows FIRST:COUNT] [--pyramid LEVELS] [--align SIZE] [--raw [OFFSET[:LENGTH]]]\n"
+        "       bmper --list PACK | --extract PACK NAME OUTFILE | --unpack PACK DIR\n"
+        "       bmper --keyscan DIR [--jobs N] [--sample SIZE]\n"
+        "       bmper --leak PLAIN CIPHER [--jobs N]\n"
+        "       bmper --manifest FILE [--results LOG]\n"
+        "  Prompts for direction, key, mode, IV and paths on stdin.\n"
+        "  --stats NAME          publish live counters in shared memory segment NAME (see bmper-top)\n"
+        "  --trace OUT.json      record what every thread does and when, written as Chrome trace\n"
+        "                        JSON at exit (open in Perfetto or chrome://tracing)\n"
+        "  --batch INDIR OUTDIR  transform every file in INDIR into OUTDIR (no path prompts)\n"
+        "  --pack                batch output OUT is one pack file with an index, not a directory\n"
+        "  --fsync               make batch outputs durable (fsyncs are grouped)\n"
+        "  --jobs N              batch worker threads (default: from cgroup CPU quota/cpuset)\n"
+        "  --block SIZE          cipher block per worker, e.g. 64K (default: from memory limit)\n"
+        "  --prefetch N          batch inputs read ahead (default: from memory limit)\n"
+        "  --wb-window SIZE      write-behind window per output (default: from memory limit)\n"
+        "  --resources           print detected limits and chosen sizing, then exit\n"
+        "  --keyscan DIR         group the ECB-encrypted BMPs in DIR by key (no key needed),\n"
+        "                        reading --sample SIZE pixel bytes of each (default 64K)\n"
+        "  --leak PLAIN CIPHER   how recognizable each plaintext BMP is in its ciphertext: SSIM and\n"
+        "                        perceptual-hash distance, for two files or two directories\n"
+        "  --manifest FILE       run the jobs in FILE, one JSON object per line with its own in, out,\n"
+        "                        direction, key, mode, iv and options (see manifest.h); no prompts\n"
+        "  --results LOG         manifest result log, one JSON line per job (default: stdout)\n"
+        "  --queue FILE          serve jobs as they arrive, one \"CLASS IN OUT [DEADLINE_MS]\" per\n"
+        "                        line of FILE (- = stdin after the prompts); CLASS is\n"
+        "                        interactive, bulk or auto\n"
+        "  --interactive-max SIZE  batch/auto jobs up to SIZE are interactive (default 4M)\n"
+        "  --deadline MS         deadline of interactive jobs, for ordering and miss counts\n"
+        "  --chunk SIZE          bulk jobs yield to interactive ones every SIZE bytes (default 1M)\n"
+        "  --rows FIRST:COUNT    transform only COUNT pixel rows starting at file row FIRST;\n"
+        "                        the rest of the output is a reflink/copy of the input\n"
+        "  --align SIZE          pad output BMP headers so pixel data starts at a multiple\n"
+        "                        of SIZE (power of two, e.g. 4K); bfOffBits/bfSize follow\n"
+        "  --raw [OFF[:LEN]]     treat input as plain bytes, not BMP/PNG: transform LEN bytes\n"
+        "                        from OFF (default: the whole file) and copy the rest\n"
+        "  --pyramid LEVELS      also write LEVELS-1 2x-downsampled levels as OUT_L<k>.bmp,\n"
+        "                        each with its own derived IV, from one read of the input\n"
+        "  gzip input is detected and inflated on the fly; an output path ending in .gz is\n"
+        "  compressed in parallel blocks (batches keep input names, so .gz stays .gz)\n");
+}
+
 static int prompt_yesno(const char *q) {
     char buf[32];
     printf("%s [y/n]: ", q);
@@ -32,8 +1348,158 @@ static int prompt_line(const char *q, char *out, size_t outsz) {
     return 0;
 }
 
-int main(void) {
-    printf("=== S-DES BMP encrypt/decrypt (ECB/CBC/CTR) ===\n");
+int main(int argc, char **argv) {
+    const char *stats_name = NULL;
+    const char *batch_in = NULL, *batch_out = NULL, *queue_src = NULL;
+    sched_opts_t sched = { .interactive_max = 4u << 20, .chunk = 1u << 20 };
+    unsigned long row_first = 0, row_count = 0;
+    int pyramid_levels = 0;
+    cg_plan_t plan = { .workers = 0, .prefetch = -1, .block = 0, .wb_window = 0 };
+    int plan_set[4] = {0, 0, 0, 0}, show_resources = 0;
+    const char *keyscan_dir = NULL;
+    const char *leak_plain = NULL, *leak_cipher = NULL;
+    uint32_t align = 0;
+    int raw = 0;
+    uint64_t raw_offset = 0, raw_length = 0;
+    const char *manifest = NULL, *results = "-";
+    const char *trace_path = NULL;
+    size_t keyscan_sample = KS_SAMPLE_DEFAULT;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc) stats_name = argv[++i];
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) trace_path = argv[++i];
+        else if (strcmp(argv[i], "--batch") == 0 && i + 2 < argc) { batch_in = argv[++i]; batch_out = argv[++i]; }
+        else if (strcmp(argv[i], "--fsync") == 0) sched.durable = 1;
+        else if (strcmp(argv[i], "--pack") == 0) sched.packing = 1;
+        else if (strcmp(argv[i], "--queue") == 0 && i + 1 < argc) queue_src = argv[++i];
+        else if (strcmp(argv[i], "--interactive-max") == 0 && i + 1 < argc) {
+            const char *v = argv[++i];
+            sched.interactive_max = parse_size(v);
+            if (!sched.interactive_max && strcmp(v, "0") != 0) {
+                fprintf(stderr, "--interactive-max expects a size such as 4M\n"); return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--deadline") == 0 && i + 1 < argc) {
+            char *end;
+            sched.deadline_ms = strtoull(argv[++i], &end, 10);
+            if (*end || !sched.deadline_ms) { fprintf(stderr, "--deadline expects milliseconds > 0\n"); return 1; }
+        }
+        else if (strcmp(argv[i], "--chunk") == 0 && i + 1 < argc) {
+            sched.chunk = parse_size(argv[++i]);
+            if (sched.chunk < 4096) { fprintf(stderr, "--chunk expects a size of at least 4K\n"); return 1; }
+        }
+        else if (strcmp(argv[i], "--resources") == 0) show_resources = 1;
+        else if (strcmp(argv[i], "--keyscan") == 0 && i + 1 < argc) keyscan_dir = argv[++i];
+        else if (strcmp(argv[i], "--leak") == 0 && i + 2 < argc) { leak_plain = argv[++i]; leak_cipher = argv[++i]; }
+        else if (strcmp(argv[i], "--sample") == 0 && i + 1 < argc) {
+            keyscan_sample = parse_size(argv[++i]);
+            if (keyscan_sample < 4096) { fprintf(stderr, "--sample expects a size of at least 4K\n"); return 1; }
+        }
+        else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            plan.workers = atoi(argv[++i]);
+            if (plan.workers < 1 || plan.workers > BATCH_MAX_WORKERS) {
+                fprintf(stderr, "--jobs expects 1..%d\n", BATCH_MAX_WORKERS); return 1;
+            }
+            plan_set[0] = 1;
+        }
+        else if (strcmp(argv[i], "--block") == 0 && i + 1 < argc) {
+            plan.block = parse_size(argv[++i]);
+            if (plan.block < 4096 || plan.block > (64u << 20)) {
+                fprintf(stderr, "--block expects 4K..64M\n"); return 1;
+            }
+            plan_set[1] = 1;
+        }
+        else if (strcmp(argv[i], "--prefetch") == 0 && i + 1 < argc) {
+            plan.prefetch = atoi(argv[++i]);
+            if (plan.prefetch < 0 || plan.prefetch > BATCH_MAX_PREFETCH) {
+                fprintf(stderr, "--prefetch expects 0..%d\n", BATCH_MAX_PREFETCH); return 1;
+            }
+            plan_set[2] = 1;
+        }
+        else if (strcmp(argv[i], "--wb-window") == 0 && i + 1 < argc) {
+            plan.wb_window = parse_size(argv[++i]);
+            if (plan.wb_window < (64u << 10) || plan.wb_window > (1u << 30)) {
+                fprintf(stderr, "--wb-window expects 64K..1G\n"); return 1;
+            }
+            plan_set[3] = 1;
+        }
+        else if ((strcmp(argv[i], "--list") == 0 && i + 1 < argc) ||
+                 ((strcmp(argv[i], "--extract") == 0 || strcmp(argv[i], "--unpack") == 0) && i + 2 < argc)) {
+            if (strcmp(argv[i], "--extract") == 0 && i + 3 >= argc) { usage(); return 1; }
+            return run_pack_tool(argv[i], argv[i + 1], i + 2 < argc ? argv[i + 2] : NULL,
+                                 i + 3 < argc ? argv[i + 3] : NULL);
+        }
+        else if (strcmp(argv[i], "--pyramid") == 0 && i + 1 < argc) {
+            pyramid_levels = atoi(argv[++i]);
+            if (pyramid_levels < 2 || pyramid_levels > PYRAMID_MAX_LEVELS) {
+                fprintf(stderr, "--pyramid expects 2..%d levels\n", PYRAMID_MAX_LEVELS); return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--align") == 0 && i + 1 < argc) {
+            size_t a = parse_size(argv[++i]);
+            if (a < 4 || a > (1u << 20) || (a & (a - 1))) {
+                fprintf(stderr, "--align expects a power of two from 4 to 1M, e.g. 4K\n"); return 1;
+            }
+            align = (uint32_t)a;
+        }
+        else if (strcmp(argv[i], "--manifest") == 0 && i + 1 < argc) manifest = argv[++i];
+        else if (strcmp(argv[i], "--results") == 0 && i + 1 < argc) results = argv[++i];
+        else if (strcmp(argv[i], "--raw") == 0) {
+            raw = 1;
+            if (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0]) &&
+                parse_raw(argv[++i], &raw_offset, &raw_length) != 0) {
+                fprintf(stderr, "--raw expects OFFSET[:LENGTH] with LENGTH > 0, e.g. 1K:64M\n"); return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--rows") == 0 && i + 1 < argc) {
+            char *end;
+            row_first = strtoul(argv[++i], &end, 10);
+            if (*end != ':' || (row_count = strtoul(end + 1, &end, 10)) == 0 || *end ||
+                row_first > UINT32_MAX || row_count > UINT32_MAX) {
+                fprintf(stderr, "--rows expects FIRST:COUNT with COUNT > 0\n"); return 1;
+            }
+        }
+        else { usage(); return 1; }
+    }
+    if (sched.packing && (!batch_in || row_count || pyramid_levels)) {
+        fprintf(stderr, "--pack needs --batch and cannot be combined with --rows or --pyramid\n"); return 1;
+    }
+    if (queue_src && batch_in) { fprintf(stderr, "--queue and --batch are exclusive\n"); return 1; }
+    if (align && (row_count || pyramid_levels)) {
+        // --rows keeps the input layout to share its extents; pyramid levels have their own headers
+        fprintf(stderr, "--align cannot be combined with --rows or --pyramid\n"); return 1;
+    }
+    if (manifest && (batch_in || queue_src || sched.packing || row_count || pyramid_levels || align || raw)) {
+        fprintf(stderr, "--manifest takes paths and per-job options from the file; it cannot be combined\n"
+                        "with --batch, --queue, --pack, --rows, --pyramid, --align or --raw\n"); return 1;
+    }
+    if (raw && (row_count || pyramid_levels || align)) {
+        // all three are about BMP rows and headers
+        fprintf(stderr, "--raw cannot be combined with --rows, --pyramid or --align\n"); return 1;
+    }
+    cg_limits_t limits;
+    cg_read_limits(&limits, NULL);
+    cg_plan(&limits, &plan);
+    if (plan.workers > BATCH_MAX_WORKERS) plan.workers = BATCH_MAX_WORKERS;
+    if (show_resources) { report_sizing(&limits, &plan, plan_set, stdout); return 0; }
+    if (trace_path) {
+        if (trace_start(trace_path) != 0) { perror("--trace"); return 1; }
+        atexit(trace_finish);   // every mode joins its threads before returning
+        trace_thread("main");
+    }
+    if (keyscan_dir) return run_keyscan(keyscan_dir, &plan, keyscan_sample);
+    if (leak_plain) return run_leak(leak_plain, leak_cipher, &plan);
+
+    if (stats_name && stats_open(stats_name) != 0) {
+        perror("stats shared memory"); return 1;
+    }
+    atexit(stats_close);
+    if (manifest) {
+        // With results on stdout, keep it JSON lines only.
+        report_sizing(&limits, &plan, plan_set, strcmp(results, "-") == 0 ? stderr : stdout);
+        return run_manifest(manifest, results, &plan, &sched);
+    }
+
+    printf("=== S-DES BMP encrypt/decrypt (ECB/CBC/CTR/ICBC) ===\n");
 
     int do_encrypt = prompt_yesno("Encrypt? (No means Decrypt)");
     if (do_encrypt < 0) { fprintf(stderr, "Input error.\n"); return 1; }
@@ -46,25 +1512,33 @@ int main(void) {
     if (sdes_parse_key10_bits(keybits, &key10) != 0) {
         fprintf(stderr, "Invalid key string (need 10 bits of 0/1).\n"); return 1;
     }
-    uint8_t K1=0, K2=0;
-    sdes_generate_subkeys(key10, &K1, &K2);
+    sdes_ctx_t ctx;
+    sdes_ctx_init(&ctx, key10);
 
     char mode_s[32];
-    if (prompt_line("Mode (ECB/CBC/CTR): ", mode_s, sizeof(mode_s)) != 0) {
+    if (prompt_line("Mode (ECB/CBC/CTR/ICBC): ", mode_s, sizeof(mode_s)) != 0) {
         fprintf(stderr, "Mode input error.\n"); return 1;
     }
     for (char *p=mode_s; *p; ++p) *p = toupper((unsigned char)*p);
     sdes_mode_t mode = MODE_ECB;
     if (strcmp(mode_s,"CBC")==0) mode = MODE_CBC;
     else if (strcmp(mode_s,"CTR")==0) mode = MODE_CTR;
+    else if (strcmp(mode_s,"ICBC")==0) mode = MODE_ICBC;
     else if (strcmp(mode_s,"ECB")!=0) {
-        fprintf(stderr, "Unknown mode. Use ECB, CBC, or CTR.\n"); return 1;
+        fprintf(stderr, "Unknown mode. Use ECB, CBC, CTR or ICBC.\n"); return 1;
+    }
+    if (mode == MODE_ICBC && pyramid_levels > 1) {
+        fprintf(stderr, "--pyramid does not support ICBC\n"); return 1;
+    }
+    if (!do_encrypt && pyramid_levels > 1) {
+        // Levels are downsampled from the input, which must be the plain image.
+        fprintf(stderr, "--pyramid only encrypts; decrypt each level on its own\n"); return 1;
     }
 
     uint8_t iv_or_nonce = 0;
     if (mode != MODE_ECB) {
         char ivs[64];
-        if (prompt_line(mode==MODE_CBC ? "Enter IV (8-bit, hex like 0xA3): " :
+        if (prompt_line(mode!=MODE_CTR ? "Enter IV (8-bit, hex like 0xA3): " :
                                          "Enter CTR nonce/start (8-bit, hex like 0x17): ",
                         ivs, sizeof(ivs)) != 0) {
             fprintf(stderr, "IV/nonce input error.\n"); return 1;
@@ -76,93 +1550,46 @@ int main(void) {
         }
     }
 
+    // Decryption takes the lane count from the BMP header; raw data has none.
+    int lanes = 0;
+    if (mode == MODE_ICBC && (do_encrypt || raw)) {
+        char ls[32];
+        if (prompt_line("Lanes (16/32/64, empty for 16): ", ls, sizeof(ls)) != 0) {
+            fprintf(stderr, "Lane count input error.\n"); return 1;
+        }
+        lanes = ls[0] ? atoi(ls) : SDES_ICBC_LANES;
+        if (lanes != 16 && lanes != 32 && lanes != 64) {
+            fprintf(stderr, "Lanes must be 16, 32 or 64.\n"); return 1;
+        }
+    }
+
+    if (batch_in || queue_src) {
+        job_t tmpl = { .ctx = &ctx, .mode = mode, .do_encrypt = do_encrypt,
+                       .iv_or_nonce = iv_or_nonce, .lanes = lanes, .io_hints = HINT_INPUT | HINT_OUTPUT,
+                       .row_first = (uint32_t)row_first, .row_count = (uint32_t)row_count,
+                       .pyramid_levels = pyramid_levels, .block = plan.block, .align = align,
+                       .wb_window = (off_t)plan.wb_window, .raw = raw, .raw_offset = raw_offset,
+                       .raw_length = raw_length };
+        report_sizing(&limits, &plan, plan_set, stdout);
+        if (queue_src) return run_queue(queue_src, &tmpl, &plan, &sched);
+        return run_batch(batch_in, batch_out, &tmpl, &plan, &sched);
+    }
+
     char inpath[512], outpath[512];
     if (prompt_line("Input .bmp path: ", inpath, sizeof(inpath)) != 0) return 1;
     if (prompt_line("Output .bmp path: ", outpath, sizeof(outpath)) != 0) return 1;
 
-    FILE *fi = fopen(inpath,"rb");
-    if (!fi) { perror("open input"); return 1; }
-    FILE *fo = fopen(outpath,"wb");
-    if (!fo) { perror("open output"); fclose(fi); return 1; }
-
-    // Read first 14+40=54 bytes to get bfOffBits at offset 10..13 (little endian)
-    unsigned char header[54];
-    size_t hr = fread(header,1,sizeof(header),fi);
-    if (hr != sizeof(header)) { fprintf(stderr,"Not a BMP (short header)\n"); fclose(fi); fclose(fo); return 1; }
-
-    if (header[0] != 'B' || header[1] != 'M') {
-        fprintf(stderr,"Not a BMP (missing 'BM')\n");
-        fclose(fi); fclose(fo); return 1;
+    job_t job = { .inpath = inpath, .outpath = outpath, .ctx = &ctx, .mode = mode,
+                  .do_encrypt = do_encrypt, .iv_or_nonce = iv_or_nonce, .lanes = lanes,
+                  .row_first = (uint32_t)row_first, .row_count = (uint32_t)row_count,
+                  .pyramid_levels = pyramid_levels, .block = plan.block, .align = align,
+                  .gz_threads = plan.workers, .raw = raw, .raw_offset = raw_offset,
+                  .raw_length = raw_length };
+    int rc = process_file(&job);
+    if (bmper_stats) {
+        stats_add(rc ? &bmper_stats->errors : &bmper_stats->files_done, 1);
     }
-    int offBits = read_uint32_le(&header[10]);
-    if (offBits < 54) offBits = 54; // basic safety
-
-    // Write out everything up to offBits unchanged
-    // We already have 54, but if offBits > 54, copy the rest
-    fwrite(header,1,54,fo);
-    if (offBits > 54) {
-        int extra = offBits - 54;
-        unsigned char *buf = (unsigned char*)malloc(extra);
-        if (!buf) { fprintf(stderr,"OOM\n"); fclose(fi); fclose(fo); return 1; }
-        size_t r = fread(buf,1,extra,fi);
-        if ((int)r != extra) { fprintf(stderr,"Unexpected EOF reading palette/headers\n"); free(buf); fclose(fi); fclose(fo); return 1; }
-        fwrite(buf,1,extra,fo);
-        free(buf);
-    }
-
-    // Process the pixel data stream as bytes
-    uint8_t chain = iv_or_nonce;     // for CBC: previous ciphertext; for CTR: counter
-    int c;
-    if (do_encrypt) {
-        if (mode == MODE_ECB) {
-            while ((c = fgetc(fi)) != EOF) {
-                uint8_t out = sdes_encrypt_byte((uint8_t)c, K1, K2);
-                fputc(out, fo);
-            }
-        } else if (mode == MODE_CBC) {
-            uint8_t prev = chain;
-            while ((c = fgetc(fi)) != EOF) {
-                uint8_t x = (uint8_t)c ^ prev;
-                uint8_t out = sdes_encrypt_byte(x, K1, K2);
-                fputc(out, fo);
-                prev = out;
-            }
-        } else { // CTR
-            uint8_t ctr = chain;
-            while ((c = fgetc(fi)) != EOF) {
-                uint8_t keystream = sdes_encrypt_byte(ctr, K1, K2);
-                uint8_t out = ((uint8_t)c) ^ keystream;
-                fputc(out, fo);
-                ctr++; // wraps naturally
-            }
-        }
-    } else { // decrypt
-        if (mode == MODE_ECB) {
-            while ((c = fgetc(fi)) != EOF) {
-                uint8_t out = sdes_decrypt_byte((uint8_t)c, K1, K2);
-                fputc(out, fo);
-            }
-        } else if (mode == MODE_CBC) {
-            uint8_t prev = chain;
-            while ((c = fgetc(fi)) != EOF) {
-                uint8_t dec = sdes_decrypt_byte((uint8_t)c, K1, K2);
-                uint8_t out = dec ^ prev;
-                fputc(out, fo);
-                prev = (uint8_t)c;
-            }
-        } else { // CTR (same as enc)
-            uint8_t ctr = chain;
-            while ((c = fgetc(fi)) != EOF) {
-                uint8_t keystream = sdes_encrypt_byte(ctr, K1, K2);
-                uint8_t out = ((uint8_t)c) ^ keystream;
-                fputc(out, fo);
-                ctr++;
-            }
-        }
-    }
-
-    fclose(fi);
-    fclose(fo);
+    if (rc != 0) return 1;
     printf("Done. Wrote %s\n", outpath);
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,52 @@
+#include "bmpmem.h"
+#include <string.h>
+
+static uint32_t u32le(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+int bmp_transform_mem(const sdes_ctx_t *ctx, sdes_mode_t mode, bool encrypt, uint8_t iv_or_nonce,
+                      const uint8_t *in, uint8_t *out, size_t len) {
+    if (len < 54 || in[0] != 'B' || in[1] != 'M') return -1;
+    size_t off = u32le(&in[10]) < 54 ? 54 : u32le(&in[10]);
+    if (off > len) return -1;
+    if (out != in) memcpy(out, in, off);
+
+    sdes_stream_t st;
+    sdes_stream_init(&st, ctx, mode, encrypt, iv_or_nonce);
+    if (mode == MODE_ICBC) {
+        // Lane count in bfReserved1, as bmper writes it: set on encryption,
+        // read and cleared on decryption.
+        unsigned lanes = encrypt ? SDES_ICBC_LANES : (unsigned)(in[6] | (in[7] << 8));
+        if (sdes_stream_set_lanes(&st, lanes) != 0) return -1;
+        out[6] = encrypt ? (uint8_t)lanes : 0;
+        out[7] = 0;
+    }
+    int bits = in[28] | (in[29] << 8);
+    if (!(u32le(&in[14]) >= 40 && u32le(&in[30]) == 0 && (bits == 1 || bits == 2 || bits == 4))) {
+        sdes_stream_process(&st, in + off, out + off, len - off);
+        return 0;
+    }
+
+    // Packed rows: pixel bytes through the stream, the partial last byte
+    // masked, row padding and anything after the last row copied.
+    int32_t width = (int32_t)u32le(&in[18]), height = (int32_t)u32le(&in[22]);
+    if (width <= 0) return -1;
+    uint64_t rows = height < 0 ? -(int64_t)height : height;
+    uint64_t used = (uint64_t)width * bits;
+    size_t stride = (size_t)(((used + 31) / 32) * 4);
+    size_t full = (size_t)(used / 8);
+    uint8_t tail_mask = (uint8_t)(0xFF00u >> (used % 8));
+    size_t pos = off;
+    for (uint64_t r = 0; r < rows && pos < len; ++r) {
+        size_t n = len - pos < stride ? len - pos : stride;
+        sdes_stream_process(&st, in + pos, out + pos, n < full ? n : full);
+        if (n > full) {
+            if (out != in) memcpy(out + pos + full, in + pos + full, n - full);
+            if (tail_mask) out[pos + full] = sdes_stream_partial(&st, in[pos + full], tail_mask);
+        }
+        pos += n;
+    }
+    if (out != in && pos < len) memcpy(out + pos, in + pos, len - pos);
+    return 0;
+}
@@ -0,0 +1,28 @@
+#ifndef BMPMEM_H
+#define BMPMEM_H
+
+// Transform a whole BMP file held in memory, with the same result bmper gives
+// on disk: everything up to bfOffBits is copied unchanged and the pixel data
+// goes through the mode (packed 1/2/4-bit rows transform only pixel bits).
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sdes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// in == out is allowed. ICBC encrypts with SDES_ICBC_LANES lanes and records
+// them in bfReserved1 like bmper. Returns 0, or -1 if in is not a BMP bmper
+// accepts (short or missing 'BM', bfOffBits past the end, bad packed width,
+// no lane count when decrypting ICBC).
+int bmp_transform_mem(const sdes_ctx_t *ctx, sdes_mode_t mode, bool encrypt, uint8_t iv_or_nonce,
+                      const uint8_t *in, uint8_t *out, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BMPMEM_H
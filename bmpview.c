@@ -0,0 +1,276 @@
+#define _GNU_SOURCE
+#include "bmpview.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/userfaultfd.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#ifndef UFFD_USER_MODE_ONLY
+#define UFFD_USER_MODE_ONLY 1
+#endif
+#endif
+
+struct bmpview {
+    int fd;
+    size_t size;
+    sdes_ctx_t ctx;
+    sdes_mode_t mode;
+    uint8_t iv;
+    size_t off_bits;
+    unsigned lanes;         // ICBC: chains (from bfReserved1) and their IVs
+    uint8_t lane_iv[SDES_ICBC_MAX_LANES];
+    // Packed 1/2/4-bit layout (stride == 0 for byte-oriented pixel data)
+    size_t stride, full, perrow;
+    uint8_t tail_mask;
+    uint64_t rows;
+
+    uint8_t *map;
+    size_t map_len, page;
+    int lazy;
+    int uffd, stop[2];
+    pthread_t thread;
+};
+
+static uint32_t u32le(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Ciphertext byte at file offset pos. raw holds [off - 1, off + n) (raw[0] is
+// only valid when off > 0) and is decrypted back to front, so anything before
+// the current byte is still ciphertext.
+static uint8_t cipher_at(const bmpview_t *v, const uint8_t *raw, off_t off, size_t n, off_t pos) {
+    if (pos >= off - 1 && pos < off + (off_t)n) return raw[pos - off + 1];
+    uint8_t b = 0;
+    if (pread(v->fd, &b, 1, pos) != 1) b = 0;
+    return b;
+}
+
+// ICBC: the ciphertext byte one block (lanes stream bytes) before stream
+// index idx, or that lane's IV in the first block.
+static uint8_t icbc_prev(const bmpview_t *v, const uint8_t *raw, off_t off, size_t n, uint64_t idx) {
+    if (idx < v->lanes) return v->lane_iv[idx];
+    uint64_t p = idx - v->lanes;
+    off_t pos = v->stride ? (off_t)(v->off_bits + (p / v->perrow) * v->stride + p % v->perrow)
+                          : (off_t)(v->off_bits + p);
+    return cipher_at(v, raw, off, n, pos);
+}
+
+// Decrypt raw[1 .. n] (file offsets off .. off+n-1) in place.
+static void decrypt_span(const bmpview_t *v, uint8_t *raw, off_t off, size_t n) {
+    const uint8_t *enc = v->ctx.enc, *dec = v->ctx.dec;
+    for (size_t i = n; i-- > 0; ) {
+        off_t pos = off + (off_t)i;
+        if ((size_t)pos < v->off_bits) {
+            // Header and palette are plaintext, but bmper clears the ICBC lane count.
+            for (off_t h = 6; v->lanes && h < 8; ++h)
+                if (h >= off && h <= pos) raw[h - off + 1] = 0;
+            break;
+        }
+        uint64_t q = (uint64_t)pos - v->off_bits;
+        uint8_t c = raw[i + 1];
+        if (!v->stride) {
+            if (v->mode == MODE_ECB) raw[i + 1] = dec[c];
+            else if (v->mode == MODE_CTR) raw[i + 1] = c ^ enc[(uint8_t)(v->iv + q)];
+            else if (v->mode == MODE_ICBC) raw[i + 1] = dec[c] ^ icbc_prev(v, raw, off, n, q);
+            else raw[i + 1] = dec[c] ^ (q ? cipher_at(v, raw, off, n, pos - 1) : v->iv);
+            continue;
+        }
+        uint64_t row = q / v->stride, col = q % v->stride;
+        if (row >= v->rows || col >= v->perrow) continue; // padding / trailing data
+        // The byte that precedes this one in the cipher stream, if any.
+        off_t prev = -1;
+        if (col > 0) prev = pos - 1;
+        else if (row > 0) prev = (off_t)(v->off_bits + (row - 1) * v->stride + v->perrow - 1);
+        uint64_t idx = row * v->perrow + col;
+        if (col < v->full) {
+            if (v->mode == MODE_ECB) raw[i + 1] = dec[c];
+            else if (v->mode == MODE_CTR) raw[i + 1] = c ^ enc[(uint8_t)(v->iv + idx)];
+            else if (v->mode == MODE_ICBC) raw[i + 1] = dec[c] ^ icbc_prev(v, raw, off, n, idx);
+            else raw[i + 1] = dec[c] ^ (prev >= 0 ? cipher_at(v, raw, off, n, prev) : v->iv);
+        } else {
+            // Partial final byte: keystream merged under the pixel-bit mask.
+            uint8_t chain = v->iv;
+            if (v->mode == MODE_CTR) chain = (uint8_t)(v->iv + idx);
+            else if (v->mode == MODE_CBC && prev >= 0) chain = cipher_at(v, raw, off, n, prev);
+            else if (v->mode == MODE_ICBC) chain = icbc_prev(v, raw, off, n, idx);
+            raw[i + 1] = c ^ (enc[chain] & v->tail_mask);
+        }
+    }
+}
+
+// Read and decrypt [off, off + n) into raw + 1. Returns bytes available.
+static size_t fill(const bmpview_t *v, uint8_t *raw, off_t off, size_t n) {
+    if ((size_t)off >= v->size) return 0;
+    if (n > v->size - (size_t)off) n = v->size - (size_t)off;
+    off_t from = off > 0 ? off - 1 : 0;
+    size_t want = n + (off > 0);
+    size_t got = 0;
+    while (got < want) {
+        ssize_t r = pread(v->fd, raw + (off > 0 ? 0 : 1) + got, want - got, from + (off_t)got);
+        if (r <= 0) break;
+        got += (size_t)r;
+    }
+    if (got < want) return 0;
+    decrypt_span(v, raw, off, n);
+    return n;
+}
+
+ssize_t bmpview_pread(bmpview_t *v, void *buf, size_t n, off_t off) {
+    if (off < 0) { errno = EINVAL; return -1; }
+    if ((size_t)off >= v->size) return 0;
+    if (n > v->size - (size_t)off) n = v->size - (size_t)off;
+    uint8_t *raw = (uint8_t*)malloc(n + 1);
+    if (!raw) return -1;
+    size_t got = fill(v, raw, off, n);
+    memcpy(buf, raw + 1, got);
+    free(raw);
+    if (got != n) { errno = EIO; return -1; }
+    return (ssize_t)n;
+}
+
+#ifdef __linux__
+static void *fault_thread(void *arg) {
+    bmpview_t *v = (bmpview_t*)arg;
+    uint8_t *raw = (uint8_t*)malloc(v->page + 1);
+    if (!raw) return NULL;
+    struct pollfd pfd[2] = {{ v->uffd, POLLIN, 0 }, { v->stop[0], POLLIN, 0 }};
+    for (;;) {
+        if (poll(pfd, 2, -1) < 0) { if (errno == EINTR) continue; break; }
+        if (pfd[1].revents) break;
+        struct uffd_msg msg;
+        if (read(v->uffd, &msg, sizeof(msg)) != sizeof(msg)) continue;
+        if (msg.event != UFFD_EVENT_PAGEFAULT) continue;
+
+        uintptr_t addr = (uintptr_t)msg.arg.pagefault.address & ~(uintptr_t)(v->page - 1);
+        off_t off = (off_t)(addr - (uintptr_t)v->map);
+        memset(raw, 0, v->page + 1);
+        fill(v, raw, off, v->page); // beyond EOF stays zero
+        struct uffdio_copy cp;
+        cp.dst = addr;
+        cp.src = (uintptr_t)(raw + 1);
+        cp.len = v->page;
+        cp.mode = 0;
+        cp.copy = 0;
+        ioctl(v->uffd, UFFDIO_COPY, &cp); // EEXIST: another fault already filled it
+    }
+    free(raw);
+    return NULL;
+}
+
+static int start_lazy(bmpview_t *v) {
+    int fd = (int)syscall(SYS_userfaultfd, O_CLOEXEC | O_NONBLOCK | UFFD_USER_MODE_ONLY);
+    if (fd < 0) fd = (int)syscall(SYS_userfaultfd, O_CLOEXEC | O_NONBLOCK);
+    if (fd < 0) return -1;
+    struct uffdio_api api = { .api = UFFD_API, .features = 0 };
+    struct uffdio_register reg;
+    reg.range.start = (uintptr_t)v->map;
+    reg.range.len = v->map_len;
+    reg.mode = UFFDIO_REGISTER_MODE_MISSING;
+    if (ioctl(fd, UFFDIO_API, &api) != 0 || ioctl(fd, UFFDIO_REGISTER, &reg) != 0 ||
+        pipe(v->stop) != 0) {
+        close(fd);
+        return -1;
+    }
+    v->uffd = fd;
+    if (pthread_create(&v->thread, NULL, fault_thread, v) != 0) {
+        close(v->stop[0]); close(v->stop[1]); close(fd);
+        v->uffd = -1;
+        return -1;
+    }
+    v->lazy = 1;
+    return 0;
+}
+#else
+static int start_lazy(bmpview_t *v) { (void)v; return -1; }
+#endif
+
+bmpview_t *bmpview_open(const char *path, const sdes_ctx_t *ctx, sdes_mode_t mode, uint8_t iv_or_nonce) {
+    bmpview_t *v = (bmpview_t*)calloc(1, sizeof(*v));
+    if (!v) return NULL;
+    v->uffd = -1;
+    v->fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat sb;
+    uint8_t h[54];
+    if (v->fd < 0 || fstat(v->fd, &sb) != 0) goto fail;
+    if (pread(v->fd, h, sizeof(h), 0) != (ssize_t)sizeof(h) || h[0] != 'B' || h[1] != 'M') {
+        errno = EINVAL;
+        goto fail;
+    }
+    v->size = (size_t)sb.st_size;
+    v->ctx = *ctx;
+    v->mode = mode;
+    v->iv = mode == MODE_ECB ? 0 : iv_or_nonce; // as sdes_stream_init
+    v->off_bits = u32le(&h[10]) < 54 ? 54 : u32le(&h[10]);
+    if (mode == MODE_ICBC) {
+        v->lanes = h[6] | (h[7] << 8);
+        if (v->lanes != 16 && v->lanes != 32 && v->lanes != 64) {
+            errno = EINVAL;
+            goto fail;
+        }
+        for (unsigned l = 0; l < v->lanes; ++l) v->lane_iv[l] = sdes_derive_iv(ctx, iv_or_nonce, l);
+    }
+
+    int bits = h[28] | (h[29] << 8);
+    int32_t width = (int32_t)u32le(&h[18]), height = (int32_t)u32le(&h[22]);
+    if (u32le(&h[14]) >= 40 && u32le(&h[30]) == 0 && (bits == 1 || bits == 2 || bits == 4) && width > 0) {
+        uint64_t used = (uint64_t)width * bits;
+        v->stride = (size_t)(((used + 31) / 32) * 4);
+        v->full = (size_t)(used / 8);
+        v->tail_mask = (uint8_t)(0xFF00u >> (used % 8));
+        v->perrow = v->full + (v->tail_mask != 0);
+        v->rows = height < 0 ? -(int64_t)height : height;
+    }
+    return v;
+fail:
+    bmpview_close(v);
+    return NULL;
+}
+
+const uint8_t *bmpview_data(bmpview_t *v) {
+    if (v->map) return v->map;
+    v->page = (size_t)sysconf(_SC_PAGESIZE);
+    v->map_len = (v->size + v->page - 1) / v->page * v->page;
+    if (v->map_len == 0) v->map_len = v->page;
+    void *p = mmap(NULL, v->map_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) return NULL;
+    v->map = (uint8_t*)p;
+    if (start_lazy(v) == 0) return v->map;
+
+    // Fallback: decrypt everything now, in chunks so scratch memory stays small.
+    size_t chunk = 1 << 20;
+    uint8_t *raw = (uint8_t*)malloc(chunk + 1);
+    if (!raw) { munmap(v->map, v->map_len); v->map = NULL; return NULL; }
+    for (size_t off = 0; off < v->size; off += chunk) {
+        size_t n = fill(v, raw, (off_t)off, chunk);
+        memcpy(v->map + off, raw + 1, n);
+    }
+    free(raw);
+    mprotect(v->map, v->map_len, PROT_READ);
+    return v->map;
+}
+
+size_t bmpview_size(const bmpview_t *v) { return v->size; }
+int bmpview_is_lazy(const bmpview_t *v) { return v->lazy; }
+
+void bmpview_close(bmpview_t *v) {
+    if (!v) return;
+    if (v->lazy) {
+        ssize_t w = write(v->stop[1], "x", 1);
+        (void)w;
+        pthread_join(v->thread, NULL);
+        close(v->stop[0]);
+        close(v->stop[1]);
+        close(v->uffd);
+    }
+    if (v->map) munmap(v->map, v->map_len);
+    if (v->fd >= 0) close(v->fd);
+    free(v);
+}
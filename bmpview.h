@@ -0,0 +1,45 @@
+#ifndef BMPVIEW_H
+#define BMPVIEW_H
+
+// Lazy plaintext view of an encrypted BMP written by bmper.
+//
+// bmpview_data() returns the whole file as if it had been decrypted. On Linux
+// with userfaultfd, nothing is decrypted up front: each page is read and
+// decrypted the first time it is touched, so the cost is proportional to what
+// is actually read. Without userfaultfd the mapping is decrypted eagerly on
+// the first bmpview_data() call; bmpview_pread() is always on demand.
+//
+// Random access works for every mode: ECB and CTR bytes are independent of
+// each other (CTR counter = IV + stream index), CBC needs only the preceding
+// ciphertext byte and ICBC the one a block earlier (lane count read from the
+// header). Packed 1/2/4-bit BMPs follow bmper's row layout.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "sdes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct bmpview bmpview_t;
+
+// Returns NULL on error (errno set; EINVAL for a file that is not a BMP, or
+// an ICBC file without a lane count).
+bmpview_t *bmpview_open(const char *path, const sdes_ctx_t *ctx, sdes_mode_t mode, uint8_t iv_or_nonce);
+void bmpview_close(bmpview_t *v);
+
+size_t bmpview_size(const bmpview_t *v);
+// 1 if pages are decrypted on first access through userfaultfd.
+int bmpview_is_lazy(const bmpview_t *v);
+// Plaintext of the whole file, valid until bmpview_close(). NULL on error.
+const uint8_t *bmpview_data(bmpview_t *v);
+// Decrypt n bytes at file offset off into buf. Returns bytes read or -1.
+ssize_t bmpview_pread(bmpview_t *v, void *buf, size_t n, off_t off);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BMPVIEW_H
@@ -0,0 +1,205 @@
+#define _GNU_SOURCE
+#include "cgroup.h"
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define KIB ((size_t)1 << 10)
+#define MIB ((size_t)1 << 20)
+
+static int read_text(const char *path, char *buf, size_t cap) {
+    FILE *f = fopen(path, "r");
+    if (!f) return -1;
+    size_t n = fread(buf, 1, cap - 1, f);
+    fclose(f);
+    buf[n] = '\0';
+    while (n && (buf[n - 1] == '\n' || buf[n - 1] == ' ')) buf[--n] = '\0';
+    return n ? 0 : -1;
+}
+
+// Count CPUs in a list such as "0-3,8,10-11".
+static int count_cpu_list(const char *s) {
+    int n = 0;
+    while (*s) {
+        char *end;
+        long a = strtol(s, &end, 10), b = a;
+        if (end == s) break;
+        if (*end == '-') b = strtol(end + 1, &end, 10);
+        if (b >= a) n += (int)(b - a + 1);
+        s = *end == ',' ? end + 1 : end;
+        if (*end != ',') break;
+    }
+    return n;
+}
+
+// This process's path in the hierarchy holding controller ctrl ("" for v2).
+static int self_path(const char *ctrl, char *out, size_t cap) {
+    FILE *f = fopen("/proc/self/cgroup", "r");
+    if (!f) return -1;
+    char line[1024];
+    int found = -1;
+    size_t cl = strlen(ctrl);
+    while (found != 0 && fgets(line, sizeof(line), f)) {
+        char *c1 = strchr(line, ':'), *c2 = c1 ? strchr(c1 + 1, ':') : NULL;
+        if (!c2) continue;
+        *c2 = '\0';
+        const char *list = c1 + 1;
+        int match = cl == 0 ? *list == '\0' : 0;
+        for (const char *p = list; cl && !match && (p = strstr(p, ctrl)) != NULL; p += cl)
+            match = (p == list || p[-1] == ',') && (p[cl] == '\0' || p[cl] == ',');
+        if (!match) continue;
+        char *path = c2 + 1;
+        path[strcspn(path, "\n")] = '\0';
+        snprintf(out, cap, "%s", path);
+        found = 0;
+    }
+    fclose(f);
+    return found;
+}
+
+typedef void (*visit_fn)(const char *dir, cg_limits_t *lim);
+
+// Visit dir = base + path and each parent up to base. Inside a container the
+// recorded path often does not exist under the mount; those levels are skipped.
+static void walk_up(const char *base, const char *path, visit_fn fn, cg_limits_t *lim) {
+    char rel[1024], dir[1536];
+    snprintf(rel, sizeof(rel), "%s", path);
+    for (;;) {
+        size_t n = strlen(rel);
+        while (n && rel[n - 1] == '/') rel[--n] = '\0';
+        snprintf(dir, sizeof(dir), "%s%s", base, rel);
+        if (access(dir, F_OK) == 0) fn(dir, lim);
+        if (!n) break;
+        char *slash = strrchr(rel, '/');
+        if (!slash) break;
+        *slash = '\0';
+    }
+}
+
+static void lower_quota(cg_limits_t *lim, double q) {
+    if (q > 0 && (lim->cpu_quota == 0 || q < lim->cpu_quota)) lim->cpu_quota = q;
+}
+
+static void lower_cpuset(cg_limits_t *lim, int n) {
+    if (n > 0 && (lim->cpuset_cpus == 0 || n < lim->cpuset_cpus)) lim->cpuset_cpus = n;
+}
+
+static void lower_mem(cg_limits_t *lim, const char *s) {
+    char *end;
+    unsigned long long v = strtoull(s, &end, 10);
+    // v1 reports "no limit" as a huge page-aligned number, v2 as "max".
+    if (end == s || v == 0 || v >= (1ULL << 62)) return;
+    if (lim->mem_limit == 0 || v < lim->mem_limit) lim->mem_limit = v;
+}
+
+static void visit_v2(const char *dir, cg_limits_t *lim) {
+    char path[1600], buf[256];
+    snprintf(path, sizeof(path), "%s/cpu.max", dir);
+    if (read_text(path, buf, sizeof(buf)) == 0 && strncmp(buf, "max", 3) != 0) {
+        double quota = 0, period = 100000;
+        if (sscanf(buf, "%lf %lf", &quota, &period) >= 1 && period > 0) lower_quota(lim, quota / period);
+    }
+    snprintf(path, sizeof(path), "%s/cpuset.cpus.effective", dir);
+    if (read_text(path, buf, sizeof(buf)) == 0) lower_cpuset(lim, count_cpu_list(buf));
+    snprintf(path, sizeof(path), "%s/memory.max", dir);
+    if (read_text(path, buf, sizeof(buf)) == 0) lower_mem(lim, buf);
+    snprintf(path, sizeof(path), "%s/memory.high", dir);
+    if (read_text(path, buf, sizeof(buf)) == 0) lower_mem(lim, buf);
+}
+
+static void visit_v1_cpu(const char *dir, cg_limits_t *lim) {
+    char path[1600], buf[64];
+    long long quota = -1, period = 100000;
+    snprintf(path, sizeof(path), "%s/cpu.cfs_quota_us", dir);
+    if (read_text(path, buf, sizeof(buf)) == 0) quota = atoll(buf);
+    snprintf(path, sizeof(path), "%s/cpu.cfs_period_us", dir);
+    if (read_text(path, buf, sizeof(buf)) == 0) period = atoll(buf);
+    if (quota > 0 && period > 0) lower_quota(lim, (double)quota / (double)period);
+}
+
+static void visit_v1_cpuset(const char *dir, cg_limits_t *lim) {
+    char path[1600], buf[256];
+    snprintf(path, sizeof(path), "%s/cpuset.effective_cpus", dir);
+    if (read_text(path, buf, sizeof(buf)) != 0) {
+        snprintf(path, sizeof(path), "%s/cpuset.cpus", dir);
+        if (read_text(path, buf, sizeof(buf)) != 0) return;
+    }
+    lower_cpuset(lim, count_cpu_list(buf));
+}
+
+static void visit_v1_memory(const char *dir, cg_limits_t *lim) {
+    char path[1600], buf[64];
+    snprintf(path, sizeof(path), "%s/memory.limit_in_bytes", dir);
+    if (read_text(path, buf, sizeof(buf)) == 0) lower_mem(lim, buf);
+}
+
+// v1 mounts a controller at root/<name>, where name may be a combined list.
+static void walk_v1(const char *root, const char *ctrl, const char *const *mounts, visit_fn fn, cg_limits_t *lim) {
+    char rel[1024], base[512];
+    if (self_path(ctrl, rel, sizeof(rel)) != 0) snprintf(rel, sizeof(rel), "/");
+    for (int i = 0; mounts[i]; ++i) {
+        snprintf(base, sizeof(base), "%s/%s", root, mounts[i]);
+        if (access(base, F_OK) == 0) { walk_up(base, rel, fn, lim); return; }
+    }
+}
+
+void cg_read_limits(cg_limits_t *lim, const char *root) {
+    memset(lim, 0, sizeof(*lim));
+    if (!root) root = "/sys/fs/cgroup";
+
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    lim->host_cpus = n > 0 ? (int)n : 1;
+#ifdef CPU_COUNT
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0 && CPU_COUNT(&set) > 0) lim->host_cpus = CPU_COUNT(&set);
+#endif
+    long pages = sysconf(_SC_PHYS_PAGES), page = sysconf(_SC_PAGESIZE);
+    if (pages > 0 && page > 0) lim->host_mem = (uint64_t)pages * (uint64_t)page;
+
+    char path[600], rel[1024];
+    snprintf(path, sizeof(path), "%s/cgroup.controllers", root);
+    if (access(path, F_OK) == 0) {
+        lim->version = 2;
+        if (self_path("", rel, sizeof(rel)) != 0) snprintf(rel, sizeof(rel), "/");
+        walk_up(root, rel, visit_v2, lim);
+    } else {
+        static const char *const cpu[] = {"cpu", "cpu,cpuacct", "cpuacct,cpu", NULL};
+        static const char *const cpuset[] = {"cpuset", NULL};
+        static const char *const memory[] = {"memory", NULL};
+        snprintf(path, sizeof(path), "%s/memory", root);
+        if (access(path, F_OK) == 0) lim->version = 1;
+        walk_v1(root, "cpu", cpu, visit_v1_cpu, lim);
+        walk_v1(root, "cpuset", cpuset, visit_v1_cpuset, lim);
+        walk_v1(root, "memory", memory, visit_v1_memory, lim);
+    }
+    if (lim->host_mem && lim->mem_limit >= lim->host_mem) lim->mem_limit = 0;
+}
+
+static size_t clamp_pow2(uint64_t v, size_t lo, size_t hi) {
+    size_t p = lo;
+    while (p < hi && (uint64_t)p * 2 <= v) p *= 2;
+    return p;
+}
+
+void cg_plan(const cg_limits_t *lim, cg_plan_t *plan) {
+    int cpus = lim->host_cpus > 0 ? lim->host_cpus : 1;
+    if (lim->cpuset_cpus > 0 && lim->cpuset_cpus < cpus) cpus = lim->cpuset_cpus;
+    // A fractional quota is rounded down: one thread more than the quota
+    // allows is exactly what gets throttled.
+    if (lim->cpu_quota > 0 && lim->cpu_quota < cpus) cpus = lim->cpu_quota < 1 ? 1 : (int)lim->cpu_quota;
+    int auto_workers = plan->workers <= 0;
+    if (auto_workers) plan->workers = cpus;
+
+    uint64_t mem = lim->mem_limit ? lim->mem_limit : lim->host_mem;
+    uint64_t budget = mem ? mem / 4 : 256 * MIB;
+    uint64_t share = budget / (uint64_t)plan->workers;
+    if (!plan->block) plan->block = clamp_pow2(share / 64, 16 * KIB, 256 * KIB);
+    if (!plan->wb_window) plan->wb_window = clamp_pow2(share / 4, 1 * MIB, 8 * MIB);
+    if (plan->prefetch < 0) plan->prefetch = budget >= 256 * MIB ? 2 : budget >= 64 * MIB ? 1 : 0;
+    // Up to two write-behind windows per worker can be dirty at once.
+    while (auto_workers && plan->workers > 1 &&
+           (uint64_t)plan->workers * (plan->block + 2 * plan->wb_window) > budget)
+        plan->workers--;
+}
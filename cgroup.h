@@ -0,0 +1,45 @@
+#ifndef CGROUP_H
+#define CGROUP_H
+
+// Container-aware sizing: read the CPU quota, cpuset and memory limit of the
+// cgroup (v1 or v2) this process runs in and derive worker count and buffer
+// sizes that fit inside it, instead of sizing from the host's cores and RAM.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    int version;            // 1 or 2; 0 if no cgroup filesystem was found
+    double cpu_quota;       // CPUs worth of CFS quota, 0 = unlimited
+    int cpuset_cpus;        // CPUs in the cpuset, 0 = unknown
+    int host_cpus;          // CPUs this process may run on (affinity mask)
+    uint64_t mem_limit;     // bytes, 0 = unlimited
+    uint64_t host_mem;      // physical memory in bytes
+} cg_limits_t;
+
+// Limits along the whole cgroup path count, so a tighter parent limit wins.
+// root is the cgroup mount point; NULL means /sys/fs/cgroup.
+void cg_read_limits(cg_limits_t *lim, const char *root);
+
+typedef struct {
+    int workers;            // parallel files in batch mode
+    int prefetch;           // queued inputs read ahead of the ones in progress
+    size_t block;           // cipher block buffer per worker (bytes)
+    size_t wb_window;       // write-behind window per worker (bytes)
+} cg_plan_t;
+
+// Size the plan to the CPUs available and to a quarter of the memory limit,
+// which covers the block buffers plus dirty and read-ahead page cache (both
+// charged to the cgroup). Zero workers/block/wb_window and negative prefetch
+// are chosen here; any other value is kept as an explicit override.
+void cg_plan(const cg_limits_t *lim, cg_plan_t *plan);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CGROUP_H
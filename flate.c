@@ -0,0 +1,639 @@
+#include "flate.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Streaming inflate in the spirit of zlib's "puff": canonical Huffman codes
+// described by per-length counts, with a 9-bit lookup table in front so the
+// common short codes decode in one step.
+
+#define WMASK 32767u
+#define FASTBITS 9
+
+static const uint16_t LBASE[29] = {
+    3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258};
+static const uint8_t LEXT[29] = {
+    0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0};
+static const uint16_t DBASE[30] = {
+    1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,
+    1025,1537,2049,3073,4097,6145,8193,12289,16385,24577};
+static const uint8_t DEXT[30] = {
+    0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13};
+static const uint8_t CLORDER[19] = {16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15};
+
+void flate_inflate_init(flate_inflate_t *z, flate_fill_fn fill, void *opaque) {
+    memset(z, 0, sizeof(*z));
+    z->fill = fill;
+    z->opaque = opaque;
+}
+
+void flate_inflate_reset(flate_inflate_t *z) {
+    z->total = 0;
+    z->phase = 0;
+    z->last = 0;
+    z->stored_left = 0;
+    z->copy_len = 0;
+    z->error = 0;
+}
+
+// Top up the bit buffer from the input without failing at end of input.
+static void refill(flate_inflate_t *z) {
+    while (z->bitcnt <= 56) {
+        if (z->in_pos == z->in_len) {
+            if (z->in_eof) return;
+            z->in_len = z->fill(z->opaque, z->in, sizeof(z->in));
+            z->in_pos = 0;
+            if (z->in_len == 0) { z->in_eof = 1; return; }
+        }
+        z->bitbuf |= (uint64_t)z->in[z->in_pos++] << z->bitcnt;
+        z->bitcnt += 8;
+    }
+}
+
+static uint32_t getbits(flate_inflate_t *z, unsigned n) {
+    if (z->bitcnt < n) {
+        refill(z);
+        if (z->bitcnt < n) { z->error = 1; return 0; }
+    }
+    uint32_t v = (uint32_t)(z->bitbuf & ((1ull << n) - 1));
+    z->bitbuf >>= n;
+    z->bitcnt -= n;
+    return v;
+}
+
+// Build a canonical code from code lengths. Returns -1 if over-subscribed.
+static int build(flate_huff_t *h, const uint8_t *len, int n) {
+    uint16_t offs[16];
+    memset(h->count, 0, sizeof(h->count));
+    memset(h->fast, 0, sizeof(h->fast));
+    for (int s = 0; s < n; ++s) h->count[len[s]]++;
+    if (h->count[0] == n) return 0;
+
+    int left = 1;
+    for (int l = 1; l < 16; ++l) {
+        left <<= 1;
+        left -= h->count[l];
+        if (left < 0) return -1;
+    }
+
+    offs[1] = 0;
+    for (int l = 1; l < 15; ++l) offs[l + 1] = offs[l] + h->count[l];
+    for (int s = 0; s < n; ++s)
+        if (len[s]) h->symbol[offs[len[s]]++] = (uint16_t)s;
+
+    // Fast table, indexed by the next FASTBITS input bits (LSB first).
+    unsigned code = 0, idx = 0;
+    for (unsigned l = 1; l <= FASTBITS; ++l) {
+        for (unsigned k = 0; k < h->count[l]; ++k, ++code, ++idx) {
+            unsigned rev = 0;
+            for (unsigned b = 0; b < l; ++b) rev |= ((code >> b) & 1u) << (l - 1 - b);
+            for (unsigned fill = rev; fill < (1u << FASTBITS); fill += 1u << l)
+                h->fast[fill] = (uint16_t)((l << 9) | h->symbol[idx]);
+        }
+        code <<= 1;
+    }
+    return 0;
+}
+
+static int decode(flate_inflate_t *z, const flate_huff_t *h) {
+    if (z->bitcnt < 15) refill(z);
+    uint16_t e = h->fast[z->bitbuf & ((1u << FASTBITS) - 1)];
+    if (e && (e >> 9) <= z->bitcnt) {
+        z->bitbuf >>= e >> 9;
+        z->bitcnt -= e >> 9;
+        return e & 0x1FF;
+    }
+    int code = 0, first = 0, index = 0;
+    for (int l = 1; l < 16; ++l) {
+        code |= (int)getbits(z, 1);
+        if (z->error) return -1;
+        int count = h->count[l];
+        if (code - count < first) return h->symbol[index + (code - first)];
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+    z->error = 1;
+    return -1;
+}
+
+static void build_fixed(flate_inflate_t *z) {
+    uint8_t len[288];
+    int s = 0;
+    for (; s < 144; ++s) len[s] = 8;
+    for (; s < 256; ++s) len[s] = 9;
+    for (; s < 280; ++s) len[s] = 7;
+    for (; s < 288; ++s) len[s] = 8;
+    build(&z->lencode, len, 288);
+    for (s = 0; s < 30; ++s) len[s] = 5;
+    build(&z->distcode, len, 30);
+}
+
+static int read_dynamic(flate_inflate_t *z) {
+    uint8_t len[320];
+    int nlen = (int)getbits(z, 5) + 257;
+    int ndist = (int)getbits(z, 5) + 1;
+    int ncode = (int)getbits(z, 4) + 4;
+    if (z->error || nlen > 286 || ndist > 30) return -1;
+
+    memset(len, 0, 19);
+    for (int i = 0; i < ncode; ++i) len[CLORDER[i]] = (uint8_t)getbits(z, 3);
+    if (z->error || build(&z->lencode, len, 19) != 0) return -1;
+
+    int i = 0;
+    while (i < nlen + ndist) {
+        int sym = decode(z, &z->lencode);
+        if (sym < 0) return -1;
+        if (sym < 16) { len[i++] = (uint8_t)sym; continue; }
+        uint8_t v = 0;
+        int rep;
+        if (sym == 16) {
+            if (i == 0) return -1;
+            v = len[i - 1];
+            rep = 3 + (int)getbits(z, 2);
+        } else if (sym == 17) {
+            rep = 3 + (int)getbits(z, 3);
+        } else {
+            rep = 11 + (int)getbits(z, 7);
+        }
+        if (z->error || i + rep > nlen + ndist) return -1;
+        while (rep--) len[i++] = v;
+    }
+    if (len[256] == 0) return -1;
+    if (build(&z->lencode, len, nlen) != 0) return -1;
+    if (build(&z->distcode, len + nlen, ndist) != 0) return -1;
+    return 0;
+}
+
+static inline void put(flate_inflate_t *z, uint8_t *out, size_t *produced, uint8_t b) {
+    z->window[z->total & WMASK] = b;
+    z->total++;
+    out[(*produced)++] = b;
+}
+
+long flate_inflate_read(flate_inflate_t *z, uint8_t *out, size_t cap) {
+    size_t produced = 0;
+    while (produced < cap && !z->error) {
+        if (z->copy_len) {
+            while (z->copy_len && produced < cap) {
+                put(z, out, &produced, z->window[(z->total - z->copy_dist) & WMASK]);
+                z->copy_len--;
+            }
+            continue;
+        }
+        if (z->phase == 0) {
+            z->last = (int)getbits(z, 1);
+            int type = (int)getbits(z, 2);
+            if (z->error) break;
+            if (type == 0) {
+                z->bitbuf >>= z->bitcnt & 7;
+                z->bitcnt -= z->bitcnt & 7;
+                uint32_t len = getbits(z, 16);
+                uint32_t nlen = getbits(z, 16);
+                if (z->error || len != (~nlen & 0xFFFF)) { z->error = 1; break; }
+                z->stored_left = len;
+                z->phase = 1;
+            } else if (type == 1) {
+                build_fixed(z);
+                z->phase = 2;
+            } else if (type == 2) {
+                if (read_dynamic(z) != 0) { z->error = 1; break; }
+                z->phase = 2;
+            } else {
+                z->error = 1;
+            }
+        } else if (z->phase == 1) {
+            if (z->stored_left == 0) { z->phase = z->last ? 3 : 0; continue; }
+            // Drain whole bytes still held in the bit buffer, then copy from input.
+            if (z->bitcnt >= 8) {
+                put(z, out, &produced, (uint8_t)getbits(z, 8));
+                z->stored_left--;
+                continue;
+            }
+            if (z->in_pos == z->in_len) {
+                refill(z);
+                if (z->bitcnt < 8) { z->error = 1; break; }
+                continue;
+            }
+            size_t n = z->in_len - z->in_pos;
+            if (n > z->stored_left) n = z->stored_left;
+            if (n > cap - produced) n = cap - produced;
+            for (size_t k = 0; k < n; ++k) put(z, out, &produced, z->in[z->in_pos + k]);
+            z->in_pos += n;
+            z->stored_left -= (uint32_t)n;
+        } else if (z->phase == 2) {
+            int sym = decode(z, &z->lencode);
+            if (sym < 0) break;
+            if (sym < 256) {
+                put(z, out, &produced, (uint8_t)sym);
+            } else if (sym == 256) {
+                z->phase = z->last ? 3 : 0;
+            } else {
+                sym -= 257;
+                if (sym >= 29) { z->error = 1; break; }
+                unsigned len = LBASE[sym] + getbits(z, LEXT[sym]);
+                int ds = decode(z, &z->distcode);
+                if (ds < 0 || ds >= 30) { z->error = 1; break; }
+                unsigned dist = DBASE[ds] + getbits(z, DEXT[ds]);
+                if (z->error || dist > z->total || dist > WMASK + 1) { z->error = 1; break; }
+                z->copy_len = len;
+                z->copy_dist = dist;
+            }
+        } else {
+            break;
+        }
+    }
+    if (z->error) return -1;
+    return (long)produced;
+}
+
+int flate_getbyte(flate_inflate_t *z) {
+    z->bitbuf >>= z->bitcnt & 7;
+    z->bitcnt -= z->bitcnt & 7;
+    if (z->bitcnt >= 8) {
+        int b = (int)(z->bitbuf & 0xFF);
+        z->bitbuf >>= 8;
+        z->bitcnt -= 8;
+        return b;
+    }
+    if (z->in_pos == z->in_len) {
+        if (z->in_eof) return -1;
+        z->in_len = z->fill(z->opaque, z->in, sizeof(z->in));
+        z->in_pos = 0;
+        if (z->in_len == 0) { z->in_eof = 1; return -1; }
+    }
+    return z->in[z->in_pos++];
+}
+
+// --- Checksums ---
+
+static uint32_t crc_table[256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static void build_crc_table(void) {
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        crc_table[i] = c;
+    }
+}
+
+uint32_t flate_crc32(uint32_t crc, const uint8_t *p, size_t n) {
+    pthread_once(&crc_once, build_crc_table);
+    crc = ~crc;
+    for (size_t i = 0; i < n; ++i) crc = crc_table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+uint32_t flate_adler32(uint32_t adler, const uint8_t *p, size_t n) {
+    uint32_t a = adler & 0xFFFF, b = adler >> 16;
+    while (n) {
+        size_t k = n < 5552 ? n : 5552;
+        n -= k;
+        while (k--) { a += *p++; b += a; }
+        a %= 65521;
+        b %= 65521;
+    }
+    return (b << 16) | a;
+}
+
+// The gzip trailer's CRC of data compressed in independent pieces: zlib's
+// crc32_combine, applying len2 zero bytes to crc1 as a GF(2) matrix power.
+static uint32_t gf2_times(const uint32_t *mat, uint32_t vec) {
+    uint32_t sum = 0;
+    for (; vec; vec >>= 1, ++mat)
+        if (vec & 1) sum ^= *mat;
+    return sum;
+}
+
+static void gf2_square(uint32_t *sq, const uint32_t *mat) {
+    for (int n = 0; n < 32; ++n) sq[n] = gf2_times(mat, mat[n]);
+}
+
+uint32_t flate_crc32_combine(uint32_t crc1, uint32_t crc2, uint64_t len2) {
+    uint32_t even[32], odd[32];
+    if (len2 == 0) return crc1;
+    odd[0] = 0xEDB88320u;   // operator for one zero bit
+    for (int n = 1; n < 32; ++n) odd[n] = 1u << (n - 1);
+    gf2_square(even, odd);  // two zero bits
+    gf2_square(odd, even);  // four
+    for (;;) {
+        gf2_square(even, odd);
+        if (len2 & 1) crc1 = gf2_times(even, crc1);
+        if (!(len2 >>= 1)) break;
+        gf2_square(odd, even);
+        if (len2 & 1) crc1 = gf2_times(odd, crc1);
+        if (!(len2 >>= 1)) break;
+    }
+    return crc1 ^ crc2;
+}
+
+// --- Compression ---
+
+// Greedy LZ77 over a 32K window with hash chains, one dynamic Huffman block
+// per DSYMS symbols (or stored blocks where those come out smaller). Matches
+// never reach before the start of the input, which is what makes pieces
+// compressed on different threads independent.
+
+#define DHASH_BITS 15
+#define DCHAIN 32           // candidates tried per position
+#define DINSERT 32          // longer matches skip hashing their interior
+#define DSKIP 5             // after 2^DSKIP misses in a row, step over more bytes
+#define DSYMS 16384
+
+typedef struct {
+    uint8_t *out;
+    size_t pos;
+    uint64_t bitbuf;
+    unsigned bitcnt;
+} bitw_t;
+
+typedef struct {
+    bitw_t w;
+    uint32_t head[1u << DHASH_BITS];    // position + 1 of the newest entry, 0 = none
+    uint32_t prev[WMASK + 1];
+    uint16_t lit[DSYMS];                // literal byte or match length
+    uint16_t dist[DSYMS];               // 0 for literals
+    size_t nsym;
+    uint32_t lfreq[286], dfreq[30];
+    uint8_t lcode[259];                 // length -> length symbol - 257
+    uint8_t dcode_lo[256], dcode_hi[256];  // distance - 1 (< 256, else >> 7) -> symbol
+} deflate_t;
+
+static void putbits(bitw_t *w, uint32_t v, unsigned n) {
+    w->bitbuf |= (uint64_t)v << w->bitcnt;
+    w->bitcnt += n;
+    while (w->bitcnt >= 8) {
+        w->out[w->pos++] = (uint8_t)w->bitbuf;
+        w->bitbuf >>= 8;
+        w->bitcnt -= 8;
+    }
+}
+
+static void alignbits(bitw_t *w) {
+    if (w->bitcnt) putbits(w, 0, 8 - w->bitcnt);
+}
+
+// Code lengths for freq[0..n), at most maxlen bits. Unused symbols get 0. The
+// tree is built with the two-queue method over leaves sorted by frequency; if
+// it is too deep, frequencies are flattened and it is built again.
+static void huff_lengths(const uint32_t *freq, int n, int maxlen, uint8_t *len) {
+    uint32_t f[286], w[2 * 286];
+    uint16_t leaf[286], parent[2 * 286];
+    uint8_t depth[2 * 286];
+    memcpy(f, freq, n * sizeof(*f));
+    for (;;) {
+        int m = 0;
+        for (int s = 0; s < n; ++s) {
+            len[s] = 0;
+            if (!f[s]) continue;
+            int k = m++;
+            for (; k > 0 && f[leaf[k - 1]] > f[s]; --k) leaf[k] = leaf[k - 1];
+            leaf[k] = (uint16_t)s;
+        }
+        if (m == 0) return;
+        if (m == 1) { len[leaf[0]] = 1; return; }
+        for (int k = 0; k < m; ++k) w[k] = f[leaf[k]];
+        int li = 0, qi = m, qn = m;
+        for (int k = 0; k < m - 1; ++k) {
+            int a = (li < m && (qi == qn || w[li] <= w[qi])) ? li++ : qi++;
+            int b = (li < m && (qi == qn || w[li] <= w[qi])) ? li++ : qi++;
+            w[qn] = w[a] + w[b];
+            parent[a] = parent[b] = (uint16_t)qn++;
+        }
+        // Internal nodes are created in order, so parents come after children.
+        int maxd = 0;
+        depth[qn - 1] = 0;
+        for (int k = qn - 2; k >= 0; --k) {
+            depth[k] = (uint8_t)(depth[parent[k]] + 1);
+            if (k < m && depth[k] > maxd) maxd = depth[k];
+        }
+        if (maxd <= maxlen) {
+            for (int k = 0; k < m; ++k) len[leaf[k]] = depth[k];
+            return;
+        }
+        for (int s = 0; s < n; ++s)
+            if (f[s]) f[s] = (f[s] >> 1) | 1;
+    }
+}
+
+// Decoders want a complete code: a lone symbol gets a sibling.
+static void huff_pad(uint8_t *len, int n) {
+    int used = 0, last = 0;
+    for (int s = 0; s < n; ++s)
+        if (len[s]) { used++; last = s; }
+    if (used == 0) len[0] = len[1] = 1;
+    else if (used == 1) len[last == 0 ? 1 : 0] = 1;
+}
+
+// Canonical codes, bit-reversed for LSB-first output.
+static void huff_codes(const uint8_t *len, int n, uint16_t *code) {
+    uint16_t count[16] = {0}, next[16];
+    for (int s = 0; s < n; ++s) count[len[s]]++;
+    count[0] = 0;
+    unsigned c = 0;
+    for (int l = 1; l < 16; ++l) {
+        c = (c + count[l - 1]) << 1;
+        next[l] = (uint16_t)c;
+    }
+    for (int s = 0; s < n; ++s) {
+        if (!len[s]) continue;
+        unsigned v = next[len[s]]++, rev = 0;
+        for (int b = 0; b < len[s]; ++b) rev |= ((v >> b) & 1u) << (len[s] - 1 - b);
+        code[s] = (uint16_t)rev;
+    }
+}
+
+static unsigned dsym(const deflate_t *d, unsigned dist) {
+    return dist <= 256 ? d->dcode_lo[dist - 1] : d->dcode_hi[(dist - 1) >> 7];
+}
+
+static void put_stored(bitw_t *w, const uint8_t *raw, size_t n, int last) {
+    do {
+        size_t k = n < 65535 ? n : 65535;
+        n -= k;
+        putbits(w, (last && n == 0) ? 1 : 0, 3);
+        alignbits(w);
+        putbits(w, (uint32_t)k, 16);
+        putbits(w, (uint32_t)k ^ 0xFFFF, 16);
+        if (k) memcpy(w->out + w->pos, raw, k);
+        w->pos += k;
+        raw += k;
+    } while (n);
+}
+
+// Emit the collected symbols, which cover raw[0..n), as one block.
+static void flush_block(deflate_t *d, const uint8_t *raw, size_t n, int last) {
+    uint8_t len[286 + 30], cllen[19];
+    uint16_t lcodes[286], dcodes[30], clcodes[19];
+    uint32_t clfreq[19] = {0};
+    uint16_t rle[286 + 30];     // code length symbol | repeat extra << 5
+    int nrle = 0;
+
+    d->lfreq[256] = 1;
+    huff_lengths(d->lfreq, 286, 15, len);
+    huff_lengths(d->dfreq, 30, 15, len + 286);
+    huff_pad(len, 286);
+    huff_pad(len + 286, 30);
+    int nlen = 286, ndist = 30;
+    while (nlen > 257 && !len[nlen - 1]) nlen--;
+    while (ndist > 1 && !len[286 + ndist - 1]) ndist--;
+    memmove(len + nlen, len + 286, ndist);
+
+    // Run-length code the two length tables as one sequence.
+    for (int i = 0; i < nlen + ndist;) {
+        int r = 1;
+        while (i + r < nlen + ndist && len[i + r] == len[i]) r++;
+        if (len[i] == 0 && r >= 3) {
+            if (r > 138) r = 138;
+            rle[nrle++] = r <= 10 ? (uint16_t)(17 | (r - 3) << 5) : (uint16_t)(18 | (r - 11) << 5);
+        } else if (i > 0 && len[i] == len[i - 1] && r >= 3) {
+            if (r > 6) r = 6;
+            rle[nrle++] = (uint16_t)(16 | (r - 3) << 5);
+        } else {
+            r = 1;
+            rle[nrle++] = len[i];
+        }
+        i += r;
+    }
+    for (int i = 0; i < nrle; ++i) clfreq[rle[i] & 31]++;
+    huff_lengths(clfreq, 19, 7, cllen);
+    huff_pad(cllen, 19);
+    int ncode = 19;
+    while (ncode > 4 && !cllen[CLORDER[ncode - 1]]) ncode--;
+
+    // Compare the exact dynamic size with storing the bytes.
+    uint64_t bits = 3 + 14 + 3 * (uint64_t)ncode;
+    for (int s = 0; s < 19; ++s) bits += (uint64_t)clfreq[s] * cllen[s];
+    bits += 2 * clfreq[16] + 3 * clfreq[17] + 7 * clfreq[18];
+    for (int s = 0; s < 286; ++s)
+        bits += (uint64_t)d->lfreq[s] * ((s < nlen ? len[s] : 0) + (s > 256 ? LEXT[s - 257] : 0));
+    for (int s = 0; s < 30; ++s)
+        bits += (uint64_t)d->dfreq[s] * ((s < ndist ? len[nlen + s] : 0) + DEXT[s]);
+    uint64_t stored = 3 + 7 + (n / 65535 + 1) * 40 + 8 * (uint64_t)n;
+
+    if (stored <= bits) {
+        put_stored(&d->w, raw, n, last);
+    } else {
+        huff_codes(len, nlen, lcodes);
+        huff_codes(len + nlen, ndist, dcodes);
+        huff_codes(cllen, 19, clcodes);
+        bitw_t *w = &d->w;
+        putbits(w, last ? 1 : 0, 1);
+        putbits(w, 2, 2);
+        putbits(w, (uint32_t)(nlen - 257), 5);
+        putbits(w, (uint32_t)(ndist - 1), 5);
+        putbits(w, (uint32_t)(ncode - 4), 4);
+        for (int i = 0; i < ncode; ++i) putbits(w, cllen[CLORDER[i]], 3);
+        for (int i = 0; i < nrle; ++i) {
+            unsigned s = rle[i] & 31;
+            putbits(w, clcodes[s], cllen[s]);
+            if (s >= 16) putbits(w, rle[i] >> 5, s == 16 ? 2 : s == 17 ? 3 : 7);
+        }
+        for (size_t i = 0; i < d->nsym; ++i) {
+            if (!d->dist[i]) {
+                putbits(w, lcodes[d->lit[i]], len[d->lit[i]]);
+                continue;
+            }
+            unsigned ls = d->lcode[d->lit[i]], ds = dsym(d, d->dist[i]);
+            putbits(w, lcodes[257 + ls], len[257 + ls]);
+            putbits(w, d->lit[i] - LBASE[ls], LEXT[ls]);
+            putbits(w, dcodes[ds], len[nlen + ds]);
+            putbits(w, d->dist[i] - DBASE[ds], DEXT[ds]);
+        }
+        putbits(w, lcodes[256], len[256]);
+    }
+    d->nsym = 0;
+    memset(d->lfreq, 0, sizeof(d->lfreq));
+    memset(d->dfreq, 0, sizeof(d->dfreq));
+}
+
+size_t flate_deflate_bound(size_t n) {
+    return n + 6 * (n / 16384 + 1) + 5 * (n / 65535 + 1) + 16;
+}
+
+static inline uint32_t dhash(const uint8_t *p) {
+    uint32_t v = (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16;
+    return (v * 2654435761u) >> (32 - DHASH_BITS);
+}
+
+size_t flate_deflate_chunk(const uint8_t *in, size_t n, int final, uint8_t *out) {
+    deflate_t *d = (deflate_t*)calloc(1, sizeof(*d));
+    if (!d) return 0;
+    d->w.out = out;
+    for (int s = 0; s < 29; ++s)
+        for (unsigned l = LBASE[s]; l < (s == 28 ? 259u : LBASE[s + 1]); ++l) d->lcode[l] = (uint8_t)s;
+    for (int s = 0; s < 30; ++s) {
+        for (unsigned v = DBASE[s] - 1; v < 256 && v < DBASE[s] - 1 + (1u << DEXT[s]); ++v)
+            d->dcode_lo[v] = (uint8_t)s;
+        if (DBASE[s] > 256)
+            for (unsigned v = (DBASE[s] - 1) >> 7; v <= (DBASE[s] - 2 + (1u << DEXT[s])) >> 7; ++v)
+                d->dcode_hi[v] = (uint8_t)s;
+    }
+
+    // Incompressible input (CBC/CTR output) would pay a chain walk per byte:
+    // like snappy, search less often the longer nothing has matched.
+    size_t pos = 0, start = 0;
+    unsigned misses = 0;
+    while (pos < n) {
+        unsigned best = 0, bdist = 0;
+        if (n - pos >= 3) {
+            unsigned limit = n - pos < 258 ? (unsigned)(n - pos) : 258;
+            uint32_t h = dhash(in + pos), cand = d->head[h];
+            for (int chain = DCHAIN; cand && chain; --chain) {
+                size_t c = cand - 1;
+                if (pos - c > WMASK + 1) break;
+                if (in[c + best] == in[pos + best]) {
+                    unsigned l = 0;
+                    while (l < limit && in[c + l] == in[pos + l]) l++;
+                    if (l > best) {
+                        best = l;
+                        bdist = (unsigned)(pos - c);
+                        if (l == limit) break;
+                    }
+                }
+                uint32_t next = d->prev[c & WMASK];
+                if (next >= cand) break;    // slot reused by a newer position
+                cand = next;
+            }
+            d->prev[pos & WMASK] = d->head[h];
+            d->head[h] = (uint32_t)pos + 1;
+        }
+        if (best >= 3) {
+            d->lit[d->nsym] = (uint16_t)best;
+            d->dist[d->nsym++] = (uint16_t)bdist;
+            d->lfreq[257 + d->lcode[best]]++;
+            d->dfreq[dsym(d, bdist)]++;
+            if (best <= DINSERT) {
+                for (size_t p = pos + 1; p < pos + best && p + 3 <= n; ++p) {
+                    uint32_t h = dhash(in + p);
+                    d->prev[p & WMASK] = d->head[h];
+                    d->head[h] = (uint32_t)p + 1;
+                }
+            }
+            pos += best;
+            misses = 0;
+        } else {
+            for (size_t k = 1 + (misses++ >> DSKIP); k && pos < n && d->nsym < DSYMS; --k) {
+                d->lit[d->nsym] = in[pos];
+                d->dist[d->nsym++] = 0;
+                d->lfreq[in[pos]]++;
+                pos++;
+            }
+        }
+        if (d->nsym == DSYMS) {
+            flush_block(d, in + start, pos - start, 0);
+            start = pos;
+        }
+    }
+    if (d->nsym || final) flush_block(d, in + start, pos - start, final);
+    if (final) {
+        alignbits(&d->w);
+    } else {
+        put_stored(&d->w, NULL, 0, 0);   // empty stored block: byte aligned
+    }
+    size_t size = d->w.pos;
+    free(d);
+    return size;
+}
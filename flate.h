@@ -0,0 +1,78 @@
+#ifndef FLATE_H
+#define FLATE_H
+
+// Minimal streaming DEFLATE decoder (RFC 1951), a block compressor, and the
+// checksums used by the zlib/PNG and gzip containers. No external dependencies.
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Input source: copy up to cap bytes into buf, return the count (0 = end of input).
+typedef size_t (*flate_fill_fn)(void *opaque, uint8_t *buf, size_t cap);
+
+typedef struct {
+    uint16_t count[16];     // number of codes of each length
+    uint16_t symbol[320];   // symbols ordered by code
+    uint16_t fast[512];     // 9-bit lookup: (len << 9) | symbol, 0 = use slow path
+} flate_huff_t;
+
+typedef struct {
+    flate_fill_fn fill;
+    void *opaque;
+    uint8_t in[16384];
+    size_t in_pos, in_len;
+    int in_eof;
+
+    uint64_t bitbuf;
+    unsigned bitcnt;
+
+    uint8_t window[32768];
+    uint64_t total;         // bytes produced so far (window index = total & 32767)
+
+    int phase;              // 0 = block header, 1 = stored, 2 = huffman, 3 = done
+    int last;
+    uint32_t stored_left;
+    unsigned copy_len, copy_dist;
+    flate_huff_t lencode, distcode;
+    int error;
+} flate_inflate_t;
+
+void flate_inflate_init(flate_inflate_t *z, flate_fill_fn fill, void *opaque);
+
+// Decompress up to cap bytes into out. Returns bytes produced, 0 once the final
+// block has been fully delivered, or -1 on malformed/truncated input.
+long flate_inflate_read(flate_inflate_t *z, uint8_t *out, size_t cap);
+
+// Start a new DEFLATE stream at the current input position (after a container
+// header read with flate_getbyte), keeping input already buffered.
+void flate_inflate_reset(flate_inflate_t *z);
+
+// Byte-aligned raw access to the input (container headers and trailers).
+// Discards any partial byte first. Returns the byte or -1 at end of input.
+int flate_getbyte(flate_inflate_t *z);
+
+// Compress in[0..n) into out as complete DEFLATE blocks that refer to nothing
+// before in, so pieces compressed separately (on different threads) can be
+// concatenated into one stream, pigz style. A non-final piece ends with an
+// empty stored block, leaving the stream byte aligned; the final one sets
+// BFINAL. out must hold flate_deflate_bound(n) bytes. Returns the compressed
+// size, 0 if out of memory. Thread-safe.
+size_t flate_deflate_bound(size_t n);
+size_t flate_deflate_chunk(const uint8_t *in, size_t n, int final, uint8_t *out);
+
+// flate_crc32() keeps a table built on first use: call it once before
+// sharing it between threads.
+uint32_t flate_crc32(uint32_t crc, const uint8_t *p, size_t n);
+// CRC of A followed by B from crc32(A), crc32(B) and the length of B.
+uint32_t flate_crc32_combine(uint32_t crc1, uint32_t crc2, uint64_t len2);
+uint32_t flate_adler32(uint32_t adler, const uint8_t *p, size_t n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FLATE_H
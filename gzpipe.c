@@ -0,0 +1,326 @@
+#define _GNU_SOURCE
+#include "gzpipe.h"
+#include "flate.h"
+#include "trace.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define GZ_PIPE (1 << 20)   // requested pipe capacity between stages
+#define GZ_IO 65536
+
+typedef struct {
+    uint8_t *in, *out;
+    size_t in_len, out_len;
+    uint32_t crc;
+    int done;
+} gz_piece_t;
+
+struct gz_stage {
+    FILE *gz;
+    int fd;                 // the stage's end of the pipe
+    pthread_t tid;
+    int error;
+
+    // Writer: a ring of pieces. [written, next) are being compressed or done,
+    // [next, filled) wait for a compressing thread.
+    gz_piece_t *ring;
+    unsigned nring;
+    uint64_t filled, next, written;
+    int closing;
+    pthread_t *workers;
+    int nworkers;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+int gz_detect(FILE *f) {
+    unsigned char m[2];
+    size_t n = fread(m, 1, 2, f);
+    rewind(f);
+    return n == 2 && m[0] == 0x1F && m[1] == 0x8B;
+}
+
+// The stage's end of a pipe outlives a caller that stops early: get EPIPE
+// instead of SIGPIPE.
+static void block_sigpipe(void) {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+}
+
+static gz_stage_t *stage_new(FILE *gz, FILE **plain, int caller_writes) {
+    int fds[2];
+    if (pipe(fds) != 0) return NULL;
+#ifdef F_SETPIPE_SZ
+    fcntl(fds[0], F_SETPIPE_SZ, GZ_PIPE);
+#endif
+    gz_stage_t *g = (gz_stage_t*)calloc(1, sizeof(*g));
+    *plain = g ? fdopen(caller_writes ? fds[1] : fds[0], caller_writes ? "wb" : "rb") : NULL;
+    if (!*plain) { free(g); close(fds[0]); close(fds[1]); return NULL; }
+    g->gz = gz;
+    g->fd = caller_writes ? fds[0] : fds[1];
+    pthread_mutex_init(&g->lock, NULL);
+    pthread_cond_init(&g->cond, NULL);
+    return g;
+}
+
+static void free_stage(gz_stage_t *g) {
+    for (unsigned i = 0; g->ring && i < g->nring; ++i) {
+        free(g->ring[i].in);
+        free(g->ring[i].out);
+    }
+    free(g->ring);
+    free(g->workers);
+    if (g->fd >= 0) close(g->fd);
+    pthread_mutex_destroy(&g->lock);
+    pthread_cond_destroy(&g->cond);
+    free(g);
+}
+
+// --- Reader ---
+
+static size_t gz_fill(void *opaque, uint8_t *buf, size_t cap) {
+    return fread(buf, 1, cap, (FILE*)opaque);
+}
+
+static int write_all(int fd, const uint8_t *p, size_t n) {
+    while (n) {
+        ssize_t w = write(fd, p, n);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return -1;
+        p += w;
+        n -= (size_t)w;
+    }
+    return 0;
+}
+
+// Skip the rest of a member header after the magic. Returns -1 if malformed.
+static int skip_header(flate_inflate_t *z) {
+    int method = flate_getbyte(z), flags = flate_getbyte(z);
+    if (method != 8 || flags < 0 || (flags & 0xE0)) return -1;
+    for (int i = 0; i < 6; ++i)                   // MTIME, XFL, OS
+        if (flate_getbyte(z) < 0) return -1;
+    if (flags & 4) {                              // FEXTRA
+        int lo = flate_getbyte(z), hi = flate_getbyte(z);
+        if (hi < 0) return -1;
+        for (int n = lo | hi << 8; n > 0; --n)
+            if (flate_getbyte(z) < 0) return -1;
+    }
+    for (int bit = 8; bit <= 16; bit <<= 1) {     // FNAME, FCOMMENT
+        if (!(flags & bit)) continue;
+        int c;
+        while ((c = flate_getbyte(z)) > 0) {}
+        if (c < 0) return -1;
+    }
+    if ((flags & 2) && (flate_getbyte(z) < 0 || flate_getbyte(z) < 0)) return -1;   // FHCRC
+    return 0;
+}
+
+static void *reader_main(void *arg) {
+    gz_stage_t *g = (gz_stage_t*)arg;
+    block_sigpipe();
+    trace_thread("gzip reader");
+    flate_inflate_t *z = (flate_inflate_t*)malloc(sizeof(*z));
+    uint8_t *buf = (uint8_t*)malloc(GZ_IO);
+    if (!z || !buf) { fprintf(stderr,"OOM\n"); g->error = 1; goto out; }
+    flate_inflate_init(z, gz_fill, g->gz);
+    // Concatenated members decompress to the concatenation of their data.
+    for (int members = 0;; ++members) {
+        int m0 = flate_getbyte(z);
+        if (m0 < 0 && members > 0) break;
+        if (m0 != 0x1F || flate_getbyte(z) != 0x8B) {
+            if (members == 0) { fprintf(stderr,"Not a gzip file\n"); g->error = 1; }
+            break;      // like gzip, ignore trailing garbage
+        }
+        if (skip_header(z) != 0) { fprintf(stderr,"Bad gzip header\n"); g->error = 1; break; }
+        flate_inflate_reset(z);
+        uint32_t crc = 0, size = 0;
+        long n;
+        uint64_t ts = trace_begin();
+        while ((n = flate_inflate_read(z, buf, GZ_IO)) > 0) {
+            crc = flate_crc32(crc, buf, (size_t)n);
+            size += (uint32_t)n;
+            trace_end(ts, "inflate", (uint64_t)n);
+            ts = trace_begin();
+            if (write_all(g->fd, buf, (size_t)n) != 0) goto out;   // caller stopped reading
+            trace_end(ts, "pipe write", (uint64_t)n);
+            ts = trace_begin();
+        }
+        uint8_t t[8];
+        int k = 0;
+        for (int c; n == 0 && k < 8 && (c = flate_getbyte(z)) >= 0; ++k) t[k] = (uint8_t)c;
+        if (n < 0 || k < 8) { fprintf(stderr,"Corrupt or truncated gzip data\n"); g->error = 1; break; }
+        if (crc != ((uint32_t)t[0] | (uint32_t)t[1] << 8 | (uint32_t)t[2] << 16 | (uint32_t)t[3] << 24) ||
+            size != ((uint32_t)t[4] | (uint32_t)t[5] << 8 | (uint32_t)t[6] << 16 | (uint32_t)t[7] << 24)) {
+            fprintf(stderr,"gzip CRC/length mismatch\n"); g->error = 1; break;
+        }
+    }
+    if (!g->error && ferror(g->gz)) { perror("read gzip input"); g->error = 1; }
+out:
+    free(buf);
+    free(z);
+    close(g->fd);   // end of data for the caller
+    g->fd = -1;
+    return NULL;
+}
+
+gz_stage_t *gz_reader_start(FILE *gz, FILE **plain) {
+    gz_stage_t *g = stage_new(gz, plain, 0);
+    if (!g) { perror("gzip pipe"); return NULL; }
+    if (pthread_create(&g->tid, NULL, reader_main, g) != 0) {
+        fprintf(stderr,"Cannot start gzip reader\n");
+        fclose(*plain);
+        free_stage(g);
+        return NULL;
+    }
+    return g;
+}
+
+// --- Writer ---
+
+static void compress_piece(gz_piece_t *p) {
+    uint64_t t = trace_begin();
+    p->crc = flate_crc32(0, p->in, p->in_len);
+    p->out_len = flate_deflate_chunk(p->in, p->in_len, 0, p->out);
+    trace_end(t, "deflate", p->in_len);
+}
+
+static void *worker_main(void *arg) {
+    gz_stage_t *g = (gz_stage_t*)arg;
+    trace_thread("gzip worker");
+    pthread_mutex_lock(&g->lock);
+    for (;;) {
+        while (g->next == g->filled && !g->closing) pthread_cond_wait(&g->cond, &g->lock);
+        if (g->next == g->filled) break;
+        gz_piece_t *p = &g->ring[g->next++ % g->nring];
+        pthread_mutex_unlock(&g->lock);
+        compress_piece(p);
+        pthread_mutex_lock(&g->lock);
+        p->done = 1;
+        pthread_cond_broadcast(&g->cond);
+    }
+    pthread_mutex_unlock(&g->lock);
+    return NULL;
+}
+
+static size_t read_full(int fd, uint8_t *p, size_t n) {
+    size_t got = 0;
+    while (got < n) {
+        ssize_t r = read(fd, p + got, n - got);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) break;
+        got += (size_t)r;
+    }
+    return got;
+}
+
+// Write out the oldest piece, waiting for it if wait is set. Returns 0 if there
+// was nothing (ready) to write. Called with the lock held.
+static int write_oldest(gz_stage_t *g, int wait, uint32_t *crc, uint64_t *total) {
+    if (g->written == g->filled) return 0;
+    gz_piece_t *p = &g->ring[g->written % g->nring];
+    while (wait && !p->done) pthread_cond_wait(&g->cond, &g->lock);
+    if (!p->done) return 0;
+    pthread_mutex_unlock(&g->lock);
+    if (!g->error && p->out_len == 0) { fprintf(stderr,"OOM\n"); g->error = 1; }
+    uint64_t t = trace_begin();
+    if (!g->error && fwrite(p->out, 1, p->out_len, g->gz) != p->out_len) {
+        perror("write gzip output"); g->error = 1;
+    }
+    trace_end(t, "write gz", p->out_len);
+    *crc = flate_crc32_combine(*crc, p->crc, p->in_len);
+    *total += p->in_len;
+    pthread_mutex_lock(&g->lock);
+    p->done = 0;
+    g->written++;
+    return 1;
+}
+
+static void *writer_main(void *arg) {
+    gz_stage_t *g = (gz_stage_t*)arg;
+    static const uint8_t header[10] = { 0x1F, 0x8B, 8, 0, 0, 0, 0, 0, 0, 3 };
+    uint32_t crc = 0;
+    uint64_t total = 0;
+    trace_thread("gzip writer");
+    if (fwrite(header, 1, sizeof(header), g->gz) != sizeof(header)) { perror("write gzip output"); g->error = 1; }
+
+    pthread_mutex_lock(&g->lock);
+    for (;;) {
+        // A full ring waits for its oldest piece; otherwise write what is ready.
+        while (write_oldest(g, g->filled - g->written == g->nring, &crc, &total)) {}
+        gz_piece_t *p = &g->ring[g->filled % g->nring];
+        pthread_mutex_unlock(&g->lock);
+        // After an error keep draining the pipe so the caller never blocks.
+        uint64_t t = trace_begin();
+        p->in_len = read_full(g->fd, p->in, GZ_BLOCK);
+        trace_end(t, "pipe read", p->in_len);
+        if (p->in_len && !g->nworkers) { compress_piece(p); p->done = 1; }
+        pthread_mutex_lock(&g->lock);
+        if (!p->in_len) break;
+        g->filled++;
+        pthread_cond_broadcast(&g->cond);
+    }
+    while (write_oldest(g, 1, &crc, &total)) {}
+    g->closing = 1;
+    pthread_cond_broadcast(&g->cond);
+    pthread_mutex_unlock(&g->lock);
+
+    // Pieces end byte aligned without BFINAL: close with an empty final block.
+    uint8_t tail[10] = { 0x03, 0x00 };
+    for (int i = 0; i < 4; ++i) {
+        tail[2 + i] = (uint8_t)(crc >> (8 * i));
+        tail[6 + i] = (uint8_t)(total >> (8 * i));
+    }
+    if (!g->error && fwrite(tail, 1, sizeof(tail), g->gz) != sizeof(tail)) { perror("write gzip output"); g->error = 1; }
+    return NULL;
+}
+
+gz_stage_t *gz_writer_start(FILE *gz, int threads, FILE **plain) {
+    gz_stage_t *g = stage_new(gz, plain, 1);
+    if (!g) { perror("gzip pipe"); return NULL; }
+    if (threads < 1) threads = 1;
+    if (threads > GZ_MAX_THREADS) threads = GZ_MAX_THREADS;
+    // Two pieces per thread keep every thread busy while the oldest is written.
+    g->nring = 2 * (unsigned)threads;
+    g->ring = (gz_piece_t*)calloc(g->nring, sizeof(*g->ring));
+    g->workers = (pthread_t*)calloc((size_t)threads, sizeof(*g->workers));
+    int ok = g->ring && g->workers;
+    for (unsigned i = 0; ok && i < g->nring; ++i) {
+        g->ring[i].in = (uint8_t*)malloc(GZ_BLOCK);
+        g->ring[i].out = (uint8_t*)malloc(flate_deflate_bound(GZ_BLOCK));
+        ok = g->ring[i].in && g->ring[i].out;
+    }
+    if (!ok) { fprintf(stderr,"OOM\n"); fclose(*plain); free_stage(g); return NULL; }
+    if (threads > 1)
+        while (g->nworkers < threads && pthread_create(&g->workers[g->nworkers], NULL, worker_main, g) == 0)
+            g->nworkers++;
+    if (pthread_create(&g->tid, NULL, writer_main, g) != 0) {
+        fprintf(stderr,"Cannot start gzip writer\n");
+        pthread_mutex_lock(&g->lock);
+        g->closing = 1;
+        pthread_cond_broadcast(&g->cond);
+        pthread_mutex_unlock(&g->lock);
+        for (int i = 0; i < g->nworkers; ++i) pthread_join(g->workers[i], NULL);
+        fclose(*plain);
+        free_stage(g);
+        return NULL;
+    }
+    return g;
+}
+
+int gz_finish(gz_stage_t *g, FILE *plain) {
+    int rc = 0;
+    if (fclose(plain) != 0 && g->ring) { perror("write gzip output"); rc = -1; }
+    pthread_join(g->tid, NULL);
+    for (int i = 0; i < g->nworkers; ++i) pthread_join(g->workers[i], NULL);
+    if (g->error) rc = -1;
+    free_stage(g);
+    return rc;
+}
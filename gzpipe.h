@@ -0,0 +1,44 @@
+#ifndef GZPIPE_H
+#define GZPIPE_H
+
+// gzip (RFC 1952) input and output as pipeline stages around bmper's stdio
+// code. Each stage runs on its own thread and talks to the caller through a
+// pipe, so inflating, the cipher pass and deflating overlap, and memory is
+// bounded by the pipe plus a few blocks per compressing thread.
+//
+// Output is pigz style: the input is cut into GZ_BLOCK pieces that are
+// deflated independently on worker threads, written in order as one member,
+// and their CRCs are combined for the trailer.
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GZ_BLOCK (128u << 10)   // input bytes per independently compressed piece
+#define GZ_MAX_THREADS 64
+
+typedef struct gz_stage gz_stage_t;
+
+// 1 if the seekable file f starts with the gzip magic; f is rewound.
+int gz_detect(FILE *f);
+
+// Inflate every member of the gzip file gz on a thread; *plain reads the
+// decompressed bytes (it is a pipe: not seekable). NULL on error.
+gz_stage_t *gz_reader_start(FILE *gz, FILE **plain);
+
+// Compress everything written to *plain into gz as one gzip member, using
+// threads compressing threads (1 = compress on the stage thread). NULL on error.
+gz_stage_t *gz_writer_start(FILE *gz, int threads, FILE **plain);
+
+// Close plain and wait for the stage; gz stays open. Returns 0, or -1 if the
+// input was not valid gzip, or the output could not be written (reported on
+// stderr). A reader closed before the end stops quietly.
+int gz_finish(gz_stage_t *g, FILE *plain);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // GZPIPE_H
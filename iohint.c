@@ -0,0 +1,180 @@
+#define _GNU_SOURCE
+#include "iohint.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
+
+void io_prefetch(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return;
+    // WILLNEED queues asynchronous readahead; the pages outlive the fd.
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    close(fd);
+}
+
+void io_input_sequential(int fd) {
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+}
+
+void io_input_done(int fd, off_t upto) {
+    if (upto > 0) posix_fadvise(fd, 0, upto, POSIX_FADV_DONTNEED);
+}
+
+void io_wb_init(io_wb_t *wb, int fd) {
+    wb->fd = fd;
+    wb->started = 0;
+    wb->dropped = 0;
+    wb->window = IO_WB_WINDOW;
+}
+
+// Wait for writeback of [dropped, upto) and evict it.
+static void drop_range(io_wb_t *wb, off_t upto) {
+    if (upto <= wb->dropped) return;
+#ifdef SYNC_FILE_RANGE_WRITE
+    sync_file_range(wb->fd, wb->dropped, upto - wb->dropped,
+                    SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+#endif
+    posix_fadvise(wb->fd, wb->dropped, upto - wb->dropped, POSIX_FADV_DONTNEED);
+    wb->dropped = upto;
+}
+
+void io_wb_advance(io_wb_t *wb, off_t written) {
+    while (written - wb->started >= wb->window) {
+        off_t prev = wb->started;
+#ifdef SYNC_FILE_RANGE_WRITE
+        sync_file_range(wb->fd, prev, wb->window, SYNC_FILE_RANGE_WRITE);
+#endif
+        wb->started = prev + wb->window;
+        drop_range(wb, prev);
+    }
+}
+
+void io_wb_finish(io_wb_t *wb, off_t written) {
+#ifdef SYNC_FILE_RANGE_WRITE
+    if (written > wb->started)
+        sync_file_range(wb->fd, wb->started, written - wb->started, SYNC_FILE_RANGE_WRITE);
+#endif
+    wb->started = written;
+    drop_range(wb, wb->started > wb->window ? wb->started - wb->window : 0);
+}
+
+int io_clone_file(int in_fd, int out_fd, off_t size) {
+#ifdef FICLONE
+    if (ioctl(out_fd, FICLONE, in_fd) == 0) return 0;
+#endif
+    off_t done = 0;
+#ifdef __linux__
+    // Shares extents on some filesystems and avoids user-space copies elsewhere.
+    while (done < size) {
+        loff_t src = done, dst = done;
+        ssize_t n = copy_file_range(in_fd, &src, out_fd, &dst, (size_t)(size - done), 0);
+        if (n <= 0) break;
+        done += n;
+    }
+#endif
+    char buf[1 << 16];
+    while (done < size) {
+        ssize_t n = pread(in_fd, buf, sizeof(buf), done);
+        if (n < 0) return -1;
+        if (n == 0) break;
+        if (pwrite(out_fd, buf, (size_t)n, done) != n) return -1;
+        done += n;
+    }
+    return 0;
+}
+
+static char *pending[IO_SYNC_BATCH];
+static int npending = 0;
+static pthread_mutex_t pending_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Take the pending list under the lock; the fsyncs themselves run outside it.
+static int take_pending(char **out) {
+    int n = npending;
+    memcpy(out, pending, (size_t)n * sizeof(*out));
+    npending = 0;
+    return n;
+}
+
+static int sync_paths(char **paths, int n) {
+    int rc = 0;
+    // Most data is already on its way thanks to write-behind, so these are cheap.
+    for (int i = 0; i < n; ++i) {
+        int fd = open(paths[i], O_RDONLY);
+        if (fd < 0 || fsync(fd) != 0) rc = -1;
+        if (fd >= 0) close(fd);
+        free(paths[i]);
+    }
+    return rc;
+}
+
+// Distinct parent directories of deferred files, fsynced by io_sync_flush so
+// new directory entries are durable too. Guarded by pending_lock.
+static char **dirs;
+static size_t ndirs, capdirs;
+
+static int add_dir(const char *path) {
+    const char *slash = strrchr(path, '/');
+    size_t len = slash ? (slash == path ? 1 : (size_t)(slash - path)) : 1;
+    const char *dir = slash ? path : ".";
+    for (size_t i = 0; i < ndirs; ++i)
+        if (strlen(dirs[i]) == len && memcmp(dirs[i], dir, len) == 0) return 0;
+    if (ndirs == capdirs) {
+        size_t cap = capdirs ? capdirs * 2 : 16;
+        char **d = (char**)realloc(dirs, cap * sizeof(*d));
+        if (!d) return -1;
+        dirs = d;
+        capdirs = cap;
+    }
+    if (!(dirs[ndirs] = strndup(dir, len))) return -1;
+    ndirs++;
+    return 0;
+}
+
+static int sync_dir(const char *dir) {
+    int fd = open(dir, O_RDONLY | O_DIRECTORY);
+    int rc = fd < 0 || fsync(fd) != 0 ? -1 : 0;
+    if (fd >= 0) close(fd);
+    return rc;
+}
+
+int io_sync_defer(const char *path) {
+    char *p = strdup(path);
+    if (!p) return -1;
+    char *batch[IO_SYNC_BATCH];
+    int n = 0;
+    pthread_mutex_lock(&pending_lock);
+    if (add_dir(path) != 0) {
+        pthread_mutex_unlock(&pending_lock);
+        free(p);
+        return -1;
+    }
+    pending[npending++] = p;
+    if (npending == IO_SYNC_BATCH) n = take_pending(batch);
+    pthread_mutex_unlock(&pending_lock);
+    return sync_paths(batch, n);
+}
+
+int io_sync_flush(const char *dir) {
+    char *batch[IO_SYNC_BATCH];
+    pthread_mutex_lock(&pending_lock);
+    int n = take_pending(batch);
+    char **d = dirs;
+    size_t nd = ndirs;
+    dirs = NULL;
+    ndirs = capdirs = 0;
+    pthread_mutex_unlock(&pending_lock);
+    int rc = sync_paths(batch, n);
+    for (size_t i = 0; i < nd; ++i) {
+        if (sync_dir(d[i]) != 0) rc = -1;
+        free(d[i]);
+    }
+    free(d);
+    if (dir && sync_dir(dir) != 0) rc = -1;
+    return rc;
+}
@@ -0,0 +1,55 @@
+#ifndef IOHINT_H
+#define IOHINT_H
+
+// Page-cache hints for batch runs: read ahead the next queued inputs, push
+// finished output ranges to disk in small steady steps and drop them from
+// the cache, and batch fsyncs when durability is requested. All hints are
+// advisory; failures are ignored.
+
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IO_WB_WINDOW (8 << 20)   // default write-behind granularity in bytes
+
+// Ask the kernel to start reading the whole file into the page cache.
+void io_prefetch(const char *path);
+
+// Input consumed sequentially: read ahead aggressively, drop pages once used.
+void io_input_sequential(int fd);
+void io_input_done(int fd, off_t upto);
+
+// Write-behind over an output fd. Call io_wb_advance() with the number of bytes
+// already handed to the kernel (after fflush); it starts writeback of each full
+// window and waits for and drops the one before it.
+typedef struct {
+    int fd;
+    off_t started;     // writeback started up to here
+    off_t dropped;     // written back and evicted up to here
+    off_t window;      // granularity; io_wb_init sets IO_WB_WINDOW
+} io_wb_t;
+
+void io_wb_init(io_wb_t *wb, int fd);
+void io_wb_advance(io_wb_t *wb, off_t written);
+void io_wb_finish(io_wb_t *wb, off_t written);
+
+// Make out_fd a copy of the first size bytes of in_fd: a reflink (FICLONE)
+// where the filesystem supports it, else copy_file_range, else read/write.
+// Returns 0 on success, -1 with errno set.
+int io_clone_file(int in_fd, int out_fd, off_t size);
+
+// Deferred fsync of completed outputs, flushed every IO_SYNC_BATCH files.
+// io_sync_flush also fsyncs the parent directory of every deferred file, and
+// dir if not NULL, so new files survive a crash. Safe to call from several
+// threads.
+#define IO_SYNC_BATCH 64
+int io_sync_defer(const char *path);
+int io_sync_flush(const char *dir);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOHINT_H
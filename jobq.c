@@ -0,0 +1,136 @@
+#include "jobq.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char *CLASS_NAMES[JOBQ_CLASSES] = {"interactive", "bulk"};
+
+void jobq_init(jobq_t *q) {
+    memset(q, 0, sizeof(*q));
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->cond, NULL);
+    for (int c = 0; c < JOBQ_CLASSES; ++c) atomic_init(&q->depth[c], 0);
+}
+
+void jobq_destroy(jobq_t *q) {
+    for (int c = 0; c < JOBQ_CLASSES; ++c) free(q->lat[c]);
+    pthread_cond_destroy(&q->cond);
+    pthread_mutex_destroy(&q->lock);
+}
+
+// Interactive items sort by deadline (none = last), ties keep arrival order.
+static int before(const jobq_item_t *a, const jobq_item_t *b) {
+    if (a->deadline_ns == b->deadline_ns) return 0;
+    if (!a->deadline_ns) return 0;
+    return !b->deadline_ns || a->deadline_ns < b->deadline_ns;
+}
+
+void jobq_push(jobq_t *q, jobq_item_t *it) {
+    jobq_class_t c = it->cls;
+    it->next = NULL;
+    pthread_mutex_lock(&q->lock);
+    if (c == JOBQ_INTERACTIVE && q->head[c] && before(it, q->tail[c])) {
+        jobq_item_t **p = &q->head[c];
+        while (!before(it, *p)) p = &(*p)->next;
+        it->next = *p;
+        *p = it;
+    } else {
+        if (q->tail[c]) q->tail[c]->next = it;
+        else q->head[c] = it;
+        q->tail[c] = it;
+    }
+    atomic_fetch_add_explicit(&q->depth[c], 1, memory_order_release);
+    pthread_cond_signal(&q->cond);
+    pthread_mutex_unlock(&q->lock);
+}
+
+void jobq_close(jobq_t *q) {
+    pthread_mutex_lock(&q->lock);
+    q->closed = 1;
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->lock);
+}
+
+static jobq_item_t *take(jobq_t *q, int c) {
+    jobq_item_t *it = q->head[c];
+    q->head[c] = it->next;
+    if (!q->head[c]) q->tail[c] = NULL;
+    atomic_fetch_sub_explicit(&q->depth[c], 1, memory_order_relaxed);
+    return it;
+}
+
+jobq_item_t *jobq_pop(jobq_t *q) {
+    jobq_item_t *it = NULL;
+    pthread_mutex_lock(&q->lock);
+    for (;;) {
+        for (int c = 0; c < JOBQ_CLASSES && !it; ++c)
+            if (q->head[c]) it = take(q, c);
+        if (it || q->closed) break;
+        pthread_cond_wait(&q->cond, &q->lock);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return it;
+}
+
+jobq_item_t *jobq_pop_urgent(jobq_t *q) {
+    if (atomic_load_explicit(&q->depth[JOBQ_INTERACTIVE], memory_order_acquire) == 0) return NULL;
+    jobq_item_t *it = NULL;
+    pthread_mutex_lock(&q->lock);
+    if (q->head[JOBQ_INTERACTIVE]) it = take(q, JOBQ_INTERACTIVE);
+    pthread_mutex_unlock(&q->lock);
+    return it;
+}
+
+size_t jobq_depth(jobq_t *q) {
+    size_t n = 0;
+    for (int c = 0; c < JOBQ_CLASSES; ++c) n += atomic_load_explicit(&q->depth[c], memory_order_relaxed);
+    return n;
+}
+
+size_t jobq_peek(jobq_t *q, void **out, size_t max) {
+    size_t n = 0;
+    pthread_mutex_lock(&q->lock);
+    for (int c = 0; c < JOBQ_CLASSES; ++c)
+        for (jobq_item_t *it = q->head[c]; it && n < max; it = it->next) out[n++] = it->payload;
+    pthread_mutex_unlock(&q->lock);
+    return n;
+}
+
+void jobq_done(jobq_t *q, const jobq_item_t *it, uint64_t now_ns) {
+    int c = it->cls;
+    pthread_mutex_lock(&q->lock);
+    if (q->nlat[c] == q->caplat[c]) {
+        size_t cap = q->caplat[c] ? q->caplat[c] * 2 : 256;
+        uint64_t *p = (uint64_t*)realloc(q->lat[c], cap * sizeof(*p));
+        if (p) { q->lat[c] = p; q->caplat[c] = cap; }
+    }
+    if (q->nlat[c] < q->caplat[c]) q->lat[c][q->nlat[c]++] = now_ns - it->arrival_ns;
+    if (it->deadline_ns && now_ns > it->deadline_ns) q->missed[c]++;
+    pthread_mutex_unlock(&q->lock);
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+// Nearest-rank percentile of sorted v[0..n).
+static double pct_ms(const uint64_t *v, size_t n, double p) {
+    size_t r = (size_t)(p / 100.0 * (double)n + 0.999999);
+    if (r < 1) r = 1;
+    return (double)v[r - 1] / 1e6;
+}
+
+void jobq_report(jobq_t *q, FILE *out) {
+    pthread_mutex_lock(&q->lock);
+    for (int c = 0; c < JOBQ_CLASSES; ++c) {
+        size_t n = q->nlat[c];
+        if (!n) continue;
+        qsort(q->lat[c], n, sizeof(*q->lat[c]), cmp_u64);
+        fprintf(out, "Latency %-11s %6zu job(s): p50 %.2f ms, p90 %.2f ms, p99 %.2f ms, max %.2f ms",
+                CLASS_NAMES[c], n, pct_ms(q->lat[c], n, 50), pct_ms(q->lat[c], n, 90),
+                pct_ms(q->lat[c], n, 99), (double)q->lat[c][n - 1] / 1e6);
+        if (q->missed[c]) fprintf(out, ", %zu missed deadline", q->missed[c]);
+        fputc('\n', out);
+    }
+    pthread_mutex_unlock(&q->lock);
+}
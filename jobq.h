@@ -0,0 +1,62 @@
+#ifndef JOBQ_H
+#define JOBQ_H
+
+// Priority job queue for batch and queue runs. Interactive jobs always go
+// before bulk ones and are ordered by deadline (earliest first, then arrival);
+// bulk jobs are FIFO. Workers processing bulk jobs poll jobq_pop_urgent() at
+// chunk boundaries, so a small urgent job never waits for a whole large file.
+// Completion latency (arrival to done) is kept per class for percentiles.
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum { JOBQ_INTERACTIVE = 0, JOBQ_BULK = 1, JOBQ_CLASSES = 2 } jobq_class_t;
+
+typedef struct jobq_item {
+    struct jobq_item *next;
+    jobq_class_t cls;
+    uint64_t arrival_ns;    // stats_now_ns() clock
+    uint64_t deadline_ns;   // absolute; 0 = none
+    void *payload;
+} jobq_item_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    jobq_item_t *head[JOBQ_CLASSES], *tail[JOBQ_CLASSES];
+    atomic_size_t depth[JOBQ_CLASSES];  // read without the lock at preemption points
+    int closed;
+    uint64_t *lat[JOBQ_CLASSES];        // completion latencies in ns
+    size_t nlat[JOBQ_CLASSES], caplat[JOBQ_CLASSES];
+    size_t missed[JOBQ_CLASSES];        // finished after their deadline
+} jobq_t;
+
+void jobq_init(jobq_t *q);
+void jobq_destroy(jobq_t *q);
+void jobq_push(jobq_t *q, jobq_item_t *it);
+// No more pushes; jobq_pop returns NULL once the queue drains.
+void jobq_close(jobq_t *q);
+// Highest-priority item, blocking until one arrives or the queue is closed.
+jobq_item_t *jobq_pop(jobq_t *q);
+// An interactive item if one is queued, else NULL. Cheap when none is.
+jobq_item_t *jobq_pop_urgent(jobq_t *q);
+size_t jobq_depth(jobq_t *q);
+// Payloads of up to max items in the order jobq_pop would return them.
+size_t jobq_peek(jobq_t *q, void **out, size_t max);
+// Record the item's latency at now_ns, and a missed deadline if any.
+void jobq_done(jobq_t *q, const jobq_item_t *it, uint64_t now_ns);
+// One line per class that ran: count, p50/p90/p99/max latency, misses.
+void jobq_report(jobq_t *q, FILE *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // JOBQ_H
@@ -0,0 +1,48 @@
+#ifndef KEYSCAN_H
+#define KEYSCAN_H
+
+// Key fingerprints for ECB-encrypted BMPs. ECB under one key is a fixed byte
+// substitution, so images that share a key can be grouped without knowing it:
+// a sample of each image's pixel bytes is reduced to counts of neighbouring
+// byte pairs, and every distinct S-DES key is tried on those counts. The key
+// under which neighbouring pixels differ least is the image's fingerprint.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define KS_SAMPLE_DEFAULT (64u << 10)   // pixel bytes read per image
+#define KS_CHUNKS 16                    // ...in this many spread-out pieces
+#define KS_MIN_MARGIN 1.25              // below this the best key is not trusted
+
+typedef struct {
+    uint32_t pairs[65536];  // count of (byte, byte one pixel later) as a << 8 | b
+    uint64_t sampled;       // pixel bytes read
+    uint64_t pixel_bytes;   // pixel bytes in the file
+    int step;               // bytes per pixel used for the pairs (1 for <= 8 bits)
+} ks_sample_t;
+
+typedef struct {
+    uint16_t key10;         // winning key (all 1024 give distinct tables)
+    uint8_t K1, K2;
+    double score;           // mean |difference| of neighbouring decrypted bytes
+    double margin;          // runner-up score / best score; near 1 = ambiguous
+} ks_guess_t;
+
+// Read up to budget pixel bytes of the BMP at path (all of them if the file
+// is smaller) and count neighbouring pairs. Returns 0, or -1 if the file can't
+// be read or is not a BMP.
+int ks_sample(const char *path, size_t budget, ks_sample_t *s);
+
+// Try every distinct key on the sample. Returns 0, or -1 if it has no pairs.
+// Thread-safe; the first call builds the shared key tables.
+int ks_guess(const ks_sample_t *s, ks_guess_t *g);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KEYSCAN_H
@@ -0,0 +1,293 @@
+#include "leak.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#define LK_MAX_THREADS 64
+
+static uint32_t u32le(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint8_t luma(uint32_t r, uint32_t g, uint32_t b) {
+    return (uint8_t)((77 * r + 150 * g + 29 * b + 128) >> 8);
+}
+
+// One colour channel of a 16/32-bit pixel, scaled to 0..255.
+typedef struct { uint32_t mask, max; int shift; } lk_field_t;
+
+static void field_init(lk_field_t *f, uint32_t mask) {
+    f->mask = mask;
+    f->shift = 0;
+    while (mask && !((mask >> f->shift) & 1)) f->shift++;
+    f->max = mask ? mask >> f->shift : 1;
+}
+
+static uint32_t field_get(const lk_field_t *f, uint32_t px) {
+    return (uint32_t)((uint64_t)((px & f->mask) >> f->shift) * 255 / f->max);
+}
+
+int lk_load(const char *path, lk_image_t *img) {
+    img->y = NULL;
+    FILE *f = fopen(path, "rb");
+    if (!f) return -1;
+    uint8_t h[66], pal[1024], lut[256] = { 0 }, *row = NULL;
+    int rc = -1;
+    if (fread(h, 1, 54, f) != 54 || h[0] != 'B' || h[1] != 'M') goto out;
+    uint32_t off = u32le(&h[10]), dib = u32le(&h[14]), comp = u32le(&h[30]), colors = u32le(&h[46]);
+    int32_t w = (int32_t)u32le(&h[18]), hh = (int32_t)u32le(&h[22]);
+    int bits = h[28] | (h[29] << 8);
+    if (dib < 40 || w <= 0 || hh == 0 || hh == INT32_MIN) goto out;
+    if (bits != 1 && bits != 2 && bits != 4 && bits != 8 && bits != 16 && bits != 24 && bits != 32) goto out;
+    if (!(comp == 0 || (comp == 3 && (bits == 16 || bits == 32)))) goto out;
+    int height = hh < 0 ? -hh : hh;
+    if ((uint64_t)w * (uint64_t)height > (1ull << 32)) goto out;
+
+    lk_field_t fr, fg, fb;
+    if (bits <= 8) {
+        size_t n = colors && colors < (1u << bits) ? colors : 1u << bits;
+        if (fseek(f, 14 + (long)dib, SEEK_SET) != 0 || fread(pal, 4, n, f) != n) goto out;
+        for (size_t i = 0; i < n; ++i) lut[i] = luma(pal[4 * i + 2], pal[4 * i + 1], pal[4 * i]);
+    } else if (comp == 3) {
+        // The masks follow a 40-byte header and sit at the same place in larger ones.
+        if (fread(h + 54, 1, 12, f) != 12) goto out;
+        field_init(&fr, u32le(&h[54]));
+        field_init(&fg, u32le(&h[58]));
+        field_init(&fb, u32le(&h[62]));
+    } else if (bits == 16) {
+        field_init(&fr, 0x7C00);
+        field_init(&fg, 0x03E0);
+        field_init(&fb, 0x001F);
+    }
+
+    size_t stride = (((size_t)w * bits + 31) / 32) * 4, need = ((size_t)w * bits + 7) / 8;
+    row = (uint8_t*)malloc(stride);
+    img->y = (uint8_t*)malloc((size_t)w * height);
+    if (!row || !img->y || fseek(f, (long)off, SEEK_SET) != 0) goto out;
+    for (int r = 0; r < height; ++r) {
+        if (fread(row, 1, stride, f) < need) goto out;   // the last row may lack its padding
+        uint8_t *dst = img->y + (size_t)(hh > 0 ? height - 1 - r : r) * w;
+        if (bits <= 8) {
+            unsigned mask = (1u << bits) - 1;
+            for (int x = 0; x < w; ++x) {
+                size_t bit = (size_t)x * bits;
+                dst[x] = lut[(row[bit / 8] >> (8 - bits - bit % 8)) & mask];
+            }
+        } else if (bits == 24 || (bits == 32 && comp == 0)) {
+            int ch = bits / 8;
+            for (int x = 0; x < w; ++x) dst[x] = luma(row[ch * x + 2], row[ch * x + 1], row[ch * x]);
+        } else {
+            for (int x = 0; x < w; ++x) {
+                uint32_t px = bits == 16 ? (uint32_t)row[2 * x] | (uint32_t)row[2 * x + 1] << 8 : u32le(&row[4 * x]);
+                dst[x] = luma(field_get(&fr, px), field_get(&fg, px), field_get(&fb, px));
+            }
+        }
+    }
+    img->width = w;
+    img->height = height;
+    rc = 0;
+out:
+    if (rc != 0) { free(img->y); img->y = NULL; }
+    free(row);
+    fclose(f);
+    return rc;
+}
+
+void lk_free(lk_image_t *img) {
+    free(img->y);
+    img->y = NULL;
+}
+
+// --- SSIM ---
+
+// s[0..4][g] += sums of a, b, a*a, b*b and a*b over pixels 4g..4g+3 of one
+// row, for groups 4-pixel groups. The vector loops do 16 pixels at a time.
+static void row_sums(const uint8_t *a, const uint8_t *b, size_t groups, uint32_t *s[5]) {
+    size_t g = 0;
+#if defined(__SSE2__)
+    // PMADDWD gives sums of pixel pairs; even + odd pairs make the groups.
+    const __m128i z = _mm_setzero_si128(), one = _mm_set1_epi16(1);
+    for (; g + 4 <= groups; g += 4) {
+        __m128i va = _mm_loadu_si128((const __m128i*)(a + 4 * g));
+        __m128i vb = _mm_loadu_si128((const __m128i*)(b + 4 * g));
+        __m128i al = _mm_unpacklo_epi8(va, z), ah = _mm_unpackhi_epi8(va, z);
+        __m128i bl = _mm_unpacklo_epi8(vb, z), bh = _mm_unpackhi_epi8(vb, z);
+        __m128i lo[5] = { _mm_madd_epi16(al, one), _mm_madd_epi16(bl, one), _mm_madd_epi16(al, al),
+                          _mm_madd_epi16(bl, bl), _mm_madd_epi16(al, bl) };
+        __m128i hi[5] = { _mm_madd_epi16(ah, one), _mm_madd_epi16(bh, one), _mm_madd_epi16(ah, ah),
+                          _mm_madd_epi16(bh, bh), _mm_madd_epi16(ah, bh) };
+        for (int k = 0; k < 5; ++k) {
+            __m128 l = _mm_castsi128_ps(lo[k]), h = _mm_castsi128_ps(hi[k]);
+            __m128i v = _mm_add_epi32(_mm_castps_si128(_mm_shuffle_ps(l, h, _MM_SHUFFLE(2, 0, 2, 0))),
+                                      _mm_castps_si128(_mm_shuffle_ps(l, h, _MM_SHUFFLE(3, 1, 3, 1))));
+            __m128i *d = (__m128i*)(s[k] + g);
+            _mm_storeu_si128(d, _mm_add_epi32(_mm_loadu_si128(d), v));
+        }
+    }
+#elif defined(__aarch64__)
+    // Pairwise widening adds: bytes -> pairs -> groups of four.
+    for (; g + 4 <= groups; g += 4) {
+        uint8x16_t va = vld1q_u8(a + 4 * g), vb = vld1q_u8(b + 4 * g);
+        uint32x4_t v[5] = {
+            vpaddlq_u16(vpaddlq_u8(va)),
+            vpaddlq_u16(vpaddlq_u8(vb)),
+            vpaddq_u32(vpaddlq_u16(vmull_u8(vget_low_u8(va), vget_low_u8(va))), vpaddlq_u16(vmull_high_u8(va, va))),
+            vpaddq_u32(vpaddlq_u16(vmull_u8(vget_low_u8(vb), vget_low_u8(vb))), vpaddlq_u16(vmull_high_u8(vb, vb))),
+            vpaddq_u32(vpaddlq_u16(vmull_u8(vget_low_u8(va), vget_low_u8(vb))), vpaddlq_u16(vmull_high_u8(va, vb))),
+        };
+        for (int k = 0; k < 5; ++k) vst1q_u32(s[k] + g, vaddq_u32(vld1q_u32(s[k] + g), v[k]));
+    }
+#endif
+    for (; g < groups; ++g) {
+        for (size_t i = 4 * g; i < 4 * g + 4; ++i) {
+            uint32_t p = a[i], q = b[i];
+            s[0][g] += p; s[1][g] += q; s[2][g] += p * p; s[3][g] += q * q; s[4][g] += p * q;
+        }
+    }
+}
+
+// Sums of the 4x4 blocks in block row by.
+static void block_row(const lk_image_t *a, const lk_image_t *b, int by, size_t bw, uint32_t *s[5]) {
+    for (int k = 0; k < 5; ++k) memset(s[k], 0, bw * sizeof(uint32_t));
+    for (int r = 0; r < 4; ++r) {
+        size_t o = (size_t)(4 * by + r) * (size_t)a->width;
+        row_sums(a->y + o, b->y + o, bw, s);
+    }
+}
+
+// SSIM of one window of n pixels from its sums (Wang et al., K1 0.01, K2 0.03).
+static double ssim_window(double sa, double sb, double saa, double sbb, double sab, double n) {
+    double c1 = 6.5025 * n * n, c2 = 58.5225 * n * n;
+    return ((2 * sa * sb + c1) * (2 * (n * sab - sa * sb) + c2)) /
+           ((sa * sa + sb * sb + c1) * (n * (saa + sbb) - sa * sa - sb * sb + c2));
+}
+
+typedef struct {
+    const lk_image_t *a, *b;
+    int r0, r1;             // window rows; window row r spans block rows r and r + 1
+    size_t bw;
+    double sum;
+    int ok;
+} ssim_part_t;
+
+static void *ssim_part(void *arg) {
+    ssim_part_t *p = (ssim_part_t*)arg;
+    uint32_t *buf = (uint32_t*)malloc(10 * p->bw * sizeof(uint32_t));
+    if (!buf) return NULL;
+    uint32_t *prev[5], *cur[5];
+    for (int k = 0; k < 5; ++k) { prev[k] = buf + k * p->bw; cur[k] = buf + (5 + k) * p->bw; }
+    block_row(p->a, p->b, p->r0, p->bw, prev);
+    for (int r = p->r0; r < p->r1; ++r) {
+        block_row(p->a, p->b, r + 1, p->bw, cur);
+        for (size_t x = 0; x + 1 < p->bw; ++x) {
+            double v[5];
+            for (int k = 0; k < 5; ++k)
+                v[k] = (double)prev[k][x] + prev[k][x + 1] + cur[k][x] + cur[k][x + 1];
+            p->sum += ssim_window(v[0], v[1], v[2], v[3], v[4], 64);
+        }
+        for (int k = 0; k < 5; ++k) { uint32_t *t = prev[k]; prev[k] = cur[k]; cur[k] = t; }
+    }
+    free(buf);
+    p->ok = 1;
+    return NULL;
+}
+
+int lk_ssim(const lk_image_t *a, const lk_image_t *b, int threads, double *ssim) {
+    if (a->width != b->width || a->height != b->height) return -1;
+    size_t bw = (size_t)a->width / 4;
+    int bh = a->height / 4;
+    if (bw < 2 || bh < 2) {
+        // Smaller than one window: the whole image is the window.
+        double s[5] = { 0 }, n = (double)a->width * a->height;
+        for (size_t i = 0; i < (size_t)a->width * a->height; ++i) {
+            double p = a->y[i], q = b->y[i];
+            s[0] += p; s[1] += q; s[2] += p * p; s[3] += q * q; s[4] += p * q;
+        }
+        *ssim = ssim_window(s[0], s[1], s[2], s[3], s[4], n);
+        return 0;
+    }
+    int rows = bh - 1;
+    if (threads > LK_MAX_THREADS) threads = LK_MAX_THREADS;
+    if (threads > rows) threads = rows;
+    if (threads < 1) threads = 1;
+    ssim_part_t parts[LK_MAX_THREADS];
+    pthread_t tids[LK_MAX_THREADS];
+    int started[LK_MAX_THREADS] = { 0 };
+    for (int t = 0; t < threads; ++t) {
+        parts[t] = (ssim_part_t){ a, b, (int)((int64_t)rows * t / threads),
+                                  (int)((int64_t)rows * (t + 1) / threads), bw, 0, 0 };
+        if (t > 0) started[t] = pthread_create(&tids[t], NULL, ssim_part, &parts[t]) == 0;
+    }
+    double sum = 0;
+    int ok = 1;
+    for (int t = 0; t < threads; ++t) {
+        if (started[t]) pthread_join(tids[t], NULL);
+        else ssim_part(&parts[t]);
+        ok &= parts[t].ok;
+        sum += parts[t].sum;
+    }
+    if (!ok) return -1;
+    *ssim = sum / ((double)rows * (double)(bw - 1));
+    return 0;
+}
+
+// --- Perceptual hash ---
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+uint64_t lk_phash(const lk_image_t *img) {
+    // Box average to 32x32; an image smaller than that repeats its pixels.
+    double m[32][32];
+    int w = img->width, h = img->height;
+    for (int cy = 0; cy < 32; ++cy) {
+        int y0 = (int)((int64_t)cy * h / 32), y1 = (int)((int64_t)(cy + 1) * h / 32);
+        if (y1 <= y0) y1 = y0 + 1;
+        for (int cx = 0; cx < 32; ++cx) {
+            int x0 = (int)((int64_t)cx * w / 32), x1 = (int)((int64_t)(cx + 1) * w / 32);
+            if (x1 <= x0) x1 = x0 + 1;
+            uint64_t acc = 0;
+            for (int y = y0; y < y1; ++y) {
+                const uint8_t *row = img->y + (size_t)y * w;
+                for (int x = x0; x < x1; ++x) acc += row[x];
+            }
+            m[cy][cx] = (double)acc / ((double)(y1 - y0) * (x1 - x0));
+        }
+    }
+    // DCT-II, frequencies 1..8 in each direction (no DC row or column).
+    double c[8][32], t[8][32], d[64], sorted[64];
+    for (int u = 0; u < 8; ++u)
+        for (int x = 0; x < 32; ++x) c[u][x] = cos(3.14159265358979323846 * (2 * x + 1) * (u + 1) / 64);
+    for (int u = 0; u < 8; ++u)
+        for (int x = 0; x < 32; ++x) {
+            t[u][x] = 0;
+            for (int y = 0; y < 32; ++y) t[u][x] += c[u][y] * m[y][x];
+        }
+    for (int u = 0; u < 8; ++u)
+        for (int v = 0; v < 8; ++v) {
+            d[8 * u + v] = 0;
+            for (int x = 0; x < 32; ++x) d[8 * u + v] += c[v][x] * t[u][x];
+        }
+    memcpy(sorted, d, sizeof(d));
+    qsort(sorted, 64, sizeof(double), cmp_double);
+    double median = (sorted[31] + sorted[32]) / 2;
+    uint64_t hash = 0;
+    for (int i = 0; i < 64; ++i) hash |= (uint64_t)(d[i] > median) << i;
+    return hash;
+}
+
+int lk_distance(uint64_t h1, uint64_t h2) {
+    int n = 0;
+    for (uint64_t x = h1 ^ h2; x; x &= x - 1) n++;
+    return n <= 32 ? n : 64 - n;
+}
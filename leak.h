@@ -0,0 +1,51 @@
+#ifndef LEAK_H
+#define LEAK_H
+
+// Perceptual leakage: how recognizable a plaintext BMP still is in its
+// ciphertext. Both images are reduced to 8-bit luma through their own header
+// and palette (the cipher leaves those alone, so a ciphertext decodes exactly
+// like its plaintext) and compared two ways:
+//
+// SSIM over 8x8 windows stepped by 4 pixels, from the sums of 4x4 blocks,
+// averaged over the image: 1 = same structure, near 0 = none left. Pixels past
+// the last whole 4x4 block are not compared.
+//
+// A DCT perceptual hash: luma box-averaged to 32x32, the 8x8 lowest
+// frequencies after DC compared with their median give 64 bits. The Hamming
+// distance between the two hashes is 0 for the same picture and near 32 for
+// unrelated ones. ECB can turn bright areas dark, and a negative still shows
+// the picture, so the inverted hash counts as well (distances stay <= 32). Up
+// to LK_PHASH_MATCH the ciphertext still looks like the plaintext.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LK_PHASH_MATCH 10
+
+typedef struct {
+    uint8_t *y;             // luma, top row first, width bytes per row
+    int width, height;
+} lk_image_t;
+
+// Decode the BMP at path (1-32 bits, palette or BI_RGB/BI_BITFIELDS) to luma.
+// Returns 0, or -1 if the file can't be read or is not a supported BMP.
+int lk_load(const char *path, lk_image_t *img);
+void lk_free(lk_image_t *img);
+
+// Mean SSIM of two images of the same size, using up to threads threads.
+// Returns 0, or -1 if the sizes differ or memory runs out.
+int lk_ssim(const lk_image_t *a, const lk_image_t *b, int threads, double *ssim);
+
+uint64_t lk_phash(const lk_image_t *img);
+// Bits that differ between h1 and h2 or its inverse, whichever is fewer (0..32).
+int lk_distance(uint64_t h1, uint64_t h2);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LEAK_H
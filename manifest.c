@@ -0,0 +1,365 @@
+#define _GNU_SOURCE
+#include "manifest.h"
+#include "jobq.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Just enough JSON for flat objects: string, number, true/false/null values.
+typedef enum { JV_STR, JV_NUM, JV_TRUE, JV_FALSE, JV_NULL } jv_type_t;
+
+typedef struct {
+    char *key;
+    jv_type_t type;
+    char *str;
+    double num;
+} jv_t;
+
+#define MF_MAX_FIELDS 32
+
+static void skip_ws(const char **p) {
+    while (**p == ' ' || **p == '\t' || **p == '\r' || **p == '\n') (*p)++;
+}
+
+static int hex4(const char *s, unsigned *v) {
+    *v = 0;
+    for (int i = 0; i < 4; ++i) {
+        char c = s[i];
+        unsigned d = c >= '0' && c <= '9' ? (unsigned)(c - '0') :
+                     c >= 'a' && c <= 'f' ? (unsigned)(c - 'a' + 10) :
+                     c >= 'A' && c <= 'F' ? (unsigned)(c - 'A' + 10) : 16u;
+        if (d == 16) return -1;
+        *v = *v << 4 | d;
+    }
+    return 0;
+}
+
+static void put_utf8(char **o, unsigned c) {
+    char *p = *o;
+    if (c < 0x80) {
+        *p++ = (char)c;
+    } else if (c < 0x800) {
+        *p++ = (char)(0xC0 | c >> 6);
+        *p++ = (char)(0x80 | (c & 0x3F));
+    } else if (c < 0x10000) {
+        *p++ = (char)(0xE0 | c >> 12);
+        *p++ = (char)(0x80 | ((c >> 6) & 0x3F));
+        *p++ = (char)(0x80 | (c & 0x3F));
+    } else {
+        *p++ = (char)(0xF0 | c >> 18);
+        *p++ = (char)(0x80 | ((c >> 12) & 0x3F));
+        *p++ = (char)(0x80 | ((c >> 6) & 0x3F));
+        *p++ = (char)(0x80 | (c & 0x3F));
+    }
+    *o = p;
+}
+
+// String at *p (on the opening quote), decoded into a new buffer; NULL if
+// malformed. Escapes never decode to more bytes than they take.
+static char *parse_string(const char **p) {
+    const char *s = *p + 1;
+    char *out = (char*)malloc(strlen(s) + 1), *o = out;
+    if (!out) return NULL;
+    while (*s && *s != '"') {
+        unsigned char c = (unsigned char)*s++;
+        if (c < 0x20) goto bad;
+        if (c != '\\') { *o++ = (char)c; continue; }
+        unsigned cp, lo;
+        switch (*s++) {
+        case '"': *o++ = '"'; break;
+        case '\\': *o++ = '\\'; break;
+        case '/': *o++ = '/'; break;
+        case 'b': *o++ = '\b'; break;
+        case 'f': *o++ = '\f'; break;
+        case 'n': *o++ = '\n'; break;
+        case 'r': *o++ = '\r'; break;
+        case 't': *o++ = '\t'; break;
+        case 'u':
+            if (hex4(s, &cp) != 0 || cp == 0) goto bad;
+            s += 4;
+            if (cp >= 0xD800 && cp < 0xDC00 && s[0] == '\\' && s[1] == 'u' &&
+                hex4(s + 2, &lo) == 0 && lo >= 0xDC00 && lo < 0xE000) {
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                s += 6;
+            }
+            put_utf8(&o, cp);
+            break;
+        default:
+            goto bad;
+        }
+    }
+    if (*s != '"') goto bad;
+    *o = '\0';
+    *p = s + 1;
+    return out;
+bad:
+    free(out);
+    return NULL;
+}
+
+static int parse_value(const char **p, jv_t *v) {
+    const char *s = *p;
+    v->str = NULL;
+    if (*s == '"') {
+        v->type = JV_STR;
+        return (v->str = parse_string(p)) ? 0 : -1;
+    }
+    if (strncmp(s, "true", 4) == 0) { v->type = JV_TRUE; *p = s + 4; return 0; }
+    if (strncmp(s, "false", 5) == 0) { v->type = JV_FALSE; *p = s + 5; return 0; }
+    if (strncmp(s, "null", 4) == 0) { v->type = JV_NULL; *p = s + 4; return 0; }
+    if (*s != '-' && (*s < '0' || *s > '9')) return -1;
+    char *end;
+    v->type = JV_NUM;
+    v->num = strtod(s, &end);
+    *p = end;
+    return 0;
+}
+
+static void free_fields(jv_t *f, int n) {
+    for (int i = 0; i < n; ++i) { free(f[i].key); free(f[i].str); }
+}
+
+// Parse one object into f. Returns the field count, or -1 with msg set.
+static int parse_object(const char *s, jv_t *f, const char **msg) {
+    int n = 0;
+    skip_ws(&s);
+    if (*s++ != '{') { *msg = "expected a JSON object"; return -1; }
+    skip_ws(&s);
+    if (*s == '}') { s++; goto end; }
+    for (;;) {
+        if (n == MF_MAX_FIELDS) { *msg = "too many fields"; goto bad; }
+        if (*s != '"' || !(f[n].key = parse_string(&s))) { *msg = "expected a field name"; goto bad; }
+        f[n].str = NULL;
+        for (int k = 0; k < n; ++k)
+            if (strcmp(f[k].key, f[n].key) == 0) { n++; *msg = "duplicate field"; goto bad; }
+        skip_ws(&s);
+        if (*s++ != ':') { n++; *msg = "expected ':'"; goto bad; }
+        skip_ws(&s);
+        if (parse_value(&s, &f[n++]) != 0) { *msg = "bad value"; goto bad; }
+        skip_ws(&s);
+        if (*s == ',') { s++; skip_ws(&s); continue; }
+        if (*s++ == '}') break;
+        *msg = "expected ',' or '}'";
+        goto bad;
+    }
+end:
+    skip_ws(&s);
+    if (*s) { *msg = "text after the object"; goto bad; }
+    return n;
+bad:
+    free_fields(f, n);
+    return -1;
+}
+
+static int as_uint(const jv_t *v, uint64_t max, uint64_t *out) {
+    if (v->type != JV_NUM || v->num < 0 || v->num > (double)max || v->num != (double)(uint64_t)v->num) return -1;
+    *out = (uint64_t)v->num;
+    return 0;
+}
+
+// "A" or "A:B" of decimal integers; B must be > 0 when present.
+static int parse_pair(const char *s, uint64_t *a, uint64_t *b, int need_b) {
+    char *end;
+    if (*s < '0' || *s > '9') return -1;
+    *a = strtoull(s, &end, 10);
+    *b = 0;
+    if (*end == ':') {
+        if (end[1] < '0' || end[1] > '9') return -1;
+        *b = strtoull(end + 1, &end, 10);
+        if (*b == 0) return -1;
+    } else if (need_b) {
+        return -1;
+    }
+    return *end ? -1 : 0;
+}
+
+// Fill j from the fields; msg names the first problem (possibly in buf).
+static int apply_fields(jv_t *f, int n, mf_job_t *j, const char **msg, char *buf, size_t cap) {
+    int have_dir = 0, have_key = 0, have_mode = 0, have_iv = 0;
+    uint64_t v, w;
+    for (int i = 0; i < n; ++i) {
+        const char *k = f[i].key;
+        const char *s = f[i].type == JV_STR ? f[i].str : NULL;
+        if (strcmp(k, "in") == 0 || strcmp(k, "out") == 0 || strcmp(k, "id") == 0) {
+            if (!s || !*s) { *msg = "\"in\", \"out\" and \"id\" must be non-empty strings"; return -1; }
+            char **dst = strcmp(k, "in") == 0 ? &j->in : strcmp(k, "out") == 0 ? &j->out : &j->id;
+            *dst = f[i].str;
+            f[i].str = NULL;
+        } else if (strcmp(k, "direction") == 0) {
+            if (!s || (strcmp(s, "encrypt") != 0 && strcmp(s, "decrypt") != 0)) {
+                *msg = "\"direction\" must be \"encrypt\" or \"decrypt\""; return -1;
+            }
+            j->encrypt = s[0] == 'e';
+            have_dir = 1;
+        } else if (strcmp(k, "key") == 0) {
+            if (!s || strlen(s) != 10 || strspn(s, "01") != 10 || sdes_parse_key10_bits(s, &j->key10) != 0) {
+                *msg = "\"key\" must be 10 bits, e.g. \"1010000010\""; return -1;
+            }
+            have_key = 1;
+        } else if (strcmp(k, "mode") == 0) {
+            static const char *names[SDES_MODE_COUNT] = {"ECB", "CBC", "CTR", "ICBC"};
+            int m = 0;
+            while (s && m < SDES_MODE_COUNT && strcasecmp(s, names[m]) != 0) m++;
+            if (!s || m == SDES_MODE_COUNT) { *msg = "\"mode\" must be ECB, CBC, CTR or ICBC"; return -1; }
+            j->mode = (sdes_mode_t)m;
+            have_mode = 1;
+        } else if (strcmp(k, "iv") == 0) {
+            char *end = NULL;
+            if (s) v = strtoull(s, &end, 0);
+            if (s ? (!*s || *end || v > 255) : as_uint(&f[i], 255, &v) != 0) {
+                *msg = "\"iv\" must be 0-255"; return -1;
+            }
+            j->iv = (uint8_t)v;
+            have_iv = 1;
+        } else if (strcmp(k, "lanes") == 0) {
+            if (as_uint(&f[i], 64, &v) != 0 || (v != 16 && v != 32 && v != 64)) {
+                *msg = "\"lanes\" must be 16, 32 or 64"; return -1;
+            }
+            j->lanes = (int)v;
+        } else if (strcmp(k, "raw") == 0) {
+            if (f[i].type == JV_TRUE || f[i].type == JV_FALSE) {
+                j->raw = f[i].type == JV_TRUE;
+            } else if (!s || parse_pair(s, &j->raw_offset, &j->raw_length, 0) != 0) {
+                *msg = "\"raw\" must be true or \"OFFSET[:LENGTH]\""; return -1;
+            } else {
+                j->raw = 1;
+            }
+        } else if (strcmp(k, "rows") == 0) {
+            if (!s || parse_pair(s, &v, &w, 1) != 0 || v > UINT32_MAX || w > UINT32_MAX) {
+                *msg = "\"rows\" must be \"FIRST:COUNT\" with COUNT > 0"; return -1;
+            }
+            j->row_first = (uint32_t)v;
+            j->row_count = (uint32_t)w;
+        } else if (strcmp(k, "align") == 0) {
+            if (as_uint(&f[i], 1u << 20, &v) != 0 || v < 4 || (v & (v - 1))) {
+                *msg = "\"align\" must be a power of two from 4 to 1048576"; return -1;
+            }
+            j->align = (uint32_t)v;
+        } else if (strcmp(k, "class") == 0) {
+            if (s && strcmp(s, "interactive") == 0) j->cls = JOBQ_INTERACTIVE;
+            else if (s && strcmp(s, "bulk") == 0) j->cls = JOBQ_BULK;
+            else if (s && strcmp(s, "auto") == 0) j->cls = -1;
+            else { *msg = "\"class\" must be interactive, bulk or auto"; return -1; }
+        } else if (strcmp(k, "deadline_ms") == 0) {
+            if (as_uint(&f[i], UINT32_MAX, &j->deadline_ms) != 0) { *msg = "\"deadline_ms\" must be a number"; return -1; }
+        } else {
+            snprintf(buf, cap, "unknown field \"%.64s\"", k);
+            *msg = buf;
+            return -1;
+        }
+    }
+    if (!j->in || !j->out || !have_dir || !have_key || !have_mode) {
+        *msg = "\"in\", \"out\", \"direction\", \"key\" and \"mode\" are required"; return -1;
+    }
+    if (j->mode != MODE_ECB && !have_iv) { *msg = "\"iv\" is required for CBC, CTR and ICBC"; return -1; }
+    if (j->lanes && j->mode != MODE_ICBC) { *msg = "\"lanes\" only applies to ICBC"; return -1; }
+    if (j->lanes && !j->encrypt && !j->raw) { *msg = "ICBC decryption reads \"lanes\" from the BMP header"; return -1; }
+    if (j->mode == MODE_ICBC && !j->encrypt && j->raw && !j->lanes) {
+        *msg = "raw ICBC decryption needs \"lanes\""; return -1;
+    }
+    if ((j->raw != 0) + (j->row_count != 0) + (j->align != 0) > 1) {
+        *msg = "\"raw\", \"rows\" and \"align\" cannot be combined"; return -1;
+    }
+    if (strcmp(j->in, j->out) == 0) { *msg = "\"out\" would overwrite \"in\""; return -1; }
+    struct stat sb;
+    if (stat(j->in, &sb) != 0 || !S_ISREG(sb.st_mode) || access(j->in, R_OK) != 0) {
+        *msg = "input is not a readable file"; return -1;
+    }
+    return 0;
+}
+
+static void free_job(mf_job_t *j) {
+    free(j->in);
+    free(j->out);
+    free(j->id);
+}
+
+static int cmp_out(const void *a, const void *b) {
+    const mf_job_t *x = *(const mf_job_t* const*)a, *y = *(const mf_job_t* const*)b;
+    int c = strcmp(x->out, y->out);
+    return c ? c : (x->line > y->line) - (x->line < y->line);
+}
+
+int manifest_load(const char *path, manifest_t *m) {
+    memset(m, 0, sizeof(*m));
+    FILE *f = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (!f) return -1;
+    char *line = NULL;
+    size_t cap = 0, lineno = 0, jcap = 0;
+    int bad = 0;
+    jv_t fields[MF_MAX_FIELDS];
+    char msgbuf[128];
+    while (getline(&line, &cap, f) >= 0) {
+        lineno++;
+        const char *s = line, *msg = NULL;
+        skip_ws(&s);
+        if (!*s) continue;
+        mf_job_t j;
+        memset(&j, 0, sizeof(j));
+        j.line = lineno;
+        j.cls = -1;
+        int n = parse_object(s, fields, &msg);
+        int rc = n < 0 ? -1 : apply_fields(fields, n, &j, &msg, msgbuf, sizeof(msgbuf));
+        if (n >= 0) free_fields(fields, n);
+        if (rc == 0 && m->count == jcap) {
+            size_t nc = jcap ? jcap * 2 : 64;
+            mf_job_t *nj = (mf_job_t*)realloc(m->jobs, nc * sizeof(*nj));
+            if (nj) { m->jobs = nj; jcap = nc; }
+            else { msg = "out of memory"; rc = -1; }
+        }
+        if (rc != 0) {
+            fprintf(stderr, "%s:%zu: %s\n", path, lineno, msg);
+            free_job(&j);
+            bad++;
+            continue;
+        }
+        m->jobs[m->count++] = j;
+    }
+    free(line);
+    if (ferror(f)) { perror(path); bad++; }
+    if (f != stdin) fclose(f);
+
+    // Two jobs writing one file would race.
+    mf_job_t **by_out = m->count ? (mf_job_t**)malloc(m->count * sizeof(*by_out)) : NULL;
+    if (m->count && !by_out) { fprintf(stderr, "OOM\n"); return bad + 1; }
+    for (size_t i = 0; i < m->count; ++i) by_out[i] = &m->jobs[i];
+    if (m->count) qsort(by_out, m->count, sizeof(*by_out), cmp_out);
+    for (size_t i = 1; i < m->count; ++i) {
+        if (strcmp(by_out[i]->out, by_out[i - 1]->out) == 0) {
+            fprintf(stderr, "%s:%zu: \"out\" is also written by line %zu\n", path, by_out[i]->line, by_out[i - 1]->line);
+            bad++;
+        }
+    }
+    free(by_out);
+    return bad;
+}
+
+void manifest_free(manifest_t *m) {
+    for (size_t i = 0; i < m->count; ++i) free_job(&m->jobs[i]);
+    free(m->jobs);
+    memset(m, 0, sizeof(*m));
+}
+
+static void put_json_string(FILE *f, const char *s) {
+    fputc('"', f);
+    for (; *s; ++s) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') fprintf(f, "\\%c", c);
+        else if (c < 0x20) fprintf(f, "\\u%04x", c);
+        else fputc(c, f);
+    }
+    fputc('"', f);
+}
+
+void manifest_log(FILE *f, const mf_job_t *j, int ok, double wait_ms, double run_ms, uint64_t bytes) {
+    fprintf(f, "{\"line\":%zu,", j->line);
+    if (j->id) { fputs("\"id\":", f); put_json_string(f, j->id); fputc(',', f); }
+    fputs("\"in\":", f);
+    put_json_string(f, j->in);
+    fputs(",\"out\":", f);
+    put_json_string(f, j->out);
+    fprintf(f, ",\"status\":\"%s\",\"wait_ms\":%.3f,\"run_ms\":%.3f,\"bytes\":%llu}\n",
+            ok ? "ok" : "failed", wait_ms, run_ms, (unsigned long long)bytes);
+}
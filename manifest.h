@@ -0,0 +1,64 @@
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+// Job manifests: one JSON object per line, each a complete job with its own
+// key, mode and options. Blank lines are skipped. Fields:
+//
+//   "in", "out"       paths (required; outputs must be distinct)
+//   "direction"       "encrypt" or "decrypt" (required)
+//   "key"             10 key bits as a string, e.g. "1010000010" (required)
+//   "mode"            "ECB", "CBC", "CTR" or "ICBC" (required)
+//   "iv"              0-255, as a number or "0x.." string (required but for ECB)
+//   "lanes"           ICBC lanes 16/32/64 (encryption, and decryption with raw)
+//   "raw"             true, or "OFFSET[:LENGTH]" in bytes: as --raw
+//   "rows"            "FIRST:COUNT": as --rows
+//   "align"           as --align, in bytes
+//   "class"           "interactive", "bulk" or "auto" (default)
+//   "deadline_ms"     deadline of an interactive job
+//   "id"              label for the result log (default: the line number)
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sdes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    size_t line;
+    char *in, *out, *id;
+    int encrypt;
+    uint16_t key10;
+    sdes_mode_t mode;
+    uint8_t iv;
+    int lanes;              // 0 = default (encryption) or from the header
+    int raw;
+    uint64_t raw_offset, raw_length;
+    uint32_t row_first, row_count;
+    uint32_t align;
+    int cls;                // jobq_class_t, or -1 = by input size
+    uint64_t deadline_ms;
+} mf_job_t;
+
+typedef struct {
+    mf_job_t *jobs;
+    size_t count;
+} manifest_t;
+
+// Parse and validate the whole manifest ("-" = stdin) before anything runs:
+// syntax, fields, option combinations, readable inputs, duplicate outputs.
+// Every problem is reported as "PATH:LINE: message". Returns the number of
+// bad lines, so 0 means m holds every job; -1 if the file can't be read.
+int manifest_load(const char *path, manifest_t *m);
+void manifest_free(manifest_t *m);
+
+// One result log line (JSON) for a finished job.
+void manifest_log(FILE *f, const mf_job_t *j, int ok, double wait_ms, double run_ms, uint64_t bytes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MANIFEST_H
@@ -0,0 +1,203 @@
+#include "pack.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define PACK_BUFFER (4 << 20)
+#define FOOTER_SIZE 24
+#define ENTRY_FIXED 24
+
+static const char MAGIC[4] = {'B','M','P','K'};
+static const char FOOTER_MAGIC[8] = {'B','M','P','K','I','D','X','1'};
+
+static void put16(unsigned char *p, uint16_t v) { p[0] = (unsigned char)v; p[1] = (unsigned char)(v >> 8); }
+static void put32(unsigned char *p, uint32_t v) { for (int i = 0; i < 4; ++i) p[i] = (unsigned char)(v >> (8 * i)); }
+static void put64(unsigned char *p, uint64_t v) { for (int i = 0; i < 8; ++i) p[i] = (unsigned char)(v >> (8 * i)); }
+static uint16_t get16(const unsigned char *p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+static uint32_t get32(const unsigned char *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+static uint64_t get64(const unsigned char *p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; --i) v = (v << 8) | p[i];
+    return v;
+}
+
+static uint32_t name_hash(const char *s) {
+    uint32_t h = 2166136261u;
+    while (*s) h = (h ^ (unsigned char)*s++) * 16777619u;
+    return h;
+}
+
+// Slot of name in w->slots: the one holding it, or the empty one to put it in.
+static size_t find_slot(const pack_writer_t *w, const char *name) {
+    size_t i = name_hash(name) & (w->nslots - 1);
+    while (w->slots[i] && strcmp(w->entries[w->slots[i] - 1].name, name) != 0)
+        i = (i + 1) & (w->nslots - 1);
+    return i;
+}
+
+// Keep the table at most half full.
+static int grow_slots(pack_writer_t *w) {
+    if (2 * (w->count + 1) <= w->nslots) return 0;
+    pack_writer_t old = *w;
+    w->nslots = old.nslots ? old.nslots * 2 : 512;
+    w->slots = (uint32_t*)calloc(w->nslots, sizeof(*w->slots));
+    if (!w->slots) { *w = old; return -1; }
+    for (size_t i = 0; i < w->count; ++i) w->slots[find_slot(w, w->entries[i].name)] = (uint32_t)(i + 1);
+    free(old.slots);
+    return 0;
+}
+
+static int cmp_entry(const void *a, const void *b) {
+    return strcmp(((const pack_entry_t*)a)->name, ((const pack_entry_t*)b)->name);
+}
+
+int pack_create(pack_writer_t *w, const char *path) {
+    memset(w, 0, sizeof(*w));
+    w->f = fopen(path, "wb");
+    if (!w->f) return -1;
+    setvbuf(w->f, NULL, _IOFBF, PACK_BUFFER);
+    io_wb_init(&w->wb, fileno(w->f));
+    w->wb.window = PACK_WB_WINDOW;
+    unsigned char h[8];
+    memcpy(h, MAGIC, 4);
+    put32(h + 4, PACK_VERSION);
+    return fwrite(h, 1, sizeof(h), w->f) == sizeof(h) ? 0 : -1;
+}
+
+int pack_add(pack_writer_t *w, const char *name, uint64_t offset, uint64_t length,
+             uint8_t mode, uint8_t iv, uint8_t encrypted, uint8_t lanes) {
+    if (strlen(name) > 0xFFFF || w->count >= UINT32_MAX - 1 || grow_slots(w) != 0) return -1;
+    size_t slot = find_slot(w, name);
+    if (w->slots[slot]) return -2;
+    if (w->count == w->cap) {
+        size_t cap = w->cap ? w->cap * 2 : 256;
+        pack_entry_t *e = (pack_entry_t*)realloc(w->entries, cap * sizeof(*e));
+        if (!e) return -1;
+        w->entries = e;
+        w->cap = cap;
+    }
+    pack_entry_t *e = &w->entries[w->count];
+    e->name = strdup(name);
+    if (!e->name) return -1;
+    e->offset = offset;
+    e->length = length;
+    e->mode = mode;
+    e->iv = iv;
+    e->encrypted = encrypted;
+    e->lanes = lanes;
+    w->slots[slot] = (uint32_t)++w->count;
+    off_t end = (off_t)(offset + length);
+    if (end - w->wb.started >= w->wb.window && fflush(w->f) == 0) io_wb_advance(&w->wb, end);
+    return 0;
+}
+
+int pack_finish(pack_writer_t *w, int durable) {
+    int rc = 0;
+    qsort(w->entries, w->count, sizeof(*w->entries), cmp_entry);
+    off_t index_off = ftello(w->f);
+    for (size_t i = 0; i < w->count && rc == 0; ++i) {
+        const pack_entry_t *e = &w->entries[i];
+        unsigned char fixed[ENTRY_FIXED] = {0};
+        size_t len = strlen(e->name);
+        put16(fixed, (uint16_t)len);
+        fixed[2] = e->mode;
+        fixed[3] = e->iv;
+        fixed[4] = e->encrypted;
+        fixed[5] = e->lanes;
+        put64(fixed + 8, e->offset);
+        put64(fixed + 16, e->length);
+        if (fwrite(fixed, 1, sizeof(fixed), w->f) != sizeof(fixed) ||
+            fwrite(e->name, 1, len, w->f) != len) rc = -1;
+    }
+    unsigned char foot[FOOTER_SIZE];
+    put64(foot, (uint64_t)index_off);
+    put64(foot + 8, w->count);
+    memcpy(foot + 16, FOOTER_MAGIC, 8);
+    if (rc == 0 && fwrite(foot, 1, sizeof(foot), w->f) != sizeof(foot)) rc = -1;
+    if (fflush(w->f) != 0) rc = -1;
+    else io_wb_finish(&w->wb, ftello(w->f));
+    // A member that failed mid-write may have left bytes past the footer.
+    if (rc == 0 && ftruncate(fileno(w->f), ftello(w->f)) != 0) rc = -1;
+    if (rc == 0 && durable && fsync(fileno(w->f)) != 0) rc = -1;
+    if (fclose(w->f) != 0) rc = -1;
+    for (size_t i = 0; i < w->count; ++i) free(w->entries[i].name);
+    free(w->entries);
+    free(w->slots);
+    memset(w, 0, sizeof(*w));
+    return rc;
+}
+
+int pack_open(pack_reader_t *r, const char *path) {
+    memset(r, 0, sizeof(*r));
+    r->fd = open(path, O_RDONLY);
+    if (r->fd < 0) return -1;
+    struct stat sb;
+    unsigned char h[8], foot[FOOTER_SIZE];
+    if (fstat(r->fd, &sb) != 0 || sb.st_size < 8 + FOOTER_SIZE ||
+        pread(r->fd, h, 8, 0) != 8 || memcmp(h, MAGIC, 4) != 0 || get32(h + 4) != PACK_VERSION ||
+        pread(r->fd, foot, FOOTER_SIZE, sb.st_size - FOOTER_SIZE) != FOOTER_SIZE ||
+        memcmp(foot + 16, FOOTER_MAGIC, 8) != 0) {
+        pack_close(r);
+        return -2;
+    }
+    uint64_t index_off = get64(foot), count = get64(foot + 8);
+    uint64_t index_len = (uint64_t)sb.st_size - FOOTER_SIZE - index_off;
+    if (index_off < 8 || index_off > (uint64_t)sb.st_size - FOOTER_SIZE || count > index_len / ENTRY_FIXED) {
+        pack_close(r);
+        return -2;
+    }
+    unsigned char *idx = (unsigned char*)malloc(index_len ? index_len : 1);
+    r->entries = (pack_entry_t*)calloc(count ? count : 1, sizeof(*r->entries));
+    if (!idx || !r->entries || pread(r->fd, idx, index_len, (off_t)index_off) != (ssize_t)index_len) {
+        free(idx);
+        pack_close(r);
+        return -1;
+    }
+    size_t p = 0;
+    for (uint64_t i = 0; i < count; ++i) {
+        if (p + ENTRY_FIXED > index_len) break;
+        size_t len = get16(idx + p);
+        if (p + ENTRY_FIXED + len > index_len) break;
+        pack_entry_t *e = &r->entries[r->count];
+        e->mode = idx[p + 2];
+        e->iv = idx[p + 3];
+        e->encrypted = idx[p + 4];
+        e->lanes = idx[p + 5];
+        e->offset = get64(idx + p + 8);
+        e->length = get64(idx + p + 16);
+        e->name = (char*)malloc(len + 1);
+        if (!e->name) break;
+        memcpy(e->name, idx + p + ENTRY_FIXED, len);
+        e->name[len] = '\0';
+        r->count++;
+        p += ENTRY_FIXED + len;
+    }
+    free(idx);
+    if (r->count != count) { pack_close(r); return -2; }
+    return 0;
+}
+
+const pack_entry_t *pack_find(const pack_reader_t *r, const char *name) {
+    pack_entry_t key;
+    key.name = (char*)name;
+    return (const pack_entry_t*)bsearch(&key, r->entries, r->count, sizeof(*r->entries), cmp_entry);
+}
+
+ssize_t pack_read(const pack_reader_t *r, const pack_entry_t *e, void *buf, size_t n, uint64_t off) {
+    if (off >= e->length) return 0;
+    if (n > e->length - off) n = (size_t)(e->length - off);
+    return pread(r->fd, buf, n, (off_t)(e->offset + off));
+}
+
+void pack_close(pack_reader_t *r) {
+    for (size_t i = 0; i < r->count; ++i) free(r->entries[i].name);
+    free(r->entries);
+    if (r->fd >= 0) close(r->fd);
+    r->entries = NULL;
+    r->count = 0;
+    r->fd = -1;
+}
@@ -0,0 +1,75 @@
+#ifndef PACK_H
+#define PACK_H
+
+// Pack file: many encrypted images appended into one large file, followed by
+// an index. Layout (all integers little endian):
+//
+//   "BMPK" u32 version
+//   member data ...
+//   index: per member  u16 name_len, u8 mode, u8 iv, u8 encrypted, u8 lanes,
+//                      2 x u8 0, u64 offset, u64 length, name bytes
+//   footer: u64 index_offset, u64 count, "BMPKIDX1"
+//
+// Members are listed in name order so readers can binary-search the index.
+// lanes is the ICBC lane count the member was transformed with, 0 for other
+// modes and for decrypted BMPs (whose header held it); packs written before
+// it was recorded have 0 there too.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include "iohint.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PACK_VERSION 1u
+#define PACK_WB_WINDOW (32 << 20)   // write-behind span of the pack file
+
+typedef struct {
+    char *name;
+    uint64_t offset, length;
+    uint8_t mode, iv, encrypted, lanes;
+} pack_entry_t;
+
+typedef struct {
+    FILE *f;                // members are written here sequentially
+    pack_entry_t *entries;
+    size_t count, cap;
+    uint32_t *slots;        // name hash table: entry index + 1, 0 = empty
+    size_t nslots;
+    io_wb_t wb;             // started by pack_add once PACK_WB_WINDOW has built up
+} pack_writer_t;
+
+typedef struct {
+    int fd;
+    pack_entry_t *entries;
+    size_t count;
+} pack_reader_t;
+
+// Create path and write the pack header. The stream gets a large buffer so
+// many small members coalesce into big sequential writes.
+int pack_create(pack_writer_t *w, const char *path);
+// Record a member occupying [offset, offset + length) of w->f. Every
+// PACK_WB_WINDOW of members the stream is flushed and written back behind,
+// so the members coalesce into large writes. Returns 0, -1 on error, or -2
+// if a member of that name exists already (it is kept; names must be unique
+// for pack_find).
+int pack_add(pack_writer_t *w, const char *name, uint64_t offset, uint64_t length,
+             uint8_t mode, uint8_t iv, uint8_t encrypted, uint8_t lanes);
+// Append index and footer, trim anything after them, optionally fsync, close.
+int pack_finish(pack_writer_t *w, int durable);
+
+int pack_open(pack_reader_t *r, const char *path);
+const pack_entry_t *pack_find(const pack_reader_t *r, const char *name);
+// Random access within one member. Returns bytes read or -1.
+ssize_t pack_read(const pack_reader_t *r, const pack_entry_t *e, void *buf, size_t n, uint64_t off);
+void pack_close(pack_reader_t *r);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PACK_H
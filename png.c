@@ -0,0 +1,313 @@
+#include "png.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const uint8_t SIG[8] = {0x89,'P','N','G','\r','\n',0x1A,'\n'};
+#define STORED_MAX 65535u
+
+static uint32_t read_u32_be(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void put_u32_be(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)(v >> 24); p[1] = (uint8_t)(v >> 16); p[2] = (uint8_t)(v >> 8); p[3] = (uint8_t)v;
+}
+
+int png_is_signature(const uint8_t *p, size_t n) {
+    return n >= 8 && memcmp(p, SIG, 8) == 0;
+}
+
+static int channels(uint8_t color_type) {
+    switch (color_type) {
+    case PNG_GRAY: case PNG_PALETTE: return 1;
+    case PNG_GRAY_ALPHA: return 2;
+    case PNG_RGB: return 3;
+    case PNG_RGBA: return 4;
+    }
+    return 0;
+}
+
+// Read a chunk header. Returns 0 and fills len/type, or -1 at EOF.
+static int chunk_header(FILE *f, uint32_t *len, char type[4]) {
+    uint8_t h[8];
+    if (fread(h, 1, 8, f) != 8) return -1;
+    *len = read_u32_be(h);
+    memcpy(type, h + 4, 4);
+    return 0;
+}
+
+// Inflate input: the payload of consecutive IDAT chunks.
+static size_t idat_fill(void *opaque, uint8_t *buf, size_t cap) {
+    png_reader_t *r = (png_reader_t*)opaque;
+    while (r->chunk_left == 0) {
+        if (r->idat_done) return 0;
+        uint32_t len;
+        char type[4];
+        if (fseek(r->f, 4, SEEK_CUR) != 0 || chunk_header(r->f, &len, type) != 0 ||
+            memcmp(type, "IDAT", 4) != 0) {
+            r->idat_done = 1;
+            return 0;
+        }
+        r->chunk_left = len;
+    }
+    size_t n = cap < r->chunk_left ? cap : r->chunk_left;
+    n = fread(buf, 1, n, r->f);
+    if (n == 0) { r->idat_done = 1; return 0; }
+    r->chunk_left -= (uint32_t)n;
+    return n;
+}
+
+int png_open(png_reader_t *r, FILE *f) {
+    memset(r, 0, sizeof(*r));
+    r->f = f;
+    uint8_t sig[8];
+    if (fread(sig, 1, 8, f) != 8 || !png_is_signature(sig, 8)) return -1;
+
+    int have_ihdr = 0;
+    for (;;) {
+        uint32_t len;
+        char type[4];
+        if (chunk_header(f, &len, type) != 0) return -2;
+        if (memcmp(type, "IDAT", 4) == 0) { r->chunk_left = len; break; }
+        if (memcmp(type, "IHDR", 4) == 0) {
+            uint8_t d[13];
+            if (len != 13 || fread(d, 1, 13, f) != 13) return -2;
+            r->width = read_u32_be(d);
+            r->height = read_u32_be(d + 4);
+            r->bit_depth = d[8];
+            r->color_type = d[9];
+            if (d[10] != 0 || d[11] != 0) return -3;
+            if (d[12] != 0) return -4; // Adam7 interlacing is not streamable row by row
+            have_ihdr = 1;
+        } else if (memcmp(type, "PLTE", 4) == 0 && len <= sizeof(r->palette) && len % 3 == 0) {
+            if (fread(r->palette, 1, len, f) != len) return -2;
+            r->palette_len = (int)(len / 3);
+        } else if (memcmp(type, "tRNS", 4) == 0 && len <= sizeof(r->trns)) {
+            if (fread(r->trns, 1, len, f) != len) return -2;
+            r->trns_len = (int)len;
+        } else if (memcmp(type, "IEND", 4) == 0) {
+            return -2;
+        } else if (fseek(f, (long)len, SEEK_CUR) != 0) {
+            return -2;
+        }
+        if (fseek(f, 4, SEEK_CUR) != 0) return -2; // CRC
+    }
+    if (!have_ihdr || r->width == 0 || r->height == 0) return -2;
+
+    int ch = channels(r->color_type);
+    int d = r->bit_depth;
+    int ok = ch && (d == 8 || d == 16 ||
+                    ((r->color_type == PNG_GRAY || r->color_type == PNG_PALETTE) &&
+                     (d == 1 || d == 2 || d == 4)));
+    if (r->color_type == PNG_PALETTE && (d == 16 || r->palette_len == 0)) ok = 0;
+    if (!ok) return -3;
+
+    size_t bits = (size_t)ch * d;
+    r->bpp = bits < 8 ? 1 : bits / 8;
+    r->rowbytes = ((size_t)r->width * bits + 7) / 8;
+    r->prev = (uint8_t*)calloc(1, r->rowbytes + 1);
+    r->cur = (uint8_t*)calloc(1, r->rowbytes + 1);
+    r->z = (flate_inflate_t*)malloc(sizeof(*r->z));
+    if (!r->prev || !r->cur || !r->z) return -5;
+    flate_inflate_init(r->z, idat_fill, r);
+
+    int cmf = flate_getbyte(r->z), flg = flate_getbyte(r->z);
+    if (cmf < 0 || flg < 0 || (cmf & 0x0F) != 8 || ((cmf << 8) | flg) % 31 != 0 || (flg & 0x20))
+        return -2;
+    return 0;
+}
+
+static uint8_t paeth(uint8_t a, uint8_t b, uint8_t c) {
+    int p = (int)a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    if (pa <= pb && pa <= pc) return a;
+    return pb <= pc ? b : c;
+}
+
+int png_read_row(png_reader_t *r, const uint8_t **row) {
+    if (r->row == r->height) return 0;
+    size_t need = r->rowbytes + 1, got = 0;
+    while (got < need) {
+        long n = flate_inflate_read(r->z, r->cur + got, need - got);
+        if (n <= 0) return -1;
+        got += (size_t)n;
+    }
+
+    uint8_t *x = r->cur + 1;
+    const uint8_t *p = r->prev + 1;
+    size_t n = r->rowbytes, bpp = r->bpp, i;
+    switch (r->cur[0]) {
+    case 0: break;
+    case 1: for (i = bpp; i < n; ++i) x[i] += x[i - bpp]; break;
+    case 2: for (i = 0; i < n; ++i) x[i] += p[i]; break;
+    case 3:
+        for (i = 0; i < bpp && i < n; ++i) x[i] += p[i] >> 1;
+        for (; i < n; ++i) x[i] += (uint8_t)((x[i - bpp] + p[i]) >> 1);
+        break;
+    case 4:
+        for (i = 0; i < bpp && i < n; ++i) x[i] += p[i];
+        for (; i < n; ++i) x[i] += paeth(x[i - bpp], p[i], p[i - bpp]);
+        break;
+    default: return -1;
+    }
+
+    uint8_t *t = r->prev; r->prev = r->cur; r->cur = t;
+    r->row++;
+    *row = r->prev + 1;
+    return 1;
+}
+
+void png_close(png_reader_t *r) {
+    free(r->prev);
+    free(r->cur);
+    free(r->z);
+    r->prev = r->cur = NULL;
+    r->z = NULL;
+}
+
+int png_bgr_channels(const png_reader_t *r) {
+    return (r->color_type == PNG_GRAY_ALPHA || r->color_type == PNG_RGBA) ? 4 : 3;
+}
+
+// Sample s of a row as an 8-bit value (high byte for 16-bit, index for palette).
+static unsigned sample(const png_reader_t *r, const uint8_t *row, size_t s) {
+    int d = r->bit_depth;
+    if (d == 8) return row[s];
+    if (d == 16) return row[2 * s];
+    unsigned shift = (unsigned)(8 - d - (s * d) % 8);
+    return (row[s * d / 8] >> shift) & ((1u << d) - 1);
+}
+
+void png_row_to_bgr(const png_reader_t *r, const uint8_t *row, uint8_t *out) {
+    int ch = channels(r->color_type);
+    int oc = png_bgr_channels(r);
+    unsigned gray_scale = r->bit_depth < 8 ? 255u / ((1u << r->bit_depth) - 1) : 1;
+    for (uint32_t x = 0; x < r->width; ++x, out += oc) {
+        size_t s = (size_t)x * ch;
+        switch (r->color_type) {
+        case PNG_GRAY:
+        case PNG_GRAY_ALPHA: {
+            uint8_t g = (uint8_t)(sample(r, row, s) * gray_scale);
+            out[0] = out[1] = out[2] = g;
+            if (oc == 4) out[3] = (uint8_t)sample(r, row, s + 1);
+            break;
+        }
+        case PNG_PALETTE: {
+            unsigned i = sample(r, row, s);
+            if ((int)i >= r->palette_len) i = 0;
+            out[0] = r->palette[3 * i + 2];
+            out[1] = r->palette[3 * i + 1];
+            out[2] = r->palette[3 * i];
+            break;
+        }
+        default:
+            out[0] = (uint8_t)sample(r, row, s + 2);
+            out[1] = (uint8_t)sample(r, row, s + 1);
+            out[2] = (uint8_t)sample(r, row, s);
+            if (oc == 4) out[3] = (uint8_t)sample(r, row, s + 3);
+            break;
+        }
+    }
+}
+
+// --- Writer ---
+
+static int write_chunk(FILE *f, const char *type, const uint8_t *a, size_t alen,
+                       const uint8_t *b, size_t blen) {
+    uint8_t h[8];
+    put_u32_be(h, (uint32_t)(alen + blen));
+    memcpy(h + 4, type, 4);
+    uint32_t crc = flate_crc32(0, h + 4, 4);
+    if (alen) crc = flate_crc32(crc, a, alen);
+    if (blen) crc = flate_crc32(crc, b, blen);
+    uint8_t t[4];
+    put_u32_be(t, crc);
+    if (fwrite(h, 1, 8, f) != 8) return -1;
+    if (alen && fwrite(a, 1, alen, f) != alen) return -1;
+    if (blen && fwrite(b, 1, blen, f) != blen) return -1;
+    return fwrite(t, 1, 4, f) == 4 ? 0 : -1;
+}
+
+// Emit the pending payload as one stored block in its own IDAT chunk.
+static int flush_block(png_writer_t *w, int final) {
+    uint8_t pre[7];
+    size_t np = 0;
+    if (!w->started) { pre[np++] = 0x78; pre[np++] = 0x01; w->started = 1; }
+    pre[np++] = (uint8_t)(final ? 1 : 0);
+    pre[np++] = (uint8_t)(w->len & 0xFF);
+    pre[np++] = (uint8_t)(w->len >> 8);
+    pre[np++] = (uint8_t)(~w->len & 0xFF);
+    pre[np++] = (uint8_t)((~w->len >> 8) & 0xFF);
+    if (final) {
+        // Trailer goes after the (possibly empty) last block in the same chunk.
+        uint8_t *tail = w->buf + w->len;
+        put_u32_be(tail, w->adler);
+        int rc = write_chunk(w->f, "IDAT", pre, np, w->buf, w->len + 4);
+        w->len = 0;
+        return rc;
+    }
+    int rc = write_chunk(w->f, "IDAT", pre, np, w->buf, w->len);
+    w->len = 0;
+    return rc;
+}
+
+int png_write_begin(png_writer_t *w, FILE *f, const png_reader_t *src) {
+    memset(w, 0, sizeof(*w));
+    w->f = f;
+    w->adler = 1;
+    w->buf = (uint8_t*)malloc(STORED_MAX + 4);
+    if (!w->buf) return -1;
+
+    uint8_t ihdr[13];
+    put_u32_be(ihdr, src->width);
+    put_u32_be(ihdr + 4, src->height);
+    ihdr[8] = src->bit_depth;
+    ihdr[9] = src->color_type;
+    ihdr[10] = ihdr[11] = ihdr[12] = 0;
+    // Transformed indices can take any value, so a palette image gets all
+    // 2^bit_depth entries, the missing ones black.
+    uint8_t plte[256 * 3];
+    size_t plte_len = (size_t)src->palette_len;
+    memcpy(plte, src->palette, plte_len * 3);
+    if (src->color_type == PNG_PALETTE && plte_len < (1u << src->bit_depth)) {
+        memset(plte + plte_len * 3, 0, ((1u << src->bit_depth) - plte_len) * 3);
+        plte_len = 1u << src->bit_depth;
+    }
+    if (fwrite(SIG, 1, 8, f) != 8 ||
+        write_chunk(f, "IHDR", ihdr, 13, NULL, 0) != 0 ||
+        (plte_len && write_chunk(f, "PLTE", plte, plte_len * 3, NULL, 0) != 0) ||
+        (src->trns_len && write_chunk(f, "tRNS", src->trns, (size_t)src->trns_len, NULL, 0) != 0)) {
+        free(w->buf);
+        w->buf = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+static int put_bytes(png_writer_t *w, const uint8_t *p, size_t n) {
+    w->adler = flate_adler32(w->adler, p, n);
+    while (n) {
+        size_t k = STORED_MAX - w->len;
+        if (k > n) k = n;
+        memcpy(w->buf + w->len, p, k);
+        w->len += k;
+        p += k;
+        n -= k;
+        if (w->len == STORED_MAX && flush_block(w, 0) != 0) return -1;
+    }
+    return 0;
+}
+
+int png_write_row(png_writer_t *w, const uint8_t *row, size_t n) {
+    static const uint8_t filter_none = 0;
+    if (put_bytes(w, &filter_none, 1) != 0) return -1;
+    return put_bytes(w, row, n);
+}
+
+int png_write_end(png_writer_t *w) {
+    int rc = flush_block(w, 1);
+    if (rc == 0) rc = write_chunk(w->f, "IEND", NULL, 0, NULL, 0);
+    free(w->buf);
+    w->buf = NULL;
+    return rc;
+}
@@ -0,0 +1,68 @@
+#ifndef PNG_H
+#define PNG_H
+
+// Streaming PNG reader (non-interlaced, all standard color types/bit depths)
+// and an uncompressed PNG writer. Rows are decoded one at a time, so memory
+// use is two rows plus the 32 KiB inflate window regardless of image size.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "flate.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum { PNG_GRAY = 0, PNG_RGB = 2, PNG_PALETTE = 3, PNG_GRAY_ALPHA = 4, PNG_RGBA = 6 };
+
+typedef struct {
+    FILE *f;
+    uint32_t width, height;
+    uint8_t bit_depth, color_type;
+    uint8_t palette[256 * 3];
+    int palette_len;            // entries
+    uint8_t trns[256];
+    int trns_len;               // raw tRNS chunk length (0 = none)
+    size_t bpp;                 // filter unit: bytes per complete pixel, at least 1
+    size_t rowbytes;            // raw row length, excluding the filter byte
+    uint8_t *prev, *cur;        // filter byte + row
+    uint32_t chunk_left;        // bytes left in the current IDAT chunk
+    int idat_done;
+    uint32_t row;
+    flate_inflate_t *z;
+} png_reader_t;
+
+typedef struct {
+    FILE *f;
+    uint8_t *buf;               // pending stored-block payload
+    size_t len;
+    uint32_t adler;
+    int started;
+} png_writer_t;
+
+// True if p (n >= 8 bytes) starts with the PNG signature.
+int png_is_signature(const uint8_t *p, size_t n);
+
+// Read signature and header chunks up to the first IDAT. 0 on success, <0 on error.
+int png_open(png_reader_t *r, FILE *f);
+// Decode the next row into *row (rowbytes bytes, owned by the reader).
+// Returns 1 for a row, 0 after the last row, -1 on error.
+int png_read_row(png_reader_t *r, const uint8_t **row);
+void png_close(png_reader_t *r);
+
+// Number of 8-bit channels png_row_to_bgr() produces: 4 with an alpha channel, else 3.
+int png_bgr_channels(const png_reader_t *r);
+// Expand one decoded row to 8-bit BGR or BGRA (BMP channel order).
+void png_row_to_bgr(const png_reader_t *r, const uint8_t *row, uint8_t *out);
+
+// Write a PNG with the same IHDR/PLTE/tRNS as src, storing rows uncompressed.
+int png_write_begin(png_writer_t *w, FILE *f, const png_reader_t *src);
+int png_write_row(png_writer_t *w, const uint8_t *row, size_t n);
+int png_write_end(png_writer_t *w);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PNG_H
@@ -0,0 +1,150 @@
+#include "pyramid.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    FILE *fo;
+    char path[1024];
+    uint32_t width, height;
+    size_t stride;
+    uint16_t *acc;          // horizontal pair sums of a row awaiting its vertical partner
+    int pending;
+    unsigned char *plain;   // finished row, fed to the next level
+    unsigned char *cipher;  // the same row after the cipher, written out
+    sdes_stream_t st;
+} level_t;
+
+static uint32_t rd32(const unsigned char *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void wr32(unsigned char *p, uint32_t v) {
+    p[0] = (unsigned char)v; p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16); p[3] = (unsigned char)(v >> 24);
+}
+
+static void emit(level_t *L, int k, int n, int ch);
+
+// Feed one plain row of level k-1 into level k.
+static void push(level_t *L, int k, int n, int ch, const unsigned char *src) {
+    level_t *lv = &L[k];
+    uint32_t sw = L[k - 1].width;
+    for (uint32_t x = 0; x < lv->width; ++x) {
+        const unsigned char *a = src + (size_t)2 * x * ch;
+        const unsigned char *b = 2 * x + 1 < sw ? a + ch : a; // odd width: repeat the edge
+        for (int c = 0; c < ch; ++c) {
+            uint16_t sum = (uint16_t)(a[c] + b[c]);
+            size_t i = (size_t)x * ch + c;
+            if (lv->pending) lv->plain[i] = (unsigned char)((lv->acc[i] + sum + 2) / 4);
+            else lv->acc[i] = sum;
+        }
+    }
+    lv->pending = !lv->pending;
+    if (!lv->pending) emit(L, k, n, ch);
+}
+
+// Write level k's finished row and pass it down the pyramid.
+static void emit(level_t *L, int k, int n, int ch) {
+    level_t *lv = &L[k];
+    memcpy(lv->cipher, lv->plain, lv->stride);
+    sdes_stream_process(&lv->st, lv->cipher, lv->cipher, lv->stride);
+    fwrite(lv->cipher, 1, lv->stride, lv->fo);
+    if (k + 1 < n) push(L, k + 1, n, ch, lv->plain);
+}
+
+static void level_path(char *out, size_t cap, const char *outpath, int k) {
+    const char *slash = strrchr(outpath, '/');
+    const char *dot = strrchr(outpath, '.');
+    if (!dot || (slash && dot < slash)) dot = outpath + strlen(outpath);
+    snprintf(out, cap, "%.*s_L%d%s", (int)(dot - outpath), outpath, k, *dot ? dot : ".bmp");
+}
+
+int pyramid_write(FILE *fi, const char *outpath, int levels, const sdes_ctx_t *ctx,
+                  sdes_mode_t mode, int do_encrypt, uint8_t iv_or_nonce) {
+    if (!do_encrypt) { fprintf(stderr, "--pyramid only encrypts\n"); return 1; }
+    unsigned char h54[54];
+    if (fread(h54, 1, sizeof(h54), fi) != sizeof(h54) || h54[0] != 'B' || h54[1] != 'M') {
+        fprintf(stderr, "Not a BMP\n"); return 1;
+    }
+    uint32_t offBits = rd32(&h54[10]) < 54 ? 54 : rd32(&h54[10]);
+    int32_t width = (int32_t)rd32(&h54[18]), height = (int32_t)rd32(&h54[22]);
+    int bits = h54[28] | (h54[29] << 8);
+    uint32_t compression = rd32(&h54[30]);
+    if (rd32(&h54[14]) < 40 || width <= 0 || height == 0 || (bits != 24 && bits != 32) ||
+        !(compression == 0 || (compression == 3 && bits == 32))) {
+        fprintf(stderr, "--pyramid needs an uncompressed 24/32-bit BMP\n"); return 1;
+    }
+    unsigned char *header = (unsigned char*)malloc(offBits);
+    if (!header) { fprintf(stderr, "OOM\n"); return 1; }
+    memcpy(header, h54, sizeof(h54));
+    if (offBits > 54 && fread(header + 54, 1, offBits - 54, fi) != offBits - 54) {
+        fprintf(stderr, "Unexpected EOF reading palette/headers\n"); free(header); return 1;
+    }
+
+    int ch = bits / 8;
+    if (levels > PYRAMID_MAX_LEVELS) levels = PYRAMID_MAX_LEVELS;
+    level_t L[PYRAMID_MAX_LEVELS];
+    memset(L, 0, sizeof(L));
+    uint32_t w = (uint32_t)width, hgt = (uint32_t)(height < 0 ? -(int64_t)height : height);
+    int n = 0, rc = 0;
+    for (; n < levels; ++n) {
+        level_t *lv = &L[n];
+        lv->width = w;
+        lv->height = hgt;
+        lv->stride = (((size_t)w * bits + 31) / 32) * 4;
+        lv->plain = (unsigned char*)calloc(1, lv->stride);
+        lv->cipher = (unsigned char*)malloc(lv->stride);
+        lv->acc = (uint16_t*)calloc((size_t)w * ch, sizeof(uint16_t));
+        if (n == 0) snprintf(lv->path, sizeof(lv->path), "%s", outpath);
+        else level_path(lv->path, sizeof(lv->path), outpath, n);
+        lv->fo = fopen(lv->path, "wb");
+        if (!lv->plain || !lv->cipher || !lv->acc || !lv->fo) {
+            perror(lv->path); rc = 1; n++; break;
+        }
+        uint8_t iv = sdes_derive_iv(ctx, iv_or_nonce, (unsigned)n);
+        sdes_stream_init(&lv->st, ctx, mode, do_encrypt, iv);
+
+        uint64_t image = (uint64_t)lv->stride * hgt;
+        wr32(&header[2], (uint32_t)(offBits + image));
+        wr32(&header[18], w);
+        wr32(&header[22], height < 0 ? (uint32_t)-(int32_t)hgt : hgt);
+        wr32(&header[34], (uint32_t)image);
+        fwrite(header, 1, offBits, lv->fo);
+        if (mode == MODE_ECB) printf("Level %d: %ux%u -> %s\n", n, w, hgt, lv->path);
+        else printf("Level %d: %ux%u -> %s (IV/nonce 0x%02X)\n", n, w, hgt, lv->path, iv);
+
+        if (w == 1 && hgt == 1) { n++; break; }
+        w = (w + 1) / 2;
+        hgt = (hgt + 1) / 2;
+    }
+
+    if (rc == 0) {
+        // Source rows stream through level 0; each level holds at most one pending row.
+        level_t *top = &L[0];
+        for (uint32_t y = 0; y < top->height; ++y) {
+            if (fread(top->plain, 1, top->stride, fi) != top->stride) {
+                fprintf(stderr, "Unexpected EOF in pixel data\n"); rc = 1; break;
+            }
+            emit(L, 0, n, ch);
+        }
+        // Odd heights: the last row of a level pairs with itself.
+        for (int k = 1; rc == 0 && k < n; ++k) {
+            if (!L[k].pending) continue;
+            uint16_t *acc = L[k].acc;
+            for (size_t i = 0; i < (size_t)L[k].width * ch; ++i)
+                L[k].plain[i] = (unsigned char)((2 * acc[i] + 2) / 4);
+            L[k].pending = 0;
+            emit(L, k, n, ch);
+        }
+    }
+
+    for (int k = 0; k < n; ++k) {
+        if (L[k].fo && fclose(L[k].fo) != 0 && rc == 0) { perror(L[k].path); rc = 1; }
+        free(L[k].plain);
+        free(L[k].cipher);
+        free(L[k].acc);
+    }
+    free(header);
+    return rc;
+}
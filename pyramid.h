@@ -0,0 +1,28 @@
+#ifndef PYRAMID_H
+#define PYRAMID_H
+
+// One-pass multi-resolution pyramid: read a 24/32-bit BMP once and write it
+// plus successive 2x box-downsampled levels, each encrypted as its own BMP.
+
+#include <stdio.h>
+#include "sdes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PYRAMID_MAX_LEVELS 16
+
+// fi is positioned at offset 0. Level 0 goes to outpath, level k to
+// "<stem>_L<k><ext>". Level k uses IV sdes_derive_iv(ctx, iv, k).
+// Stops early once a level is 1x1. Encryption only, as the levels are
+// downsampled from the plain input; decrypt each level as its own BMP.
+// Returns 0 on success (errors are printed).
+int pyramid_write(FILE *fi, const char *outpath, int levels, const sdes_ctx_t *ctx,
+                  sdes_mode_t mode, int do_encrypt, uint8_t iv_or_nonce);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PYRAMID_H
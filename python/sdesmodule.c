@@ -0,0 +1,348 @@
+// CPython bindings for the S-DES bulk API and the in-memory BMP transform.
+//
+// Every data argument is taken through the buffer protocol (bytes, bytearray,
+// memoryview, mmap, NumPy arrays, ...) and read in place. Results go into a
+// caller-supplied writable buffer (out=..., which may be the input itself for
+// in-place work) or into a new bytes object written directly by the cipher.
+// The GIL is released while bytes are processed, so threads scale.
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <string.h>
+#include <strings.h>
+#include "sdes.h"
+#include "bmpmem.h"
+
+// Below this size releasing the GIL costs more than it saves.
+#define NOGIL_MIN 4096
+
+typedef struct {
+    PyObject_HEAD
+    sdes_ctx_t ctx;
+} KeyObject;
+
+typedef struct {
+    PyObject_HEAD
+    KeyObject *key;         // keeps ctx alive
+    sdes_stream_t st;
+    int busy;               // a call is running with the GIL released
+} StreamObject;
+
+static PyTypeObject KeyType, StreamType;
+
+static int parse_mode(PyObject *o, sdes_mode_t *mode) {
+    if (PyLong_Check(o)) {
+        long m = PyLong_AsLong(o);
+        if (m >= MODE_ECB && m <= MODE_ICBC) { *mode = (sdes_mode_t)m; return 0; }
+    } else if (PyUnicode_Check(o)) {
+        const char *s = PyUnicode_AsUTF8(o);
+        if (!s) return -1;
+        if (strcasecmp(s, "ECB") == 0) { *mode = MODE_ECB; return 0; }
+        if (strcasecmp(s, "CBC") == 0) { *mode = MODE_CBC; return 0; }
+        if (strcasecmp(s, "CTR") == 0) { *mode = MODE_CTR; return 0; }
+        if (strcasecmp(s, "ICBC") == 0) { *mode = MODE_ICBC; return 0; }
+    }
+    PyErr_SetString(PyExc_ValueError, "mode must be 'ECB', 'CBC', 'CTR', 'ICBC' or sdes.ECB/CBC/CTR/ICBC");
+    return -1;
+}
+
+// ICBC lane count (ignored by the other modes).
+static int set_lanes(sdes_stream_t *st, int lanes) {
+    if (st->mode != MODE_ICBC || sdes_stream_set_lanes(st, (unsigned)lanes) == 0) return 0;
+    PyErr_SetString(PyExc_ValueError, "lanes must be 16, 32 or 64");
+    return -1;
+}
+
+static int parse_iv(int iv, uint8_t *out) {
+    if (iv < 0 || iv > 255) { PyErr_SetString(PyExc_ValueError, "iv must be 0..255"); return -1; }
+    *out = (uint8_t)iv;
+    return 0;
+}
+
+// Input view plus either the caller's out buffer or a new bytes object.
+// On success *result is a new reference to what the call returns.
+static int open_io(PyObject *data, PyObject *out, Py_buffer *in, Py_buffer *ob, PyObject **result, uint8_t **dst) {
+    if (PyObject_GetBuffer(data, in, PyBUF_C_CONTIGUOUS) != 0) return -1;
+    if (out && out != Py_None) {
+        if (PyObject_GetBuffer(out, ob, PyBUF_C_CONTIGUOUS | PyBUF_WRITABLE) != 0) {
+            PyBuffer_Release(in);
+            return -1;
+        }
+        if (ob->len != in->len) {
+            PyErr_Format(PyExc_ValueError, "out has %zd bytes, data has %zd", ob->len, in->len);
+            PyBuffer_Release(ob);
+            PyBuffer_Release(in);
+            return -1;
+        }
+        *dst = (uint8_t*)ob->buf;
+        Py_INCREF(out);
+        *result = out;
+        return 0;
+    }
+    ob->obj = NULL;
+    *result = PyBytes_FromStringAndSize(NULL, in->len);
+    if (!*result) { PyBuffer_Release(in); return -1; }
+    *dst = (uint8_t*)PyBytes_AS_STRING(*result);
+    return 0;
+}
+
+static void close_io(Py_buffer *in, Py_buffer *ob) {
+    if (ob->obj) PyBuffer_Release(ob);
+    PyBuffer_Release(in);
+}
+
+// --- Key ---
+
+static int Key_init(KeyObject *self, PyObject *args, PyObject *kw) {
+    static char *kwlist[] = {"key", NULL};
+    PyObject *k;
+    if (!PyArg_ParseTupleAndKeywords(args, kw, "O:Key", kwlist, &k)) return -1;
+    uint16_t key10;
+    if (PyUnicode_Check(k)) {
+        const char *s = PyUnicode_AsUTF8(k);
+        if (!s) return -1;
+        if (sdes_parse_key10_bits(s, &key10) != 0) {
+            PyErr_SetString(PyExc_ValueError, "key string must be 10 bits of 0/1");
+            return -1;
+        }
+    } else {
+        long v = PyLong_AsLong(k);
+        if (v == -1 && PyErr_Occurred()) return -1;
+        if (v < 0 || v > 0x3FF) { PyErr_SetString(PyExc_ValueError, "key must be 0..1023"); return -1; }
+        key10 = (uint16_t)v;
+    }
+    sdes_ctx_init(&self->ctx, key10);
+    return 0;
+}
+
+static PyObject *Key_process(KeyObject *self, PyObject *args, PyObject *kw) {
+    static char *kwlist[] = {"data", "mode", "encrypt", "iv", "out", "lanes", NULL};
+    PyObject *data, *mode_o, *out = NULL;
+    int encrypt = 1, iv_i = 0, lanes = SDES_ICBC_LANES;
+    if (!PyArg_ParseTupleAndKeywords(args, kw, "OO|piOi:process", kwlist, &data, &mode_o, &encrypt, &iv_i,
+                                     &out, &lanes))
+        return NULL;
+    sdes_mode_t mode;
+    uint8_t iv;
+    if (parse_mode(mode_o, &mode) != 0 || parse_iv(iv_i, &iv) != 0) return NULL;
+    sdes_stream_t st;
+    sdes_stream_init(&st, &self->ctx, mode, encrypt, iv);
+    if (set_lanes(&st, lanes) != 0) return NULL;
+    Py_buffer in, ob;
+    PyObject *result;
+    uint8_t *dst;
+    if (open_io(data, out, &in, &ob, &result, &dst) != 0) return NULL;
+    if (in.len >= NOGIL_MIN) {
+        Py_BEGIN_ALLOW_THREADS
+        sdes_stream_process(&st, (const uint8_t*)in.buf, dst, (size_t)in.len);
+        Py_END_ALLOW_THREADS
+    } else {
+        sdes_stream_process(&st, (const uint8_t*)in.buf, dst, (size_t)in.len);
+    }
+    close_io(&in, &ob);
+    return result;
+}
+
+static PyObject *Key_transform_bmp(KeyObject *self, PyObject *args, PyObject *kw) {
+    static char *kwlist[] = {"data", "mode", "encrypt", "iv", "out", NULL};
+    PyObject *data, *mode_o, *out = NULL;
+    int encrypt = 1, iv_i = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kw, "OO|piO:transform_bmp", kwlist, &data, &mode_o, &encrypt, &iv_i, &out))
+        return NULL;
+    sdes_mode_t mode;
+    uint8_t iv;
+    if (parse_mode(mode_o, &mode) != 0 || parse_iv(iv_i, &iv) != 0) return NULL;
+    Py_buffer in, ob;
+    PyObject *result;
+    uint8_t *dst;
+    if (open_io(data, out, &in, &ob, &result, &dst) != 0) return NULL;
+    int rc;
+    Py_BEGIN_ALLOW_THREADS
+    rc = bmp_transform_mem(&self->ctx, mode, encrypt, iv, (const uint8_t*)in.buf, dst, (size_t)in.len);
+    Py_END_ALLOW_THREADS
+    close_io(&in, &ob);
+    if (rc != 0) {
+        Py_DECREF(result);
+        PyErr_SetString(PyExc_ValueError, "not a BMP (or truncated header)");
+        return NULL;
+    }
+    return result;
+}
+
+// process_many([(data, mode, iv[, out]), ...], encrypt=True) -> list
+static PyObject *Key_process_many(KeyObject *self, PyObject *args, PyObject *kw) {
+    static char *kwlist[] = {"items", "encrypt", NULL};
+    PyObject *items;
+    int encrypt = 1;
+    if (!PyArg_ParseTupleAndKeywords(args, kw, "O|p:process_many", kwlist, &items, &encrypt)) return NULL;
+    PyObject *seq = PySequence_Fast(items, "items must be a sequence of (data, mode, iv[, out]) tuples");
+    if (!seq) return NULL;
+    Py_ssize_t n = PySequence_Fast_GET_SIZE(seq);
+    Py_buffer *ins = PyMem_Calloc(n ? (size_t)n : 1, sizeof(Py_buffer));
+    Py_buffer *obs = PyMem_Calloc(n ? (size_t)n : 1, sizeof(Py_buffer));
+    sdes_iov_t *iov = PyMem_Calloc(n ? (size_t)n : 1, sizeof(sdes_iov_t));
+    PyObject *results = PyList_New(n);
+    Py_ssize_t opened = 0;
+    size_t total = 0;
+    if (!ins || !obs || !iov || !results) { PyErr_NoMemory(); goto done; }
+    for (; opened < n; ++opened) {
+        PyObject *data, *mode_o, *out = NULL, *result;
+        int iv_i = 0;
+        sdes_mode_t mode;
+        uint8_t iv, *dst;
+        if (!PyArg_ParseTuple(PySequence_Fast_GET_ITEM(seq, opened), "OOi|O:process_many item",
+                              &data, &mode_o, &iv_i, &out) ||
+            parse_mode(mode_o, &mode) != 0 || parse_iv(iv_i, &iv) != 0 ||
+            open_io(data, out, &ins[opened], &obs[opened], &result, &dst) != 0)
+            goto done;
+        PyList_SET_ITEM(results, opened, result);
+        iov[opened] = (sdes_iov_t){ (const uint8_t*)ins[opened].buf, dst, (size_t)ins[opened].len, mode, iv, 0 };
+        total += (size_t)ins[opened].len;
+    }
+    if (total >= NOGIL_MIN) {
+        Py_BEGIN_ALLOW_THREADS
+        sdes_process_iov(&self->ctx, encrypt, iov, (size_t)n);
+        Py_END_ALLOW_THREADS
+    } else {
+        sdes_process_iov(&self->ctx, encrypt, iov, (size_t)n);
+    }
+done:
+    for (Py_ssize_t i = 0; i < opened; ++i) close_io(&ins[i], &obs[i]);
+    PyMem_Free(ins);
+    PyMem_Free(obs);
+    PyMem_Free(iov);
+    Py_DECREF(seq);
+    if (PyErr_Occurred()) { Py_XDECREF(results); return NULL; }
+    return results;
+}
+
+static PyObject *Key_stream(KeyObject *self, PyObject *args, PyObject *kw) {
+    static char *kwlist[] = {"mode", "encrypt", "iv", "lanes", NULL};
+    PyObject *mode_o;
+    int encrypt = 1, iv_i = 0, lanes = SDES_ICBC_LANES;
+    if (!PyArg_ParseTupleAndKeywords(args, kw, "O|pii:stream", kwlist, &mode_o, &encrypt, &iv_i, &lanes))
+        return NULL;
+    sdes_mode_t mode;
+    uint8_t iv;
+    if (parse_mode(mode_o, &mode) != 0 || parse_iv(iv_i, &iv) != 0) return NULL;
+    sdes_stream_t st;
+    sdes_stream_init(&st, &self->ctx, mode, encrypt, iv);
+    if (set_lanes(&st, lanes) != 0) return NULL;
+    StreamObject *s = PyObject_New(StreamObject, &StreamType);
+    if (!s) return NULL;
+    Py_INCREF(self);
+    s->key = self;
+    s->busy = 0;
+    s->st = st;
+    return (PyObject*)s;
+}
+
+static PyObject *Key_get_subkeys(KeyObject *self, void *closure) {
+    (void)closure;
+    return Py_BuildValue("(ii)", self->ctx.K1, self->ctx.K2);
+}
+
+static PyMethodDef Key_methods[] = {
+    {"process", (PyCFunction)(void(*)(void))Key_process, METH_VARARGS | METH_KEYWORDS,
+     "process(data, mode, encrypt=True, iv=0, out=None, lanes=16)\n"
+     "Transform a whole buffer as one stream. Returns out, or new bytes."},
+    {"process_many", (PyCFunction)(void(*)(void))Key_process_many, METH_VARARGS | METH_KEYWORDS,
+     "process_many(items, encrypt=True)\n"
+     "items: (data, mode, iv[, out]) tuples, each its own stream, done in one call."},
+    {"transform_bmp", (PyCFunction)(void(*)(void))Key_transform_bmp, METH_VARARGS | METH_KEYWORDS,
+     "transform_bmp(data, mode, encrypt=True, iv=0, out=None)\n"
+     "Transform a BMP file image exactly as the bmper tool does."},
+    {"stream", (PyCFunction)(void(*)(void))Key_stream, METH_VARARGS | METH_KEYWORDS,
+     "stream(mode, encrypt=True, iv=0, lanes=16) -> Stream for data fed in pieces."},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyGetSetDef Key_getset[] = {
+    {"subkeys", (getter)Key_get_subkeys, NULL, "(K1, K2)", NULL},
+    {NULL, NULL, NULL, NULL, NULL}
+};
+
+// --- Stream ---
+
+static void Stream_dealloc(StreamObject *self) {
+    Py_XDECREF(self->key);
+    PyObject_Free(self);
+}
+
+static PyObject *Stream_process(StreamObject *self, PyObject *args, PyObject *kw) {
+    static char *kwlist[] = {"data", "out", NULL};
+    PyObject *data, *out = NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kw, "O|O:process", kwlist, &data, &out)) return NULL;
+    if (self->busy) {
+        PyErr_SetString(PyExc_RuntimeError, "Stream is in use by another thread");
+        return NULL;
+    }
+    Py_buffer in, ob;
+    PyObject *result;
+    uint8_t *dst;
+    if (open_io(data, out, &in, &ob, &result, &dst) != 0) return NULL;
+    self->busy = 1;
+    if (in.len >= NOGIL_MIN) {
+        Py_BEGIN_ALLOW_THREADS
+        sdes_stream_process(&self->st, (const uint8_t*)in.buf, dst, (size_t)in.len);
+        Py_END_ALLOW_THREADS
+    } else {
+        sdes_stream_process(&self->st, (const uint8_t*)in.buf, dst, (size_t)in.len);
+    }
+    self->busy = 0;
+    close_io(&in, &ob);
+    return result;
+}
+
+static PyMethodDef Stream_methods[] = {
+    {"process", (PyCFunction)(void(*)(void))Stream_process, METH_VARARGS | METH_KEYWORDS,
+     "process(data, out=None)\nContinue the stream over data."},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyTypeObject KeyType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "sdes.Key",
+    .tp_basicsize = sizeof(KeyObject),
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = "Key(key)\nS-DES key from an int 0..1023 or a 10-character bit string.",
+    .tp_new = PyType_GenericNew,
+    .tp_init = (initproc)Key_init,
+    .tp_methods = Key_methods,
+    .tp_getset = Key_getset,
+};
+
+static PyTypeObject StreamType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "sdes.Stream",
+    .tp_basicsize = sizeof(StreamObject),
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = "Cipher state for one stream; create with Key.stream().",
+    .tp_dealloc = (destructor)Stream_dealloc,
+    .tp_methods = Stream_methods,
+};
+
+static struct PyModuleDef sdes_module = {
+    PyModuleDef_HEAD_INIT, "sdes",
+    "S-DES ECB/CBC/CTR/ICBC over buffers and in-memory BMP files (zero-copy, GIL released).",
+    -1, NULL, NULL, NULL, NULL, NULL
+};
+
+PyMODINIT_FUNC PyInit_sdes(void) {
+    if (PyType_Ready(&KeyType) < 0 || PyType_Ready(&StreamType) < 0) return NULL;
+    PyObject *m = PyModule_Create(&sdes_module);
+    if (!m) return NULL;
+    Py_INCREF(&KeyType);
+    if (PyModule_AddObject(m, "Key", (PyObject*)&KeyType) < 0 ||
+        PyModule_AddIntConstant(m, "ECB", MODE_ECB) < 0 ||
+        PyModule_AddIntConstant(m, "CBC", MODE_CBC) < 0 ||
+        PyModule_AddIntConstant(m, "CTR", MODE_CTR) < 0 ||
+        PyModule_AddIntConstant(m, "ICBC", MODE_ICBC) < 0) {
+        Py_DECREF(&KeyType);
+        Py_DECREF(m);
+        return NULL;
+    }
+    Py_INCREF(&StreamType);
+    PyModule_AddObject(m, "Stream", (PyObject*)&StreamType);
+    return m;
+}
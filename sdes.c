@@ -1,5 +1,9 @@
 #include "sdes.h"
+#include "sdes_kernels.h"
+#include <stdatomic.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 // --- S-DES tables (Stallings) ---
 // Permutation helpers expect 1-based positions in tables.
@@ -152,4 +156,380 @@ int sdes_parse_key10_bits(const char *bits, uint16_t *out_key10) {
     // Keep only low 10 bits (support longer inputs just in case)
     *out_key10 = k & 0x03FF;
     return 0;
-}
\ No newline at end of file
+}
+
+// --- Bulk API ---
+
+void sdes_ctx_init(sdes_ctx_t *ctx, uint16_t key10) {
+    sdes_generate_subkeys(key10, &ctx->K1, &ctx->K2);
+    for (int b = 0; b < 256; ++b) {
+        uint8_t c = sdes_encrypt_byte((uint8_t)b, ctx->K1, ctx->K2);
+        ctx->enc[b] = c;
+        ctx->dec[c] = (uint8_t)b;
+    }
+}
+
+uint8_t sdes_derive_iv(const sdes_ctx_t *ctx, uint8_t iv, unsigned index) {
+    return index ? ctx->enc[(uint8_t)(iv ^ index)] : iv;
+}
+
+// --- Kernel dispatch ---
+// The byte-parallel loops go through a kernel set chosen on first use: the
+// SDES_KERNEL environment variable if set, otherwise the fastest available.
+// sdes_encrypt_byte stays the reference every kernel is checked against.
+
+static void scalar_lookup(const uint8_t *t, const uint8_t *in, uint8_t *out, size_t n) {
+    for (size_t i = 0; i < n; ++i) out[i] = t[in[i]];
+}
+
+static uint8_t scalar_cbc_decrypt(const uint8_t *dec, uint8_t chain, const uint8_t *in, uint8_t *out, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        uint8_t c = in[i];
+        out[i] = dec[c] ^ chain;
+        chain = c;
+    }
+    return chain;
+}
+
+static uint8_t scalar_ctr(const uint8_t *enc, uint8_t ctr, const uint8_t *in, uint8_t *out, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        out[i] = in[i] ^ enc[ctr];
+        ctr++; // wraps naturally
+    }
+    return ctr;
+}
+
+// Lanes are independent, so each block's lookups overlap instead of waiting
+// on one another as a single chain's do.
+static void scalar_icbc_encrypt(const uint8_t *enc, uint8_t *chain, size_t lanes,
+                                const uint8_t *in, uint8_t *out, size_t n) {
+    uint8_t c[SDES_ICBC_MAX_LANES];
+    memcpy(c, chain, lanes);
+    for (size_t i = 0; i < n; i += lanes) {
+        for (size_t l = 0; l < lanes; ++l) {
+            c[l] = enc[in[i + l] ^ c[l]];
+            out[i + l] = c[l];
+        }
+    }
+    memcpy(chain, c, lanes);
+}
+
+static void scalar_icbc_decrypt(const uint8_t *dec, uint8_t *chain, size_t lanes,
+                                const uint8_t *in, uint8_t *out, size_t n) {
+    uint8_t c[SDES_ICBC_MAX_LANES];
+    memcpy(c, chain, lanes);
+    for (size_t i = 0; i < n; i += lanes) {
+        for (size_t l = 0; l < lanes; ++l) {
+            uint8_t x = in[i + l];
+            out[i + l] = dec[x] ^ c[l];
+            c[l] = x;
+        }
+    }
+    memcpy(chain, c, lanes);
+}
+
+static const sdes_kernels_t SCALAR = { "scalar", scalar_lookup, scalar_cbc_decrypt, scalar_ctr,
+                                       scalar_icbc_encrypt, scalar_icbc_decrypt };
+static _Atomic(const sdes_kernels_t *) active_kernels;
+
+static const sdes_kernels_t *find_kernels(const char *name) {
+    if (strcmp(name, "scalar") == 0) return &SCALAR;
+    if (strcmp(name, "neon") == 0) return sdes_neon_kernels();
+    if (strcmp(name, "sve") == 0) return sdes_sve_kernels();
+    return NULL;
+}
+
+// Nanoseconds for a few ECB passes over 16 KiB; only used to rank kernels.
+// The buffer is local, as racing first callers of kernels() may both get here.
+static uint64_t time_kernels(const sdes_kernels_t *k) {
+    uint8_t buf[16384] = { 0 }, t[256];
+    for (int b = 0; b < 256; ++b) t[b] = (uint8_t)(b * 167 + 13);
+    struct timespec a, z;
+    clock_gettime(CLOCK_MONOTONIC, &a);
+    for (int r = 0; r < 16; ++r) k->lookup(t, buf, buf, sizeof(buf));
+    clock_gettime(CLOCK_MONOTONIC, &z);
+    return (uint64_t)(z.tv_sec - a.tv_sec) * 1000000000u + (uint64_t)z.tv_nsec - (uint64_t)a.tv_nsec;
+}
+
+static const sdes_kernels_t *best_kernels(void) {
+    const sdes_kernels_t *neon = sdes_neon_kernels(), *sve = sdes_sve_kernels();
+    // Narrow SVE gathers can lose to NEON's table registers, so measure.
+    if (neon && sve) return time_kernels(sve) < time_kernels(neon) ? sve : neon;
+    return sve ? sve : neon ? neon : &SCALAR;
+}
+
+// The SIMD kernels are opt-in until they have been validated on AArch64
+// hardware or qemu-user: without SDES_KERNEL the scalar loops run.
+static const sdes_kernels_t *kernels(void) {
+    const sdes_kernels_t *k = atomic_load_explicit(&active_kernels, memory_order_acquire);
+    if (!k) {
+        // Racing first callers may both choose; either answer is valid.
+        const char *env = getenv("SDES_KERNEL");
+        if (env && strcmp(env, "auto") == 0) k = best_kernels();
+        else if (env && *env) k = find_kernels(env);
+        if (!k) k = &SCALAR;
+        atomic_store_explicit(&active_kernels, k, memory_order_release);
+    }
+    return k;
+}
+
+const char *sdes_kernel_name(void) {
+    return kernels()->name;
+}
+
+int sdes_set_kernel(const char *name) {
+    const sdes_kernels_t *k = strcmp(name, "auto") == 0 ? best_kernels() : find_kernels(name);
+    if (!k) return -1;
+    atomic_store_explicit(&active_kernels, k, memory_order_release);
+    return 0;
+}
+
+void sdes_stream_init(sdes_stream_t *s, const sdes_ctx_t *ctx, sdes_mode_t mode,
+                      bool encrypt, uint8_t iv_or_nonce) {
+    s->ctx = ctx;
+    s->mode = mode;
+    s->encrypt = encrypt;
+    s->chain = mode == MODE_ECB ? 0 : iv_or_nonce; // ECB partial bytes use E(0) whatever the IV
+    s->lanes = 0;
+    if (mode == MODE_ICBC) sdes_stream_set_lanes(s, SDES_ICBC_LANES);
+}
+
+int sdes_stream_set_lanes(sdes_stream_t *s, unsigned lanes) {
+    if (lanes != 16 && lanes != 32 && lanes != 64) return -1;
+    s->lanes = (uint8_t)lanes;
+    s->lane = 0;
+    for (unsigned l = 0; l < lanes; ++l) s->lane_chain[l] = sdes_derive_iv(s->ctx, s->chain, l);
+    return 0;
+}
+
+// ICBC byte by byte, for the parts of a call that don't fill whole blocks.
+static void icbc_bytes(sdes_stream_t *s, const uint8_t *in, uint8_t *out, size_t n) {
+    const uint8_t *enc = s->ctx->enc, *dec = s->ctx->dec;
+    for (size_t i = 0; i < n; ++i) {
+        uint8_t *c = &s->lane_chain[s->lane];
+        if (s->encrypt) {
+            *c = enc[in[i] ^ *c];
+            out[i] = *c;
+        } else {
+            uint8_t x = in[i];
+            out[i] = dec[x] ^ *c;
+            *c = x;
+        }
+        if (++s->lane == s->lanes) s->lane = 0;
+    }
+}
+
+// --- Uniform-run fast paths ---
+// Flat image regions feed the same plaintext byte p many times in a row.
+// CBC then iterates x -> E(p ^ x) over 256 values, so its output enters a
+// cycle within 256 steps; CTR output p ^ E(ctr) repeats every 256 bytes.
+// Once the cycle is known the rest of the run is filled by copying it.
+
+#define RUN_MIN  128
+#define RUN_STEP 64     // run checks happen at most once per RUN_STEP bytes
+
+// True if a run of at least RUN_MIN equal bytes starts at in[0].
+static int long_run_at(const uint8_t *in, size_t n) {
+    if (n < RUN_MIN || in[0] != in[RUN_MIN - 1]) return 0;
+    for (size_t k = 1; k < RUN_MIN - 1; ++k)
+        if (in[k] != in[0]) return 0;
+    return 1;
+}
+
+// Fill out[done..n) given that out[j] == out[j - period] for j >= base + period.
+static void replicate(uint8_t *out, size_t base, size_t period, size_t done, size_t n) {
+    while (done < n) {
+        size_t span = ((done - base) / period) * period;   // whole cycles available
+        size_t c = n - done < span ? n - done : span;
+        memcpy(out + done, out + done - span, c);
+        done += c;
+    }
+}
+
+// CBC-encrypt a run of n copies of p starting from chain; returns the new chain.
+static uint8_t cbc_encrypt_run(const uint8_t *enc, uint8_t p, uint8_t chain, uint8_t *out, size_t n) {
+    int16_t seen[256];
+    memset(seen, 0xFF, sizeof(seen));
+    for (size_t k = 0; k < n; ++k) {
+        chain = enc[p ^ chain];
+        out[k] = chain;
+        if (seen[chain] >= 0) {
+            size_t base = (size_t)seen[chain];
+            replicate(out, base, k - base, k + 1, n);
+            return out[n - 1];
+        }
+        seen[chain] = (int16_t)k;
+    }
+    return chain;
+}
+
+// CTR over a run of n copies of p; returns the new counter.
+static uint8_t ctr_run(const uint8_t *enc, uint8_t p, uint8_t ctr, uint8_t *out, size_t n) {
+    size_t m = n < 256 ? n : 256;
+    for (size_t k = 0; k < m; ++k) out[k] = p ^ enc[(uint8_t)(ctr + k)];
+    if (n > 256) replicate(out, 0, 256, 256, n);
+    return (uint8_t)(ctr + n);
+}
+
+// Length of the run of equal bytes starting at in[0] (n > 0).
+static size_t run_length(const uint8_t *in, size_t n) {
+    uint64_t pat = 0x0101010101010101ull * in[0], w;
+    size_t r = 1;
+    while (r + 8 <= n) {
+        memcpy(&w, in + r, 8);
+        if (w != pat) break;
+        r += 8;
+    }
+    while (r < n && in[r] == in[0]) r++;
+    return r;
+}
+
+void sdes_stream_process(sdes_stream_t *s, const uint8_t *in, uint8_t *out, size_t n) {
+    const uint8_t *enc = s->ctx->enc;
+    const uint8_t *dec = s->ctx->dec;
+    const sdes_kernels_t *k = kernels();
+    uint8_t chain = s->chain;
+
+    if (s->mode == MODE_ECB) {
+        k->lookup(s->encrypt ? enc : dec, in, out, n);
+    } else if (s->mode == MODE_CBC) {
+        if (s->encrypt) {
+            size_t i = 0;
+            while (i < n) {
+                if (long_run_at(in + i, n - i)) {
+                    size_t r = run_length(in + i, n - i);
+                    chain = cbc_encrypt_run(enc, in[i], chain, out + i, r);
+                    i += r;
+                    continue;
+                }
+                size_t end = n - i > RUN_STEP ? i + RUN_STEP : n;
+                for (; i < end; ++i) {
+                    chain = enc[in[i] ^ chain];
+                    out[i] = chain;
+                }
+            }
+        } else {
+            chain = k->cbc_decrypt(dec, chain, in, out, n);
+        }
+    } else if (s->mode == MODE_ICBC) {
+        // Finish the block in progress, whole blocks through the kernel, then the rest.
+        size_t head = s->lane ? s->lanes - s->lane : 0;
+        if (head > n) head = n;
+        icbc_bytes(s, in, out, head);
+        size_t whole = (n - head) / s->lanes * s->lanes;
+        if (whole) {
+            if (s->encrypt) k->icbc_encrypt(enc, s->lane_chain, s->lanes, in + head, out + head, whole);
+            else k->icbc_decrypt(dec, s->lane_chain, s->lanes, in + head, out + head, whole);
+        }
+        icbc_bytes(s, in + head + whole, out + head + whole, n - head - whole);
+    } else { // CTR (same for enc/dec)
+        size_t i = 0;
+        while (i < n) {
+            if (long_run_at(in + i, n - i)) {
+                size_t r = run_length(in + i, n - i);
+                chain = ctr_run(enc, in[i], chain, out + i, r);
+                i += r;
+                continue;
+            }
+            // Hand the kernel everything up to the next run, checked at the
+            // same RUN_STEP boundaries as a segment-at-a-time loop would.
+            size_t end = i;
+            do {
+                end = n - end > RUN_STEP ? end + RUN_STEP : n;
+            } while (end < n && !long_run_at(in + end, n - end));
+            chain = k->ctr(enc, chain, in + i, out + i, end - i);
+            i = end;
+        }
+    }
+    s->chain = chain;
+}
+
+uint8_t sdes_stream_partial(sdes_stream_t *s, uint8_t in, uint8_t mask) {
+    if (s->mode == MODE_ICBC) {
+        uint8_t *c = &s->lane_chain[s->lane];
+        uint8_t out = in ^ (s->ctx->enc[*c] & mask);
+        *c = s->encrypt ? out : in;
+        if (++s->lane == s->lanes) s->lane = 0;
+        return out;
+    }
+    uint8_t ks = s->ctx->enc[s->chain];
+    uint8_t out = in ^ (ks & mask);
+    if (s->mode == MODE_CTR) s->chain++;
+    else if (s->mode == MODE_CBC) s->chain = s->encrypt ? out : in; // ciphertext byte
+    return out;
+}
+
+// --- Scatter-gather batch API ---
+
+#define IOV_LANES 8
+
+// CBC encryption of up to IOV_LANES buffers with their chains advanced in lockstep.
+static void cbc_encrypt_multi(const uint8_t *enc, const sdes_iov_t **v, int k) {
+    const uint8_t *in[IOV_LANES];
+    uint8_t *out[IOV_LANES];
+    size_t left[IOV_LANES];
+    uint8_t chain[IOV_LANES];
+    for (int l = 0; l < k; ++l) {
+        in[l] = v[l]->in;
+        out[l] = v[l]->out;
+        left[l] = v[l]->len;
+        chain[l] = v[l]->iv;
+    }
+    while (k > 0) {
+        size_t m = left[0];
+        for (int l = 1; l < k; ++l) if (left[l] < m) m = left[l];
+        for (size_t i = 0; i < m; ++i) {
+            for (int l = 0; l < k; ++l) {
+                chain[l] = enc[in[l][i] ^ chain[l]];
+                out[l][i] = chain[l];
+            }
+        }
+        // Advance and drop finished lanes (swap-remove).
+        for (int l = 0; l < k; ) {
+            in[l] += m; out[l] += m; left[l] -= m;
+            if (left[l] == 0) {
+                --k;
+                in[l] = in[k]; out[l] = out[k]; left[l] = left[k]; chain[l] = chain[k];
+            } else {
+                ++l;
+            }
+        }
+    }
+}
+
+void sdes_process_iov(const sdes_ctx_t *ctx, bool encrypt, const sdes_iov_t *iov, size_t n) {
+    const uint8_t *enc = ctx->enc;
+    const uint8_t *dec = ctx->dec;
+    const sdes_kernels_t *k = kernels();
+    const sdes_iov_t *cbc[IOV_LANES];
+    int ncbc = 0;
+
+    for (size_t j = 0; j < n; ++j) {
+        const sdes_iov_t *v = &iov[j];
+        const uint8_t *in = v->in;
+        uint8_t *out = v->out;
+        size_t len = v->len;
+        if (len == 0) continue;
+
+        if (v->mode == MODE_ECB) {
+            k->lookup(encrypt ? enc : dec, in, out, len);
+        } else if (v->mode == MODE_CTR) {
+            k->ctr(enc, v->iv, in, out, len);
+        } else if (v->mode == MODE_ICBC) {
+            sdes_stream_t st;
+            sdes_stream_init(&st, ctx, MODE_ICBC, encrypt, v->iv);
+            if (v->lanes) sdes_stream_set_lanes(&st, v->lanes);
+            sdes_stream_process(&st, in, out, len);
+        } else if (!encrypt) {
+            // CBC decryption has no serial dependency: P[i] = D(C[i]) ^ C[i-1].
+            k->cbc_decrypt(dec, v->iv, in, out, len);
+        } else {
+            cbc[ncbc++] = v;
+            if (ncbc == IOV_LANES) {
+                cbc_encrypt_multi(enc, cbc, ncbc);
+                ncbc = 0;
+            }
+        }
+    }
+    if (ncbc) cbc_encrypt_multi(enc, cbc, ncbc);
+}
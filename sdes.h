@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -19,7 +20,85 @@ uint8_t sdes_decrypt_byte(uint8_t in, uint8_t K1, uint8_t K2);
 int sdes_parse_key10_bits(const char *bits, uint16_t *out_key10);
 
 // Modes
-typedef enum { MODE_ECB = 0, MODE_CBC = 1, MODE_CTR = 2 } sdes_mode_t;
+typedef enum { MODE_ECB = 0, MODE_CBC = 1, MODE_CTR = 2, MODE_ICBC = 3 } sdes_mode_t;
+#define SDES_MODE_COUNT 4
+
+// Interleaved CBC (MODE_ICBC): byte i belongs to chain i % lanes, and chain l
+// starts from sdes_derive_iv(iv, l). Each block of `lanes` bytes depends only
+// on the block before it, so both directions run at full SIMD width.
+#define SDES_ICBC_LANES 16      // default lane count; 16, 32 and 64 are valid
+#define SDES_ICBC_MAX_LANES 64
+
+// --- Bulk API ---
+// S-DES has only 256 possible blocks, so a key is fully described by its
+// forward and inverse substitution tables. Build them once per key.
+typedef struct {
+    uint8_t K1, K2;
+    uint8_t enc[256];
+    uint8_t dec[256];
+} sdes_ctx_t;
+
+void sdes_ctx_init(sdes_ctx_t *ctx, uint16_t key10);
+
+// Derive the IV/nonce for sub-stream `index` (pyramid level, lane, ...) from a
+// base IV: index 0 keeps the base, others use E(iv ^ index).
+uint8_t sdes_derive_iv(const sdes_ctx_t *ctx, uint8_t iv, unsigned index);
+
+// State for one pass over a byte stream. Feeding the stream in pieces of any
+// size gives the same result as a single call over the whole stream.
+typedef struct {
+    const sdes_ctx_t *ctx;
+    sdes_mode_t mode;
+    bool encrypt;
+    uint8_t chain;   // CBC: previous ciphertext byte; CTR: next counter value; ICBC: IV
+    uint8_t lanes;   // ICBC: number of chains
+    uint8_t lane;    // ICBC: chain of the next byte
+    uint8_t lane_chain[SDES_ICBC_MAX_LANES]; // ICBC: previous ciphertext byte per chain
+} sdes_stream_t;
+
+void sdes_stream_init(sdes_stream_t *s, const sdes_ctx_t *ctx, sdes_mode_t mode,
+                      bool encrypt, uint8_t iv_or_nonce);
+
+// ICBC: use `lanes` chains (16, 32 or 64; SDES_ICBC_LANES after init) and
+// restart them from the IV. Returns -1 for any other lane count.
+int sdes_stream_set_lanes(sdes_stream_t *s, unsigned lanes);
+
+// Transform n bytes from in to out (in == out is allowed).
+void sdes_stream_process(sdes_stream_t *s, const uint8_t *in, uint8_t *out, size_t n);
+
+// Transform only the bits of one byte selected by mask; the others pass through.
+// Used for a partial final byte (e.g. the last pixels of a packed 1/4-bit row):
+// the selected bits are XORed with a keystream byte, E(counter) for CTR,
+// E(chain) for CBC (residual-block termination) and E(0) for ECB, which
+// ignores the IV, so it stays invertible.
+uint8_t sdes_stream_partial(sdes_stream_t *s, uint8_t in, uint8_t mask);
+
+// --- Scatter-gather batch API ---
+// One descriptor per independent buffer; each starts its own chain/counter at iv.
+typedef struct {
+    const uint8_t *in;
+    uint8_t *out;       // may equal in
+    size_t len;
+    sdes_mode_t mode;
+    uint8_t iv;         // CBC/ICBC IV or CTR nonce/start; ignored for ECB
+    uint8_t lanes;      // ICBC lane count; 0 (or invalid) = SDES_ICBC_LANES
+} sdes_iov_t;
+
+// Transform every descriptor under one key in a single call. CBC encryption,
+// the only serial case, runs several buffers' chains interleaved so their
+// table lookups overlap instead of waiting on each other.
+void sdes_process_iov(const sdes_ctx_t *ctx, bool encrypt, const sdes_iov_t *iov, size_t n);
+
+// --- Kernels ---
+// ECB, CBC decryption, CTR and ICBC can run on SIMD kernels (NEON or SVE on
+// AArch64). They are opt-in for now: the scalar loops run unless
+// SDES_KERNEL=neon|sve|auto is set (auto picks the fastest the CPU has) or
+// sdes_set_kernel() is called. Results never depend on the kernel.
+const char *sdes_kernel_name(void);
+
+// Switch kernels ("scalar", "neon", "sve" or "auto"). Returns -1 if the name
+// is unknown or this CPU/build lacks that kernel.
+int sdes_set_kernel(const char *name);
 
 #ifdef __cplusplus
 }
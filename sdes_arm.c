@@ -0,0 +1,227 @@
+// AArch64 kernels for the table-driven modes.
+//
+// NEON: a 256-entry table is held in 16 q registers. TBL looks up indices
+// 0..63 from the first four; each TBX then handles the next 64 after the
+// index is lowered by 64 (lanes out of range keep what they have), so four
+// instructions substitute 16 bytes.
+//
+// SVE: bytes are widened to 32-bit lanes and substituted with a gather load
+// from the table, at whatever vector length the CPU has. CBC decryption
+// shifts the previous ciphertext byte in with INSR. Interleaved CBC works
+// block by block, a block being one byte of every lane.
+
+#include "sdes_kernels.h"
+#include <string.h>
+
+#if defined(__aarch64__)
+
+#include <arm_neon.h>
+#ifdef __linux__
+#include <sys/auxv.h>
+#endif
+#ifndef HWCAP_ASIMD
+#define HWCAP_ASIMD (1 << 1)
+#endif
+#ifndef HWCAP_SVE
+#define HWCAP_SVE (1 << 22)
+#endif
+
+static unsigned long hwcaps(void) {
+#ifdef __linux__
+    return getauxval(AT_HWCAP);
+#else
+    return HWCAP_ASIMD; // Advanced SIMD is mandatory on AArch64
+#endif
+}
+
+typedef struct { uint8x16x4_t q[4]; } neon_table_t;
+
+static inline void neon_load_table(neon_table_t *t, const uint8_t *tab) {
+    for (int k = 0; k < 4; ++k)
+        for (int j = 0; j < 4; ++j) t->q[k].val[j] = vld1q_u8(tab + 64 * k + 16 * j);
+}
+
+static inline uint8x16_t neon_lookup16(const neon_table_t *t, uint8x16_t idx) {
+    const uint8x16_t k64 = vdupq_n_u8(64);
+    uint8x16_t r = vqtbl4q_u8(t->q[0], idx);
+    idx = vsubq_u8(idx, k64);
+    r = vqtbx4q_u8(r, t->q[1], idx);
+    idx = vsubq_u8(idx, k64);
+    r = vqtbx4q_u8(r, t->q[2], idx);
+    idx = vsubq_u8(idx, k64);
+    return vqtbx4q_u8(r, t->q[3], idx);
+}
+
+static void neon_lookup(const uint8_t *tab, const uint8_t *in, uint8_t *out, size_t n) {
+    neon_table_t t;
+    neon_load_table(&t, tab);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) vst1q_u8(out + i, neon_lookup16(&t, vld1q_u8(in + i)));
+    for (; i < n; ++i) out[i] = tab[in[i]];
+}
+
+static uint8_t neon_cbc_decrypt(const uint8_t *dec, uint8_t chain, const uint8_t *in, uint8_t *out, size_t n) {
+    neon_table_t t;
+    neon_load_table(&t, dec);
+    uint8x16_t last = vdupq_n_u8(chain);
+    size_t i = 0;
+    // Ciphertext is loaded before the store, so in-place works.
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t c = vld1q_u8(in + i);
+        uint8x16_t prev = vextq_u8(last, c, 15); // last[15], c[0..14]
+        vst1q_u8(out + i, veorq_u8(neon_lookup16(&t, c), prev));
+        last = c;
+    }
+    if (i) chain = vgetq_lane_u8(last, 15);
+    for (; i < n; ++i) {
+        uint8_t c = in[i];
+        out[i] = dec[c] ^ chain;
+        chain = c;
+    }
+    return chain;
+}
+
+static uint8_t neon_ctr(const uint8_t *enc, uint8_t ctr, const uint8_t *in, uint8_t *out, size_t n) {
+    static const uint8_t IOTA[16] = {0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15};
+    neon_table_t t;
+    neon_load_table(&t, enc);
+    uint8x16_t ctrv = vaddq_u8(vdupq_n_u8(ctr), vld1q_u8(IOTA));
+    const uint8x16_t k16 = vdupq_n_u8(16);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        vst1q_u8(out + i, veorq_u8(vld1q_u8(in + i), neon_lookup16(&t, ctrv)));
+        ctrv = vaddq_u8(ctrv, k16);
+    }
+    ctr = (uint8_t)(ctr + i);
+    for (; i < n; ++i) out[i] = in[i] ^ enc[ctr++];
+    return ctr;
+}
+
+// Interleaved CBC: one q register per 16 lanes, all chains advanced per block.
+static void neon_icbc_encrypt(const uint8_t *enc, uint8_t *chain, size_t lanes,
+                              const uint8_t *in, uint8_t *out, size_t n) {
+    neon_table_t t;
+    neon_load_table(&t, enc);
+    uint8x16_t c[4];
+    size_t groups = lanes / 16;
+    for (size_t g = 0; g < groups; ++g) c[g] = vld1q_u8(chain + 16 * g);
+    for (size_t i = 0; i < n; i += lanes) {
+        for (size_t g = 0; g < groups; ++g) {
+            c[g] = neon_lookup16(&t, veorq_u8(vld1q_u8(in + i + 16 * g), c[g]));
+            vst1q_u8(out + i + 16 * g, c[g]);
+        }
+    }
+    for (size_t g = 0; g < groups; ++g) vst1q_u8(chain + 16 * g, c[g]);
+}
+
+static void neon_icbc_decrypt(const uint8_t *dec, uint8_t *chain, size_t lanes,
+                              const uint8_t *in, uint8_t *out, size_t n) {
+    neon_table_t t;
+    neon_load_table(&t, dec);
+    uint8x16_t c[4];
+    size_t groups = lanes / 16;
+    for (size_t g = 0; g < groups; ++g) c[g] = vld1q_u8(chain + 16 * g);
+    for (size_t i = 0; i < n; i += lanes) {
+        for (size_t g = 0; g < groups; ++g) {
+            uint8x16_t x = vld1q_u8(in + i + 16 * g);
+            vst1q_u8(out + i + 16 * g, veorq_u8(neon_lookup16(&t, x), c[g]));
+            c[g] = x;
+        }
+    }
+    for (size_t g = 0; g < groups; ++g) vst1q_u8(chain + 16 * g, c[g]);
+}
+
+static const sdes_kernels_t NEON = { "neon", neon_lookup, neon_cbc_decrypt, neon_ctr,
+                                     neon_icbc_encrypt, neon_icbc_decrypt };
+
+const sdes_kernels_t *sdes_neon_kernels(void) {
+    return (hwcaps() & HWCAP_ASIMD) ? &NEON : NULL;
+}
+
+// SVE kernels are only built when the compiler targets SVE (for example
+// -march=armv8.2-a+sve), and still only run when HWCAP_SVE says so.
+#if defined(__ARM_FEATURE_SVE)
+#define HAVE_SVE_KERNELS 1
+#include <arm_sve.h>
+
+static void sve_lookup(const uint8_t *tab, const uint8_t *in, uint8_t *out, size_t n) {
+    for (uint64_t i = 0; i < n; i += svcntw()) {
+        svbool_t pg = svwhilelt_b32_u64(i, n);
+        svuint32_t idx = svld1ub_u32(pg, in + i);
+        svst1b_u32(pg, out + i, svld1ub_gather_u32offset_u32(pg, tab, idx));
+    }
+}
+
+static uint8_t sve_cbc_decrypt(const uint8_t *dec, uint8_t chain, const uint8_t *in, uint8_t *out, size_t n) {
+    for (uint64_t i = 0; i < n; i += svcntw()) {
+        svbool_t pg = svwhilelt_b32_u64(i, n);
+        svuint32_t c = svld1ub_u32(pg, in + i);
+        svuint32_t prev = svinsr_n_u32(c, chain); // chain, c[0], c[1], ...
+        svuint32_t p = sveor_u32_x(pg, svld1ub_gather_u32offset_u32(pg, dec, c), prev);
+        chain = (uint8_t)svlastb_u32(pg, c);
+        svst1b_u32(pg, out + i, p);
+    }
+    return chain;
+}
+
+static uint8_t sve_ctr(const uint8_t *enc, uint8_t ctr, const uint8_t *in, uint8_t *out, size_t n) {
+    for (uint64_t i = 0; i < n; i += svcntw()) {
+        svbool_t pg = svwhilelt_b32_u64(i, n);
+        svuint32_t idx = svand_n_u32_x(pg, svindex_u32((uint32_t)ctr + (uint32_t)i, 1), 0xFF);
+        svuint32_t ks = svld1ub_gather_u32offset_u32(pg, enc, idx);
+        svst1b_u32(pg, out + i, sveor_u32_x(pg, svld1ub_u32(pg, in + i), ks));
+    }
+    return (uint8_t)(ctr + n);
+}
+
+// Interleaved CBC: the previous block is the chain for the first block and
+// out[i - lanes] after that, since ciphertext is what encryption writes.
+static void sve_icbc_encrypt(const uint8_t *enc, uint8_t *chain, size_t lanes,
+                             const uint8_t *in, uint8_t *out, size_t n) {
+    for (size_t i = 0; i < n; i += lanes) {
+        const uint8_t *prev = i ? out + i - lanes : chain;
+        for (uint64_t j = 0; j < lanes; j += svcntw()) {
+            svbool_t pg = svwhilelt_b32_u64(j, lanes);
+            svuint32_t x = sveor_u32_x(pg, svld1ub_u32(pg, in + i + j), svld1ub_u32(pg, prev + j));
+            svst1b_u32(pg, out + i + j, svld1ub_gather_u32offset_u32(pg, enc, x));
+        }
+    }
+    if (n) memcpy(chain, out + n - lanes, lanes);
+}
+
+// Decryption needs the previous ciphertext block, which an in-place call
+// overwrites; going back to front keeps it intact until it is used.
+static void sve_icbc_decrypt(const uint8_t *dec, uint8_t *chain, size_t lanes,
+                             const uint8_t *in, uint8_t *out, size_t n) {
+    uint8_t last[64];
+    if (n) memcpy(last, in + n - lanes, lanes);
+    for (size_t i = n; i > 0; ) {
+        i -= lanes;
+        const uint8_t *prev = i ? in + i - lanes : chain;
+        for (uint64_t j = 0; j < lanes; j += svcntw()) {
+            svbool_t pg = svwhilelt_b32_u64(j, lanes);
+            svuint32_t p = svld1ub_gather_u32offset_u32(pg, dec, svld1ub_u32(pg, in + i + j));
+            svst1b_u32(pg, out + i + j, sveor_u32_x(pg, p, svld1ub_u32(pg, prev + j)));
+        }
+    }
+    if (n) memcpy(chain, last, lanes);
+}
+
+static const sdes_kernels_t SVE = { "sve", sve_lookup, sve_cbc_decrypt, sve_ctr,
+                                    sve_icbc_encrypt, sve_icbc_decrypt };
+#endif // SVE
+
+const sdes_kernels_t *sdes_sve_kernels(void) {
+#ifdef HAVE_SVE_KERNELS
+    return (hwcaps() & HWCAP_SVE) ? &SVE : NULL;
+#else
+    return NULL;
+#endif
+}
+
+#else // !__aarch64__
+
+const sdes_kernels_t *sdes_neon_kernels(void) { return NULL; }
+const sdes_kernels_t *sdes_sve_kernels(void) { return NULL; }
+
+#endif
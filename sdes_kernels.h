@@ -0,0 +1,33 @@
+#ifndef SDES_KERNELS_H
+#define SDES_KERNELS_H
+
+// Internal to the library: the inner loops of ECB, CBC decryption, CTR and
+// interleaved CBC, which have no serial dependency across a vector and so
+// have SIMD versions on some CPUs.
+// sdes.c picks one set at run time. Every kernel allows in == out.
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    const char *name;
+    // out[i] = t[in[i]]
+    void (*lookup)(const uint8_t *t, const uint8_t *in, uint8_t *out, size_t n);
+    // out[i] = dec[in[i]] ^ in[i - 1], with in[-1] = chain; returns in[n - 1]
+    uint8_t (*cbc_decrypt)(const uint8_t *dec, uint8_t chain, const uint8_t *in, uint8_t *out, size_t n);
+    // out[i] = in[i] ^ enc[(uint8_t)(ctr + i)]; returns ctr + n
+    uint8_t (*ctr)(const uint8_t *enc, uint8_t ctr, const uint8_t *in, uint8_t *out, size_t n);
+    // Interleaved CBC over whole blocks (n a multiple of lanes, lanes 16/32/64):
+    // encrypt c[i] = enc[in[i] ^ c[i - lanes]], decrypt out[i] = dec[in[i]] ^ in[i - lanes],
+    // with chain[] standing for the block before in[0]; chain[] is updated.
+    void (*icbc_encrypt)(const uint8_t *enc, uint8_t *chain, size_t lanes,
+                         const uint8_t *in, uint8_t *out, size_t n);
+    void (*icbc_decrypt)(const uint8_t *dec, uint8_t *chain, size_t lanes,
+                         const uint8_t *in, uint8_t *out, size_t n);
+} sdes_kernels_t;
+
+// AArch64 kernels (sdes_arm.c); NULL when the CPU or build lacks them.
+const sdes_kernels_t *sdes_neon_kernels(void);
+const sdes_kernels_t *sdes_sve_kernels(void);
+
+#endif // SDES_KERNELS_H
@@ -0,0 +1,15 @@
+# Build the Python extension from the same C sources as bmper:
+#   python3 setup.py build_ext --inplace     (or: pip install .)
+from setuptools import setup, Extension
+
+setup(
+    name="sdes",
+    version="1.0",
+    description="S-DES ECB/CBC/CTR/ICBC over buffers and in-memory BMP files",
+    ext_modules=[Extension(
+        "sdes",
+        sources=["python/sdesmodule.c", "sdes.c", "sdes_arm.c", "bmpmem.c"],
+        include_dirs=["."],
+        extra_compile_args=["-O2"],
+    )],
+)
@@ -0,0 +1,40 @@
+#include "stats.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+bmper_stats_t *bmper_stats = NULL;
+static char shm_name[256];
+
+int stats_open(const char *name) {
+    if (name[0] == '/') snprintf(shm_name, sizeof(shm_name), "%s", name);
+    else snprintf(shm_name, sizeof(shm_name), "/%s", name);
+
+    int fd = shm_open(shm_name, O_CREAT | O_RDWR, 0644);
+    if (fd < 0) return -1;
+    if (ftruncate(fd, sizeof(bmper_stats_t)) != 0) { close(fd); return -1; }
+    void *p = mmap(NULL, sizeof(bmper_stats_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return -1;
+
+    bmper_stats_t *s = (bmper_stats_t*)p;
+    memset(s, 0, sizeof(*s));
+    s->version = BMPER_STATS_VERSION;
+    s->size = sizeof(*s);
+    s->pid = (uint32_t)getpid();
+    s->start_ns = stats_now_ns();
+    // Publish the magic last so readers never see a half-initialised page.
+    atomic_thread_fence(memory_order_release);
+    s->magic = BMPER_STATS_MAGIC;
+    bmper_stats = s;
+    return 0;
+}
+
+void stats_close(void) {
+    if (!bmper_stats) return;
+    munmap(bmper_stats, sizeof(bmper_stats_t));
+    bmper_stats = NULL;
+    shm_unlink(shm_name);
+}
@@ -0,0 +1,49 @@
+#ifndef STATS_H
+#define STATS_H
+
+// Live counters published in a POSIX shared-memory segment for bmper-top.
+// Writers use relaxed atomic adds on block/file granularity only, and every
+// update is skipped with a single pointer test when publishing is off.
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#define BMPER_STATS_MAGIC   0x53504D42u   // "BMPS"
+#define BMPER_STATS_VERSION 2u
+
+enum { STAGE_READ = 0, STAGE_TRANSFORM = 1, STAGE_WRITE = 2, STAGE_COUNT = 3 };
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;                      // sizeof(bmper_stats_t), for forward compatibility
+    uint32_t pid;
+    uint64_t start_ns;                  // CLOCK_MONOTONIC at open
+    _Atomic uint64_t bytes_in[4];       // payload bytes read, indexed by sdes_mode_t
+    _Atomic uint64_t bytes_out[4];      // payload bytes written, indexed by sdes_mode_t
+    _Atomic uint64_t files_done;
+    _Atomic uint64_t errors;
+    _Atomic uint64_t queue_depth;       // files waiting to be processed
+    _Atomic uint64_t busy_ns[STAGE_COUNT];
+} bmper_stats_t;
+
+// NULL unless stats_open() succeeded.
+extern bmper_stats_t *bmper_stats;
+
+// Create (or reuse) segment "name" ("/" is prepended if missing). 0 on success.
+int stats_open(const char *name);
+// Unmap and unlink the segment.
+void stats_close(void);
+
+static inline uint64_t stats_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static inline void stats_add(_Atomic uint64_t *c, uint64_t v) {
+    atomic_fetch_add_explicit(c, v, memory_order_relaxed);
+}
+
+#endif // STATS_H
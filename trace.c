@@ -0,0 +1,148 @@
+#include "trace.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TRACE_MAX_RINGS 256     // threads alive at once; more are not traced
+
+typedef struct {
+    const char *name;
+    uint64_t t0, t1, arg;
+    char detail[TRACE_DETAIL];
+} trace_ev_t;
+
+typedef struct {
+    trace_ev_t *ev;
+    uint64_t head;              // events recorded; the newest TRACE_RING are kept
+    char name[32];
+    int tid;                    // track id in the output
+    int in_use;                 // owned by a live thread
+} trace_ring_t;
+
+int trace_on = 0;
+
+static FILE *trace_out;
+static uint64_t trace_t0;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t trace_key;
+static trace_ring_t *rings[TRACE_MAX_RINGS];
+static int nrings;
+static __thread trace_ring_t *my_ring;
+static __thread int my_ring_failed;
+
+// Thread exit: the ring (and its events) goes to the next thread of that name.
+static void release_ring(void *r) {
+    pthread_mutex_lock(&trace_lock);
+    ((trace_ring_t*)r)->in_use = 0;
+    pthread_mutex_unlock(&trace_lock);
+}
+
+int trace_start(const char *path) {
+    trace_out = fopen(path, "w");
+    if (!trace_out || pthread_key_create(&trace_key, release_ring) != 0) return -1;
+    trace_t0 = trace_now();
+    trace_on = 1;
+    trace_thread("main");
+    return 0;
+}
+
+// A free ring of a thread with the same name is reused, so short-lived
+// threads (one gzip writer per batch file) share a track per role.
+static trace_ring_t *get_ring(const char *name) {
+    if (my_ring || my_ring_failed) return my_ring;
+    trace_ring_t *r = NULL;
+    pthread_mutex_lock(&trace_lock);
+    for (int i = 0; i < nrings && !r; ++i)
+        if (!rings[i]->in_use && strcmp(rings[i]->name, name) == 0) r = rings[i];
+    if (!r && nrings < TRACE_MAX_RINGS && (r = (trace_ring_t*)calloc(1, sizeof(*r))) != NULL) {
+        r->ev = (trace_ev_t*)malloc(TRACE_RING * sizeof(*r->ev));
+        if (r->ev) {
+            snprintf(r->name, sizeof(r->name), "%s", name);
+            r->tid = nrings + 1;
+            rings[nrings++] = r;
+        } else {
+            free(r);
+            r = NULL;
+        }
+    }
+    for (int i = 0; i < nrings && !r; ++i)
+        if (!rings[i]->in_use) r = rings[i];
+    if (r) r->in_use = 1;
+    pthread_mutex_unlock(&trace_lock);
+    if (r) pthread_setspecific(trace_key, r);
+    else my_ring_failed = 1;
+    return my_ring = r;
+}
+
+void trace_thread(const char *name) {
+    if (!trace_on) return;
+    trace_ring_t *r = get_ring(name);
+    if (r) snprintf(r->name, sizeof(r->name), "%s", name);
+}
+
+void trace_span(const char *name, const char *detail, uint64_t t0, uint64_t t1, uint64_t arg) {
+    trace_ring_t *r = trace_on ? get_ring("") : NULL;
+    if (!r) return;
+    trace_ev_t *e = &r->ev[r->head++ % TRACE_RING];
+    e->name = name;
+    e->t0 = t0;
+    e->t1 = t1;
+    e->arg = arg;
+    e->detail[0] = '\0';
+    if (detail) {
+        // Keep the end of long paths: the file name is the useful part.
+        size_t n = strlen(detail);
+        if (n >= TRACE_DETAIL) detail += n - (TRACE_DETAIL - 1);
+        while ((*detail & 0xC0) == 0x80) detail++;  // not mid UTF-8 sequence
+        memcpy(e->detail, detail, strlen(detail) + 1);
+    }
+}
+
+static void put_json_text(FILE *f, const char *s) {
+    for (; *s; ++s) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') fprintf(f, "\\%c", c);
+        else if (c < 0x20) fprintf(f, "\\u%04x", c);
+        else fputc(c, f);
+    }
+}
+
+void trace_finish(void) {
+    if (!trace_on) return;
+    trace_on = 0;
+    FILE *f = trace_out;
+    int pid = (int)getpid();
+    uint64_t dropped = 0;
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", f);
+    fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"bmper\"}}", pid);
+    for (int i = 0; i < nrings; ++i) {
+        trace_ring_t *r = rings[i];
+        fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"", pid, r->tid);
+        put_json_text(f, r->name[0] ? r->name : "thread");
+        fputs("\"}}", f);
+        uint64_t first = r->head > TRACE_RING ? r->head - TRACE_RING : 0;
+        dropped += first;
+        for (uint64_t k = first; k < r->head; ++k) {
+            const trace_ev_t *e = &r->ev[k % TRACE_RING];
+            uint64_t t0 = e->t0 > trace_t0 ? e->t0 - trace_t0 : 0, t1 = e->t1 > e->t0 ? e->t1 - e->t0 : 0;
+            fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"bmper\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,"
+                       "\"ts\":%llu.%03u,\"dur\":%llu.%03u", e->name, pid, r->tid,
+                    (unsigned long long)(t0 / 1000), (unsigned)(t0 % 1000),
+                    (unsigned long long)(t1 / 1000), (unsigned)(t1 % 1000));
+            if (e->arg || e->detail[0]) {
+                fputs(",\"args\":{", f);
+                if (e->arg) fprintf(f, "\"bytes\":%llu%s", (unsigned long long)e->arg, e->detail[0] ? "," : "");
+                if (e->detail[0]) { fputs("\"file\":\"", f); put_json_text(f, e->detail); fputc('"', f); }
+                fputc('}', f);
+            }
+            fputc('}', f);
+        }
+        free(r->ev);
+        free(r);
+    }
+    fprintf(f, "\n],\"otherData\":{\"dropped_events\":\"%llu\"}}\n", (unsigned long long)dropped);
+    if (fclose(f) != 0) perror("write trace");
+    nrings = 0;
+}
@@ -0,0 +1,59 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// Opt-in timeline of what every thread was doing, exported as Chrome trace
+// events (JSON) for Perfetto or chrome://tracing. Spans go into a per-thread
+// ring of TRACE_RING events, allocated when the thread records its first span
+// and handed to the next thread of the same name when it exits. When a ring
+// wraps its oldest spans are dropped (the count is written with the trace).
+// Spans on one thread must nest.
+//
+// Disabled, every hook is one branch on trace_on. Enabled, a span costs two
+// clock reads and a store into the thread's own ring, no locks.
+
+#include <stdint.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TRACE_RING (1u << 15)   // events per thread
+#define TRACE_DETAIL 40         // bytes of detail text kept per event
+
+extern int trace_on;            // set by trace_start() before any thread starts
+
+static inline uint64_t trace_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// Start recording; the trace is written to path by trace_finish(). Returns 0,
+// or -1 if path can't be created.
+int trace_start(const char *path);
+// Write the trace and stop. Call once, after all recording threads are joined.
+void trace_finish(void);
+
+// Name the calling thread's track; call it before the thread's first span.
+// Threads with the same name reuse the rings of exited ones.
+void trace_thread(const char *name);
+
+// Record a span [t0, t1) on the calling thread. arg (bytes) and detail
+// (e.g. a file name, truncated) are optional: 0 and NULL leave them out.
+void trace_span(const char *name, const char *detail, uint64_t t0, uint64_t t1, uint64_t arg);
+
+// t = trace_begin(); ...; trace_end(t, "name", bytes): a span up to now.
+static inline uint64_t trace_begin(void) {
+    return trace_on ? trace_now() : 0;
+}
+
+static inline void trace_end(uint64_t t0, const char *name, uint64_t arg) {
+    if (t0) trace_span(name, NULL, t0, trace_now(), arg);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TRACE_H